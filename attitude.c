@@ -0,0 +1,233 @@
+
+/* Quaternion attitude and latency prediction, see attitude.h. */
+
+#include <math.h>
+#include <string.h>
+#include <time.h>
+#include "attitude.h"
+
+#define DEGREES (float)(M_PI / 180.0)
+
+struct timedAttitude {
+    double sourceTime;      // sender's clock, for the rate
+    double receiveTime;     // CLOCK_MONOTONIC seconds, to place the sample in local time
+    float roll, pitch, yaw;
+    struct quaternion orientation;
+};
+
+struct attitudeFrame frameAttitude;
+
+static struct timedAttitude samples[2];    // [1] is the newest
+static int sampleCount;
+
+static double monotonicSeconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// ------------------------------- quaternions ----------------------------------
+
+static struct quaternion axisAngle(float degrees, float x, float y, float z) {
+    float s = sinf(degrees * DEGREES / 2);
+    struct quaternion q = { cosf(degrees * DEGREES / 2), x * s, y * s, z * s };
+    return q;
+}
+
+static struct quaternion multiplyQuaternion(struct quaternion a, struct quaternion b) {
+    struct quaternion q = {
+        a.w * b.w - a.x * b.x - a.y * b.y - a.z * b.z,
+        a.w * b.x + a.x * b.w + a.y * b.z - a.z * b.y,
+        a.w * b.y - a.x * b.z + a.y * b.w + a.z * b.x,
+        a.w * b.z + a.x * b.y - a.y * b.x + a.z * b.w,
+    };
+    return q;
+}
+
+/* The ball's orientation Rz(roll) Rx(-pitch) Ry(yaw). */
+struct quaternion quaternionFromEuler(float rollDegrees, float pitchDegrees, float yawDegrees) {
+    return multiplyQuaternion(multiplyQuaternion(axisAngle(rollDegrees, 0.0f, 0.0f, 1.0f),
+                                                 axisAngle(-pitchDegrees, 1.0f, 0.0f, 0.0f)),
+                              axisAngle(yawDegrees, 0.0f, 1.0f, 0.0f));
+}
+
+/* Spherical interpolation from a (t = 0) to b (t = 1) along the shorter arc.
+ * t > 1 keeps turning at the same rate beyond b.
+ */
+struct quaternion slerpQuaternion(struct quaternion a, struct quaternion b, float t) {
+    float d = a.w * b.w + a.x * b.x + a.y * b.y + a.z * b.z;
+    float wa, wb, angle, length;
+    struct quaternion q;
+
+    if (d < 0.0f) {
+        d = -d;
+        b.w = -b.w;
+        b.x = -b.x;
+        b.y = -b.y;
+        b.z = -b.z;
+    }
+    if (d > 0.9995f) {      // nearly equal: linear, normalized below
+        wa = 1.0f - t;
+        wb = t;
+    }
+    else {
+        angle = acosf(d);
+        wa = sinf((1.0f - t) * angle) / sinf(angle);
+        wb = sinf(t * angle) / sinf(angle);
+    }
+    q.w = wa * a.w + wb * b.w;
+    q.x = wa * a.x + wb * b.x;
+    q.y = wa * a.y + wb * b.y;
+    q.z = wa * a.z + wb * b.z;
+    length = sqrtf(q.w * q.w + q.x * q.x + q.y * q.y + q.z * q.z);
+    q.w /= length;
+    q.x /= length;
+    q.y /= length;
+    q.z /= length;
+    return q;
+}
+
+/* r[row][column] = the rotation of q. */
+static void rotationOf(struct quaternion q, float r[3][3]) {
+    r[0][0] = 1 - 2 * (q.y * q.y + q.z * q.z);
+    r[0][1] = 2 * (q.x * q.y - q.w * q.z);
+    r[0][2] = 2 * (q.x * q.z + q.w * q.y);
+    r[1][0] = 2 * (q.x * q.y + q.w * q.z);
+    r[1][1] = 1 - 2 * (q.x * q.x + q.z * q.z);
+    r[1][2] = 2 * (q.y * q.z - q.w * q.x);
+    r[2][0] = 2 * (q.x * q.z - q.w * q.y);
+    r[2][1] = 2 * (q.y * q.z + q.w * q.x);
+    r[2][2] = 1 - 2 * (q.x * q.x + q.y * q.y);
+}
+
+// ------------------------------- angles ---------------------------------------
+
+/* degrees + k * 360 closest to near. */
+static float unwrapNear(float degrees, float near) {
+    return near + remainderf(degrees - near, 360.0f);
+}
+
+static float angleDistance(float a, float b) {
+    return fabsf(remainderf(a - b, 360.0f));
+}
+
+/* Takes roll, pitch and yaw back out of r = Rz(roll) Rx(-pitch) Ry(yaw).  Of the
+ * two solutions, the one closest to the given angles wins, and so does their yaw
+ * where roll and yaw cannot be told apart (pitch +-90).
+ */
+static void eulerOf(float r[3][3], float* lpRoll, float* lpPitch, float* lpYaw) {
+    float sinA = fmaxf(fminf(r[2][1], 1.0f), -1.0f);
+    float a = asinf(sinA) / DEGREES;    // the x rotation, -pitch
+    float roll, yaw, otherRoll, otherYaw;
+
+    if (sqrtf(r[0][1] * r[0][1] + r[1][1] * r[1][1]) < 1e-5f) {
+        yaw = *lpYaw;
+        roll = atan2f(r[1][0], r[0][0]) / DEGREES - sinA * yaw;
+        *lpRoll = unwrapNear(roll, *lpRoll);
+        *lpPitch = unwrapNear(-a, *lpPitch);
+        return;
+    }
+    roll = atan2f(-r[0][1], r[1][1]) / DEGREES;
+    yaw = atan2f(-r[2][0], r[2][2]) / DEGREES;
+    otherRoll = roll + 180.0f;
+    otherYaw = yaw + 180.0f;
+    if (angleDistance(otherRoll, *lpRoll) + angleDistance(180.0f + a, *lpPitch) + angleDistance(otherYaw, *lpYaw) <
+            angleDistance(roll, *lpRoll) + angleDistance(-a, *lpPitch) + angleDistance(yaw, *lpYaw)) {
+        roll = otherRoll;
+        yaw = otherYaw;
+        a = 180.0f - a;
+    }
+    *lpRoll = unwrapNear(roll, *lpRoll);
+    *lpPitch = unwrapNear(-a, *lpPitch);
+    *lpYaw = unwrapNear(yaw, *lpYaw);
+}
+
+// ------------------------------- frames ---------------------------------------
+
+/* Keeps the sample for prediction.  Samples with the source time of the newest
+ * one (nothing new) or older are ignored.
+ */
+void addAttitudeSample(double sourceTime, double receiveTime, float rollDegrees, float pitchDegrees,
+                       float yawDegrees) {
+    if (sampleCount > 0 && sourceTime <= samples[1].sourceTime)
+        return;
+    samples[0] = samples[1];
+    samples[1].sourceTime = sourceTime;
+    samples[1].receiveTime = receiveTime;
+    samples[1].roll = rollDegrees;
+    samples[1].pitch = pitchDegrees;
+    samples[1].yaw = yawDegrees;
+    samples[1].orientation = quaternionFromEuler(rollDegrees, pitchDegrees, yawDegrees);
+    if (sampleCount < 2)
+        sampleCount++;
+}
+
+/* The position along the two samples (0 at the older, 1 at the newest) that
+ * corresponds to local time, or a negative value if they cannot predict it.
+ */
+static double samplePosition(double time) {
+    double gap = samples[1].sourceTime - samples[0].sourceTime;
+    double ahead = time - samples[1].receiveTime;
+
+    if (sampleCount < 2 || gap <= 0.0 || gap > ATTITUDE_MAX_GAP || ahead > ATTITUDE_MAX_GAP)
+        return -1.0;
+    if (ahead > ATTITUDE_MAX_PREDICTION)
+        ahead = ATTITUDE_MAX_PREDICTION;
+    return 1.0 + ahead / gap;
+}
+
+/* Fills frameAttitude for a frame that reaches the panel leadSeconds from now.
+ * Without usable samples, or when the globals moved away from the newest sample
+ * (keys, replay), the frame shows the given angles as they are.
+ */
+void beginAttitudeFrame(float rollDegrees, float pitchDegrees, float yawDegrees, double leadSeconds) {
+    float r[3][3];
+    float* m = frameAttitude.sphereMatrix;
+    float c, s;
+    double position = -1.0;
+
+    frameAttitude.roll = rollDegrees;
+    frameAttitude.pitch = pitchDegrees;
+    frameAttitude.yaw = yawDegrees;
+    if (leadSeconds > 0.0 && sampleCount == 2 && samples[1].roll == rollDegrees &&
+            samples[1].pitch == pitchDegrees && samples[1].yaw == yawDegrees)
+        position = samplePosition(monotonicSeconds() + leadSeconds);
+
+    frameAttitude.predicted = position >= 0.0;
+    if (frameAttitude.predicted) {
+        frameAttitude.orientation = slerpQuaternion(samples[0].orientation, samples[1].orientation, (float)position);
+        rotationOf(frameAttitude.orientation, r);
+        eulerOf(r, &frameAttitude.roll, &frameAttitude.pitch, &frameAttitude.yaw);
+    }
+    else {
+        frameAttitude.orientation = quaternionFromEuler(rollDegrees, pitchDegrees, yawDegrees);
+        rotationOf(frameAttitude.orientation, r);
+    }
+
+    // The sphere mesh is first turned into place by Rz(90) Rx(90), which takes its
+    // x, y and z axes to y, z and x.
+    memset(m, 0, 16 * sizeof(float));
+    m[0] = r[0][1];
+    m[1] = r[1][1];
+    m[2] = r[2][1];
+    m[4] = r[0][2];
+    m[5] = r[1][2];
+    m[6] = r[2][2];
+    m[8] = r[0][0];
+    m[9] = r[1][0];
+    m[10] = r[2][0];
+    m[15] = 1.0f;
+
+    // The ring only turns with roll.
+    m = frameAttitude.ringMatrix;
+    c = cosf(frameAttitude.roll * DEGREES);
+    s = sinf(frameAttitude.roll * DEGREES);
+    memset(m, 0, 16 * sizeof(float));
+    m[0] = c;
+    m[1] = s;
+    m[4] = -s;
+    m[5] = c;
+    m[10] = 1.0f;
+    m[14] = RING_DEPTH;
+    m[15] = 1.0f;
+}
@@ -0,0 +1,51 @@
+
+/* Attitude of the ball as a unit quaternion, and the orientation every frame
+ * shows.
+ *
+ * The roll, pitch and yaw globals are what the keys, the mouse, replay and
+ * telemetry set.  beginAttitudeFrame() turns them into frameAttitude once per
+ * frame: the quaternion, the angles the overlay needs and the finished model
+ * matrices of the ball and the ring, so drawing never chains rotations itself.
+ * The ball is q = Rz(roll) Rx(-pitch) Ry(yaw) applied to the sphere mesh turned
+ * into place by Rz(90) Rx(90); with yaw 0 this is exactly the glRotatef() chain
+ * display() used to issue.  Yaw turns the ball about the vertical axis.
+ *
+ * Telemetry samples also go to addAttitudeSample(), which keeps the last two
+ * with their timestamps.  While they are fresh and still what the globals show,
+ * beginAttitudeFrame() slerps along them to the time the frame is expected to
+ * reach the panel: between the samples that is interpolation, past the newest
+ * one it extrapolates at the angular rate the two samples measured, at most
+ * ATTITUDE_MAX_PREDICTION ahead.  Quaternions do not lock at +-90 degrees of
+ * pitch, and the angles for the overlay are taken back out of the predicted
+ * quaternion choosing the solution closest to the globals, so they stay
+ * continuous through loops.
+ */
+
+#ifndef ATTITUDE_H
+#define ATTITUDE_H
+
+#define ATTITUDE_MAX_PREDICTION 0.05    // seconds past the newest sample
+#define ATTITUDE_MAX_GAP 0.25           // samples further apart do not give a rate
+#define RING_DEPTH -0.7f
+
+struct quaternion {
+    float w, x, y, z;
+};
+
+struct attitudeFrame {
+    struct quaternion orientation;
+    float roll, pitch, yaw;             // degrees, near the globals of the same name
+    float sphereMatrix[16];             // column-major model matrices
+    float ringMatrix[16];
+    int predicted;                      // 1 if the frame shows a predicted attitude
+};
+
+extern struct attitudeFrame frameAttitude;
+
+struct quaternion quaternionFromEuler(float rollDegrees, float pitchDegrees, float yawDegrees);
+struct quaternion slerpQuaternion(struct quaternion a, struct quaternion b, float t);
+void addAttitudeSample(double sourceTime, double receiveTime, float rollDegrees, float pitchDegrees,
+                       float yawDegrees);
+void beginAttitudeFrame(float rollDegrees, float pitchDegrees, float yawDegrees, double leadSeconds);
+
+#endif
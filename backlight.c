@@ -0,0 +1,289 @@
+
+/* Backlight brightness writer, see backlight.h. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <glob.h>
+#include <math.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "backlight.h"
+
+#define SENSOR_INTERVAL 0.25        // seconds between ambient light readings
+#define SENSOR_PATH_LENGTH 1024
+
+static pthread_t workerThread;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t wake;
+static int running, stopping;
+
+// Shared with setBacklight(), guarded by lock.
+static int requestedLevel = -1;
+
+// Worker state.
+static int brightnessFd = -1;
+static int truncateFile;            // regular file instead of a sysfs attribute
+static int sensorFd = -1;
+static double sensorScale = 1.0, sensorOffset = 0.0;
+static double writeInterval, rampSeconds;
+
+static double monotonicSeconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Reads one number from a small sysfs file at offset 0.  Returns 0 on failure. */
+static int readNumber(int fd, double* lpValue) {
+    char text[64];
+    ssize_t n = pread(fd, text, sizeof(text) - 1, 0);
+
+    if (n <= 0)
+        return 0;
+    text[n] = '\0';
+    *lpValue = strtod(text, NULL);
+    return 1;
+}
+
+/* Reads a number from the file lpDirectory/lpName, leaving *lpValue alone if the
+ * file does not exist.
+ */
+static void readSensorAttribute(const char* lpDirectory, const char* lpName, double* lpValue) {
+    char path[SENSOR_PATH_LENGTH];
+    int fd;
+
+    snprintf(path, sizeof(path), "%s/%s", lpDirectory, lpName);
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return;
+    readNumber(fd, lpValue);
+    close(fd);
+}
+
+/* Opens the ambient light sensor.  For in_illuminance_raw the IIO scale and
+ * offset next to it convert the reading to lux.
+ */
+static int openSensor(const char* lpPath) {
+    char directory[SENSOR_PATH_LENGTH];
+    const char* lpSlash;
+
+    sensorFd = open(lpPath, O_RDONLY | O_CLOEXEC);
+    if (sensorFd < 0) {
+        fprintf(stderr, "%s:%u: Failed to open %s: %s\n", __FILE__, __LINE__, lpPath, strerror(errno));
+        return 0;
+    }
+    lpSlash = strrchr(lpPath, '/');
+    if (lpSlash != NULL && strcmp(lpSlash + 1, "in_illuminance_raw") == 0 &&
+            (size_t)(lpSlash - lpPath) < sizeof(directory)) {
+        memcpy(directory, lpPath, lpSlash - lpPath);
+        directory[lpSlash - lpPath] = '\0';
+        readSensorAttribute(directory, "in_illuminance_scale", &sensorScale);
+        readSensorAttribute(directory, "in_illuminance_offset", &sensorOffset);
+    }
+    return 1;
+}
+
+/* Maps the ambient light to a factor for the set level, logarithmic in lux. */
+static double ambientGain() {
+    double raw, lux, gain;
+
+    if (!readNumber(sensorFd, &raw))
+        return 1.0;
+    lux = (raw + sensorOffset) * sensorScale;
+    if (lux <= 0.0)
+        return AMBIENT_MIN_GAIN;
+    gain = log10(1.0 + lux) / log10(1.0 + AMBIENT_FULL_LUX);
+    if (gain < AMBIENT_MIN_GAIN)
+        gain = AMBIENT_MIN_GAIN;
+    return gain > 1.0 ? 1.0 : gain;
+}
+
+static void writeLevel(int level) {
+    char text[16];
+    int length = snprintf(text, sizeof(text), "%d\n", level);
+
+    if (pwrite(brightnessFd, text, length, 0) != length) {
+        fprintf(stderr, "%s:%u: Failed to write brightness %d: %s\n", __FILE__, __LINE__, level, strerror(errno));
+        return;
+    }
+    if (truncateFile && ftruncate(brightnessFd, length) != 0)
+        fprintf(stderr, "%s:%u: Failed to truncate the brightness file\n", __FILE__, __LINE__);
+}
+
+/* Sleeps on wake until deadline (CLOCK_MONOTONIC seconds), forever if deadline is
+ * 0.  Called with lock held.
+ */
+static void waitUntil(double deadline) {
+    struct timespec ts;
+
+    if (deadline <= 0.0) {
+        pthread_cond_wait(&wake, &lock);
+        return;
+    }
+    ts.tv_sec = (time_t)deadline;
+    ts.tv_nsec = (long)((deadline - ts.tv_sec) * 1e9);
+    pthread_cond_timedwait(&wake, &lock, &ts);
+}
+
+static void* runWorker(void* lpArg) {
+    int written = -1;                   // level in the file, -1 before the first write
+    int rampFrom = 0, rampGoal = -1;    // current ramp, from rampStart on
+    double rampStart = 0.0, lastWrite = -1e9, nextSensorRead = 0.0;
+    double gain = 1.0;
+    int final;
+
+    pthread_mutex_lock(&lock);
+    while (!stopping) {
+        double now = monotonicSeconds();
+        double deadline = 0.0;
+        int goal, level;
+
+        if (sensorFd >= 0) {
+            if (now >= nextSensorRead) {
+                pthread_mutex_unlock(&lock);
+                gain = ambientGain();
+                pthread_mutex_lock(&lock);
+                nextSensorRead = now + SENSOR_INTERVAL;
+            }
+            deadline = nextSensorRead;
+        }
+
+        if (requestedLevel < 0 || (goal = (int)lround(requestedLevel * gain)) == written) {
+            waitUntil(deadline);
+            continue;
+        }
+        if (now < lastWrite + writeInterval) {
+            // Rate limit; whatever is requested by then is written in one go.
+            if (deadline <= 0.0 || lastWrite + writeInterval < deadline)
+                deadline = lastWrite + writeInterval;
+            waitUntil(deadline);
+            continue;
+        }
+
+        level = goal;
+        if (rampSeconds > 0.0 && written >= 0) {
+            if (goal != rampGoal) {
+                rampFrom = written;
+                rampGoal = goal;
+                rampStart = now;
+            }
+            if (now - rampStart < rampSeconds)
+                level = rampFrom + (int)lround((goal - rampFrom) * (now - rampStart) / rampSeconds);
+            if (level == written) {
+                // Less than one step so far: wait until the next step is due.
+                double due = rampStart + rampSeconds * (abs(written - rampFrom) + 0.5) / abs(goal - rampFrom);
+                if (due > now) {
+                    if (deadline <= 0.0 || due < deadline)
+                        deadline = due;
+                    waitUntil(deadline);
+                    continue;
+                }
+                level += goal > written ? 1 : -1;
+            }
+        }
+
+        pthread_mutex_unlock(&lock);
+        writeLevel(level);
+        pthread_mutex_lock(&lock);
+        written = level;
+        lastWrite = now;
+    }
+
+    // The last level set still reaches the file, whatever the rate and ramp.
+    final = requestedLevel < 0 ? -1 : (int)lround(requestedLevel * gain);
+    pthread_mutex_unlock(&lock);
+    if (final >= 0 && final != written)
+        writeLevel(final);
+    return NULL;
+}
+
+// -------------------------------------------------------------------------------
+
+/* Opens the brightness file (and sensor) and starts the worker.  Returns 0, with
+ * setBacklight() doing nothing, if there is no backlight to write to.
+ */
+int startBacklight(const struct backlightOptions* lpOptions) {
+    pthread_condattr_t attributes;
+    const char* lpPath = lpOptions->lpPath;
+    glob_t globbuf;
+    struct stat st;
+    int result;
+
+    globbuf.gl_pathc = 0;
+    if (lpPath == NULL) {
+        result = glob("/sys/class/backlight/*/brightness", GLOB_ERR, NULL, &globbuf);
+        if (result == GLOB_NOMATCH)
+            fprintf(stderr, "glob error: No match!\n");
+        else if (result == GLOB_NOSPACE)
+            fprintf(stderr, "glob error: No space!\n");
+        else if (result == GLOB_ABORTED)
+            fprintf(stderr, "glob error: Aborted!\n");
+        if (result != 0)
+            return 0;
+        lpPath = globbuf.gl_pathv[0];
+    }
+
+    brightnessFd = open(lpPath, O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+    if (brightnessFd < 0)
+        fprintf(stderr, "%s:%u: Failed to open %s: %s\n", __FILE__, __LINE__, lpPath, strerror(errno));
+    if (globbuf.gl_pathc > 0)
+        globfree(&globbuf);
+    if (brightnessFd < 0)
+        return 0;
+    truncateFile = fstat(brightnessFd, &st) == 0 && S_ISREG(st.st_mode);
+
+    if (lpOptions->lpSensorPath != NULL && !openSensor(lpOptions->lpSensorPath)) {
+        close(brightnessFd);
+        brightnessFd = -1;
+        return 0;
+    }
+    writeInterval = lpOptions->maxRate > 0.0 ? 1.0 / lpOptions->maxRate : 0.0;
+    rampSeconds = lpOptions->rampSeconds;
+
+    pthread_condattr_init(&attributes);
+    pthread_condattr_setclock(&attributes, CLOCK_MONOTONIC);
+    pthread_cond_init(&wake, &attributes);
+    pthread_condattr_destroy(&attributes);
+
+    stopping = 0;
+    if (pthread_create(&workerThread, NULL, runWorker, NULL) != 0) {
+        fprintf(stderr, "%s:%u: Failed to start the backlight thread\n", __FILE__, __LINE__);
+        return 0;
+    }
+    running = 1;
+    return 1;
+}
+
+/* Records the wanted brightness and returns at once. */
+void setBacklight(int level) {
+    if (!running)
+        return;
+    pthread_mutex_lock(&lock);
+    requestedLevel = level < 0 ? 0 : level;
+    pthread_cond_signal(&wake);
+    pthread_mutex_unlock(&lock);
+}
+
+/* Stops the worker after it wrote the last level set, at once. */
+void stopBacklight() {
+    if (!running)
+        return;
+    pthread_mutex_lock(&lock);
+    stopping = 1;
+    pthread_cond_signal(&wake);
+    pthread_mutex_unlock(&lock);
+    pthread_join(workerThread, NULL);
+    running = 0;
+
+    close(brightnessFd);
+    brightnessFd = -1;
+    if (sensorFd >= 0)
+        close(sensorFd);
+    sensorFd = -1;
+    pthread_cond_destroy(&wake);
+}
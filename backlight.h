@@ -0,0 +1,37 @@
+
+/* Backlight brightness writer.  setBacklight() only records the wanted level and
+ * returns immediately; a worker thread writes it to the backlight's sysfs
+ * brightness file, which it keeps open.  Levels set faster than the worker writes
+ * are coalesced, so only the latest one is written.
+ *
+ * The worker writes at most maxRate times per second.  With a ramp time, it
+ * moves the brightness to a new level in steps over that time instead of
+ * jumping to it.
+ *
+ * With an ambient light sensor (an IIO in_illuminance_raw or in_illuminance_input
+ * file), the written level is the set level scaled by the ambient light. The
+ * scale goes from AMBIENT_MIN_GAIN in the dark to 1 at AMBIENT_FULL_LUX and above.
+ *
+ * lpPath NULL picks the brightness file of the first device in /sys/class/backlight.
+ * Any other file works as well; a regular file is truncated to the written value,
+ * which makes it easy to test against a temporary file.
+ */
+
+#ifndef BACKLIGHT_H
+#define BACKLIGHT_H
+
+#define AMBIENT_FULL_LUX 1000.0
+#define AMBIENT_MIN_GAIN 0.1
+
+struct backlightOptions {
+    const char* lpPath;         // brightness file, NULL to search sysfs
+    double maxRate;             // writes per second
+    double rampSeconds;         // 0 to jump to a new level at once
+    const char* lpSensorPath;   // ambient light sensor, NULL for none
+};
+
+int startBacklight(const struct backlightOptions* lpOptions);
+void setBacklight(int level);
+void stopBacklight();
+
+#endif
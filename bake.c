@@ -0,0 +1,384 @@
+
+/* Offline texture baker.  Decodes the given JPEG files once, builds their full mip
+ * chains and writes them as one texture pack (see texpack.h) that the indicator
+ * maps at startup instead of decoding JPEGs:
+ *
+ *        bake-textures textures.pack sphere.jpg ring.jpg
+ *
+ * With --virtual it cuts one large image into the tiles of a virtual texture
+ * (see vtexfile.h) instead:
+ *
+ *        bake-textures --virtual earth.vtex earth.jpg
+ *
+ * That image is never held in memory as a whole: its rows stream from the JPEG
+ * decoder through one band of tile rows per level, and each row pair is averaged
+ * into the next level on the way, so a 32k image bakes in a few tens of MB.
+ *
+ * The output is written to a temporary file first and renamed into place, so a
+ * running indicator never maps a half-written file.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include "image.h"
+#include "texpack.h"
+#include "vtexfile.h"
+
+#define BAKE_ROWS 16                // JPEG rows decoded per call
+
+static uint64_t alignOffset(uint64_t offset) {
+    return (offset + TEXPACK_ALIGNMENT - 1) / TEXPACK_ALIGNMENT * TEXPACK_ALIGNMENT;
+}
+
+/* Strips a leading "./" so "./ring.jpg" and "ring.jpg" name the same entry. */
+static const char* entryName(const char* lpFilename) {
+    while (strncmp(lpFilename, "./", 2) == 0)
+        lpFilename += 2;
+    return lpFilename;
+}
+
+/* Writes one level as RGBA at the current file position. */
+static int writeLevel(FILE* fHandle, const struct imgRawImage* lpImage) {
+    unsigned char* lpRow;
+    unsigned long x, y;
+
+    if ((lpRow = (unsigned char*)malloc(lpImage->width * 4)) == NULL) {
+        fprintf(stderr, "%s:%u: Allocation of lpRow failed\n", __FILE__, __LINE__);
+        return 0;
+    }
+    for (y = 0; y < lpImage->height; y++) {
+        const unsigned char* lpSource = &lpImage->lpData[3 * y * lpImage->width];
+        for (x = 0; x < lpImage->width; x++) {
+            lpRow[4 * x + 0] = lpSource[3 * x + 0];
+            lpRow[4 * x + 1] = lpSource[3 * x + 1];
+            lpRow[4 * x + 2] = lpSource[3 * x + 2];
+            lpRow[4 * x + 3] = 255;
+        }
+        if (fwrite(lpRow, 4, lpImage->width, fHandle) != lpImage->width) {
+            free(lpRow);
+            return 0;
+        }
+    }
+    free(lpRow);
+    return 1;
+}
+
+/* Decodes lpFilename, fills in lpEntry (levels placed from *lpOffset on) and
+ * writes the level data.  Returns 0 on failure.
+ */
+static int bakeTexture(FILE* fHandle, char* lpFilename, struct texPackEntry* lpEntry, uint64_t* lpOffset) {
+    struct imgRawImage *lpImage, *lpNext;
+    struct stat st;
+    uint32_t level;
+
+    if (stat(lpFilename, &st) != 0) {
+        fprintf(stderr, "%s:%u: Failed to stat %s\n", __FILE__, __LINE__, lpFilename);
+        return 0;
+    }
+    if (strlen(entryName(lpFilename)) >= TEXPACK_NAME_LENGTH) {
+        fprintf(stderr, "%s:%u: File name %s is too long\n", __FILE__, __LINE__, lpFilename);
+        return 0;
+    }
+    if ((lpImage = loadJpegImageFile(lpFilename)) == NULL)
+        return 0;
+
+    memset(lpEntry, 0, sizeof(*lpEntry));
+    strcpy(lpEntry->name, entryName(lpFilename));
+    lpEntry->sourceMtime = st.st_mtime;
+    lpEntry->sourceSize = st.st_size;
+
+    for (level = 0; level < TEXPACK_MAX_LEVELS; level++) {
+        struct texPackLevel* lpLevel = &lpEntry->levels[level];
+        lpLevel->width = lpImage->width;
+        lpLevel->height = lpImage->height;
+        lpLevel->offset = alignOffset(*lpOffset);
+        lpLevel->size = (uint64_t)lpImage->width * lpImage->height * 4;
+        *lpOffset = lpLevel->offset + lpLevel->size;
+
+        if (fseek(fHandle, (long)lpLevel->offset, SEEK_SET) != 0 || !writeLevel(fHandle, lpImage)) {
+            fprintf(stderr, "%s:%u: Failed to write level %u of %s\n", __FILE__, __LINE__, level, lpFilename);
+            freeImage(lpImage);
+            return 0;
+        }
+        lpEntry->levelCount = level + 1;
+        if (lpImage->width == 1 && lpImage->height == 1)
+            break;
+
+        lpNext = downsampleImage(lpImage);
+        freeImage(lpImage);
+        if ((lpImage = lpNext) == NULL)
+            return 0;
+    }
+    freeImage(lpImage);
+
+    printf("%s: %ux%u, %u levels\n", lpEntry->name, lpEntry->levels[0].width, lpEntry->levels[0].height,
+           lpEntry->levelCount);
+    return 1;
+}
+
+// ------------------------------- virtual texture ------------------------------
+
+struct bakeLevel {
+    struct vtexLevel* lpLevel;
+    unsigned char* lpBand;          // VTEX_PAGE RGBA rows; row i is texel row bandRow * VTEX_TILE - 1 + i
+    unsigned char* lpPending;       // even row waiting for the odd one to go to the next level
+    unsigned char* lpHalf;          // their average, a row of the next level
+    uint32_t rows;                  // rows received
+    uint32_t bandRow;               // tile row being collected
+};
+
+static struct bakeLevel bakeLevels[VTEX_MAX_LEVELS];
+static int bakeLevelCount;
+static int bakeFile;
+static uint64_t bakeDataOffset;
+
+/* Cuts the band into its tiles and writes them at their places in the file. */
+static int writeBand(struct bakeLevel* lpBake) {
+    const struct vtexLevel* lpLevel = lpBake->lpLevel;
+    unsigned char tile[VTEX_TILE_BYTES];
+    uint32_t tx, i, j;
+    uint64_t number;
+
+    for (tx = 0; tx < lpLevel->tilesX; tx++) {
+        for (j = 0; j < VTEX_PAGE; j++) {
+            const uint32_t* lpRow = (const uint32_t*)(lpBake->lpBand + (size_t)j * lpLevel->width * 4);
+            uint32_t* lpTileRow = (uint32_t*)(tile + j * VTEX_PAGE * 4);
+            for (i = 0; i < VTEX_PAGE; i++) {
+                int64_t x = (int64_t)tx * VTEX_TILE - VTEX_BORDER + i;
+                lpTileRow[i] = lpRow[(x + lpLevel->width) % lpLevel->width];    // wraps around in s
+            }
+        }
+        number = lpLevel->firstTile + (uint64_t)lpBake->bandRow * lpLevel->tilesX + tx;
+        if (pwrite(bakeFile, tile, sizeof(tile), (off_t)(bakeDataOffset + number * VTEX_TILE_BYTES)) !=
+                (ssize_t)sizeof(tile))
+            return 0;
+    }
+    lpBake->bandRow++;
+    return 1;
+}
+
+/* Takes the next RGBA row of level l: collects it into the band, writes the band
+ * once its last row is in, and passes row pairs on to the next level.
+ */
+static int addBakeRow(int l, const unsigned char* lpRow) {
+    struct bakeLevel* lpBake = &bakeLevels[l];
+    const struct vtexLevel* lpLevel = lpBake->lpLevel;
+    size_t rowBytes = (size_t)lpLevel->width * 4;
+    uint32_t y = lpBake->rows++;
+    uint32_t slot = y + VTEX_BORDER - lpBake->bandRow * VTEX_TILE;
+    unsigned char* lpHalf = lpBake->lpHalf;
+    uint32_t x, x1;
+    int c;
+
+    memcpy(lpBake->lpBand + slot * rowBytes, lpRow, rowBytes);
+    if (y == 0)
+        memcpy(lpBake->lpBand, lpRow, rowBytes);     // the border above repeats the top row
+    if (slot == VTEX_PAGE - 1) {
+        if (!writeBand(lpBake))
+            return 0;
+        // The last two rows are the top border and first row of the next band.
+        memmove(lpBake->lpBand, lpBake->lpBand + VTEX_TILE * rowBytes, 2 * rowBytes);
+    }
+    if (y == lpLevel->height - 1) {
+        // The bottom border and the rows past the image repeat the last row.
+        while (lpBake->bandRow < lpLevel->tilesY) {
+            for (slot = y + VTEX_BORDER - lpBake->bandRow * VTEX_TILE + 1; slot < VTEX_PAGE; slot++)
+                memcpy(lpBake->lpBand + slot * rowBytes, lpRow, rowBytes);
+            if (!writeBand(lpBake))
+                return 0;
+        }
+    }
+
+    if (l + 1 == bakeLevelCount)
+        return 1;
+    if (y % 2 == 0 || lpLevel->height == 1)
+        memcpy(lpBake->lpPending, lpRow, rowBytes);
+    if (y % 2 == 0 && lpLevel->height > 1)
+        return 1;
+    // Same averaging as downsampleImage(); an odd last row or column is dropped.
+    for (x = 0; x < bakeLevels[l + 1].lpLevel->width; x++) {
+        x1 = 2 * x + 1 < lpLevel->width ? 2 * x + 1 : lpLevel->width - 1;
+        for (c = 0; c < 4; c++)
+            lpHalf[4 * x + c] = (lpBake->lpPending[8 * x + c] + lpBake->lpPending[4 * x1 + c] +
+                               lpRow[8 * x + c] + lpRow[4 * x1 + c] + 2) / 4;
+    }
+    return addBakeRow(l + 1, lpHalf);
+}
+
+/* Lays out the levels and tiles of a width x height image in lpHeader. */
+static void layoutVirtualTexture(struct vtexHeader* lpHeader, uint32_t width, uint32_t height) {
+    uint64_t tiles = 0;
+    uint32_t l;
+
+    memset(lpHeader, 0, sizeof(*lpHeader));
+    lpHeader->magic = VTEX_MAGIC;
+    lpHeader->version = VTEX_VERSION;
+    for (l = 0; l < VTEX_MAX_LEVELS; l++) {
+        struct vtexLevel* lpLevel = &lpHeader->levels[l];
+        lpLevel->width = width;
+        lpLevel->height = height;
+        lpLevel->tilesX = (width + VTEX_TILE - 1) / VTEX_TILE;
+        lpLevel->tilesY = (height + VTEX_TILE - 1) / VTEX_TILE;
+        lpLevel->firstTile = tiles;
+        tiles += (uint64_t)lpLevel->tilesX * lpLevel->tilesY;
+        lpHeader->levelCount = l + 1;
+        if (width <= VTEX_TILE && height <= VTEX_TILE)
+            break;
+        width = width > 1 ? width / 2 : 1;
+        height = height > 1 ? height / 2 : 1;
+    }
+    lpHeader->tileCount = tiles;
+    lpHeader->dataOffset = (sizeof(*lpHeader) + VTEX_ALIGNMENT - 1) / VTEX_ALIGNMENT * VTEX_ALIGNMENT;
+}
+
+/* Streams lpFilename into the tiles of a virtual texture.  Returns 0 on failure. */
+static int bakeVirtualTexture(char* lpFilename, char* lpOutput) {
+    struct jpegRowReader* lpReader;
+    struct vtexHeader header;
+    unsigned char *lpRows = NULL, *lpRow = NULL;
+    unsigned long width, height;
+    unsigned int rows, i, x;
+    char tempFilename[4096];
+    int l, ok = 0;
+
+    if ((lpReader = openJpegRows(lpFilename, &width, &height)) == NULL)
+        return 0;
+    layoutVirtualTexture(&header, width, height);
+    if (header.levels[header.levelCount - 1].width > VTEX_TILE ||
+            header.levels[header.levelCount - 1].height > VTEX_TILE) {
+        fprintf(stderr, "%s:%u: %s is too large for a virtual texture\n", __FILE__, __LINE__, lpFilename);
+        closeJpegRows(lpReader);
+        return 0;
+    }
+
+    bakeLevelCount = header.levelCount;
+    for (l = 0; l < bakeLevelCount; l++) {
+        bakeLevels[l].lpLevel = &header.levels[l];
+        bakeLevels[l].lpBand = (unsigned char*)malloc((size_t)VTEX_PAGE * header.levels[l].width * 4);
+        bakeLevels[l].lpPending = (unsigned char*)malloc((size_t)header.levels[l].width * 4);
+        bakeLevels[l].lpHalf = (unsigned char*)malloc((size_t)header.levels[l].width * 2 + 4);
+        if (bakeLevels[l].lpBand == NULL || bakeLevels[l].lpPending == NULL || bakeLevels[l].lpHalf == NULL) {
+            fprintf(stderr, "%s:%u: Allocation of level %d failed\n", __FILE__, __LINE__, l);
+            goto done;
+        }
+    }
+    lpRows = (unsigned char*)malloc((size_t)BAKE_ROWS * width * 3);
+    lpRow = (unsigned char*)malloc((size_t)width * 4);
+    if (lpRows == NULL || lpRow == NULL) {
+        fprintf(stderr, "%s:%u: Allocation of lpRows failed\n", __FILE__, __LINE__);
+        goto done;
+    }
+
+    snprintf(tempFilename, sizeof(tempFilename), "%s.tmp", lpOutput);
+    if ((bakeFile = open(tempFilename, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0) {
+        fprintf(stderr, "%s:%u: Failed to write file %s\n", __FILE__, __LINE__, tempFilename);
+        goto done;
+    }
+    bakeDataOffset = header.dataOffset;
+
+    while ((rows = readJpegRows(lpReader, lpRows, BAKE_ROWS)) > 0) {
+        for (i = 0; i < rows; i++) {
+            const unsigned char* lpSource = lpRows + (size_t)i * width * 3;
+            for (x = 0; x < width; x++) {
+                lpRow[4 * x + 0] = lpSource[3 * x + 0];
+                lpRow[4 * x + 1] = lpSource[3 * x + 1];
+                lpRow[4 * x + 2] = lpSource[3 * x + 2];
+                lpRow[4 * x + 3] = 255;
+            }
+            if (!addBakeRow(0, lpRow)) {
+                fprintf(stderr, "%s:%u: Failed to write file %s\n", __FILE__, __LINE__, tempFilename);
+                close(bakeFile);
+                remove(tempFilename);
+                goto done;
+            }
+        }
+    }
+
+    if (bakeLevels[0].rows != height || pwrite(bakeFile, &header, sizeof(header), 0) != (ssize_t)sizeof(header) ||
+            close(bakeFile) != 0) {
+        fprintf(stderr, "%s:%u: Failed to write file %s\n", __FILE__, __LINE__, tempFilename);
+        remove(tempFilename);
+        goto done;
+    }
+    if (rename(tempFilename, lpOutput) != 0) {
+        fprintf(stderr, "%s:%u: Failed to rename %s to %s\n", __FILE__, __LINE__, tempFilename, lpOutput);
+        remove(tempFilename);
+        goto done;
+    }
+    printf("%s: %lux%lu, %u levels, %llu tiles\n", lpOutput, width, height, header.levelCount,
+           (unsigned long long)header.tileCount);
+    ok = 1;
+
+done:
+    for (l = 0; l < bakeLevelCount; l++) {
+        free(bakeLevels[l].lpBand);
+        free(bakeLevels[l].lpPending);
+        free(bakeLevels[l].lpHalf);
+    }
+    free(lpRows);
+    free(lpRow);
+    closeJpegRows(lpReader);
+    return ok;
+}
+
+int main(int argc, char** argv) {
+    struct texPackHeader header;
+    struct texPackEntry* lpEntries;
+    char tempFilename[4096];
+    uint64_t offset;
+    FILE* fHandle;
+    int count = argc - 2;
+    int i;
+
+    if (argc == 4 && strcmp(argv[1], "--virtual") == 0)
+        return bakeVirtualTexture(argv[3], argv[2]) ? 0 : 1;
+    if (argc < 3) {
+        fprintf(stderr, "usage: %s PACK IMAGE.jpg...\n       %s --virtual FILE.vtex IMAGE.jpg\n", argv[0], argv[0]);
+        return 2;
+    }
+    if ((lpEntries = (struct texPackEntry*)calloc(count, sizeof(struct texPackEntry))) == NULL) {
+        fprintf(stderr, "%s:%u: Allocation of lpEntries failed\n", __FILE__, __LINE__);
+        return 1;
+    }
+
+    snprintf(tempFilename, sizeof(tempFilename), "%s.tmp", argv[1]);
+    fHandle = fopen(tempFilename, "wb");
+    if (fHandle == NULL) {
+        fprintf(stderr, "%s:%u: Failed to write file %s\n", __FILE__, __LINE__, tempFilename);
+        return 1;
+    }
+
+    offset = sizeof(header) + count * sizeof(struct texPackEntry);
+    for (i = 0; i < count; i++) {
+        if (!bakeTexture(fHandle, argv[i + 2], &lpEntries[i], &offset)) {
+            fclose(fHandle);
+            remove(tempFilename);
+            return 1;
+        }
+    }
+
+    // The directory goes in last, once every level offset is known.
+    memset(&header, 0, sizeof(header));
+    header.magic = TEXPACK_MAGIC;
+    header.version = TEXPACK_VERSION;
+    header.textureCount = count;
+    if (fseek(fHandle, 0, SEEK_SET) != 0 || fwrite(&header, sizeof(header), 1, fHandle) != 1 ||
+            fwrite(lpEntries, sizeof(struct texPackEntry), count, fHandle) != (size_t)count ||
+            fclose(fHandle) != 0) {
+        fprintf(stderr, "%s:%u: Failed to write file %s\n", __FILE__, __LINE__, tempFilename);
+        remove(tempFilename);
+        return 1;
+    }
+    if (rename(tempFilename, argv[1]) != 0) {
+        fprintf(stderr, "%s:%u: Failed to rename %s to %s\n", __FILE__, __LINE__, tempFilename, argv[1]);
+        remove(tempFilename);
+        return 1;
+    }
+
+    free(lpEntries);
+    return 0;
+}
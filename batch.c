@@ -0,0 +1,303 @@
+/* Batch rendering, see batch.h. */
+
+#include <GL/gl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include "indicator.h"
+#include "headless.h"
+#include "texture.h"
+#include "batch.h"
+
+struct batchAttitude {
+    float roll, pitch, yaw;
+};
+
+/* What a worker reports back, in memory shared with the parent. */
+struct batchResult {
+    long images;
+    double seconds;         // from the first frame until the last image is written
+};
+
+static const struct batchOptions* lpBatch;
+static struct batchAttitude* lpAttitudes;  // read before the fork, shared by the workers
+static long attitudeCount;
+static size_t imageBytes;
+static int rawFd = -1;                      // DIR/images.rgb with BATCH_RAW
+
+// Shared by a worker's renderer and writer, guarded by lock.  The writer only
+// touches queued images, so the renderer fills the next free one without the lock.
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t imageQueued = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t imageWritten = PTHREAD_COND_INITIALIZER;
+static unsigned char* lpQueue[BATCH_QUEUE_IMAGES];
+static long queueIndex[BATCH_QUEUE_IMAGES];
+static int queueHead, queueCount;
+static int stopping;
+static int writeFailed;
+
+static double nowSeconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Reads the attitude list into lpAttitudes.  A line that does not parse fails the
+ * whole batch, as skipping it would shift the numbers of all images after it.
+ * Returns 0 on failure.
+ */
+static int readAttitudeList(const char* lpFilename) {
+    FILE* fHandle;
+    char* lpLine = NULL;
+    size_t lineSize = 0;
+    long capacity = 0, lineNumber = 0;
+    int ok = 1;
+
+    fHandle = fopen(lpFilename, "r");
+    if (fHandle == NULL) {
+        fprintf(stderr, "%s:%u: Failed to open %s: %s\n", __FILE__, __LINE__, lpFilename, strerror(errno));
+        return 0;
+    }
+    while (getline(&lpLine, &lineSize, fHandle) >= 0) {
+        struct batchAttitude attitude = { 0.0f, 0.0f, 0.0f };
+        char* lpText = lpLine + strspn(lpLine, " \t");
+
+        lineNumber++;
+        if (*lpText == '#' || *lpText == '\n' || *lpText == '\r' || *lpText == 0)
+            continue;
+        if (sscanf(lpText, "%f %f %f", &attitude.roll, &attitude.pitch, &attitude.yaw) < 2) {
+            fprintf(stderr, "%s:%u: %s:%ld: expected ROLL PITCH [YAW]\n", __FILE__, __LINE__, lpFilename, lineNumber);
+            ok = 0;
+            break;
+        }
+        if (attitudeCount == capacity) {
+            struct batchAttitude* lpGrown;
+            capacity = capacity > 0 ? capacity * 2 : 1024;
+            lpGrown = (struct batchAttitude*)realloc(lpAttitudes, capacity * sizeof(struct batchAttitude));
+            if (lpGrown == NULL) {
+                fprintf(stderr, "%s:%u: Allocation of lpAttitudes failed\n", __FILE__, __LINE__);
+                ok = 0;
+                break;
+            }
+            lpAttitudes = lpGrown;
+        }
+        lpAttitudes[attitudeCount++] = attitude;
+    }
+    free(lpLine);
+    fclose(fHandle);
+    return ok;
+}
+
+// ------------------------------- writer thread --------------------------------
+
+/* Writes image index.  Returns 0 on failure. */
+static int writeImage(long index, const unsigned char* lpRgb) {
+    char filename[1024];
+    off_t offset = (off_t)index * imageBytes;
+    size_t written = 0;
+    ssize_t n;
+
+    if (lpBatch->format == BATCH_PPM) {
+        snprintf(filename, sizeof(filename), "%s/%08ld.ppm", lpBatch->lpOutputDir, index);
+        return writePPMFile(filename, lpRgb, lpBatch->size, lpBatch->size);
+    }
+    while (written < imageBytes) {
+        n = pwrite(rawFd, lpRgb + written, imageBytes - written, offset + written);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0) {
+            fprintf(stderr, "%s:%u: Failed to write image %ld: %s\n", __FILE__, __LINE__, index, strerror(errno));
+            return 0;
+        }
+        written += n;
+    }
+    return 1;
+}
+
+static void* runWriter(void* lpArgument) {
+    (void)lpArgument;
+    pthread_mutex_lock(&lock);
+    for (;;) {
+        while (queueCount == 0 && !stopping)
+            pthread_cond_wait(&imageQueued, &lock);
+        if (queueCount == 0)
+            break;
+        pthread_mutex_unlock(&lock);
+
+        if (!writeFailed && !writeImage(queueIndex[queueHead], lpQueue[queueHead]))
+            writeFailed = 1;    // keep draining the queue so the renderer never blocks
+
+        pthread_mutex_lock(&lock);
+        queueHead = (queueHead + 1) % BATCH_QUEUE_IMAGES;
+        queueCount--;
+        pthread_cond_signal(&imageWritten);
+    }
+    pthread_mutex_unlock(&lock);
+    return NULL;
+}
+
+// ------------------------------- worker process -------------------------------
+
+/* Reads the frame just drawn into the next free queue entry and hands it to the
+ * writer, waiting while the queue is full.
+ */
+static void queueImage(long index) {
+    int slot;
+
+    pthread_mutex_lock(&lock);
+    while (queueCount == BATCH_QUEUE_IMAGES)
+        pthread_cond_wait(&imageWritten, &lock);
+    slot = (queueHead + queueCount) % BATCH_QUEUE_IMAGES;
+    pthread_mutex_unlock(&lock);
+
+    readHeadlessPixels(lpQueue[slot]);
+    queueIndex[slot] = index;
+
+    pthread_mutex_lock(&lock);
+    queueCount++;
+    pthread_cond_signal(&imageQueued);
+    pthread_mutex_unlock(&lock);
+}
+
+/* Body of worker k: renders its share of the list in its own context.  Returns
+ * the exit status of the worker process.
+ */
+static int renderShard(int k, int workers, struct batchResult* lpResult) {
+    pthread_t writerThread;
+    double start;
+    long i;
+    int slot, status = 1;
+
+    if (!createHeadlessContext(lpBatch->size, lpBatch->size))
+        return 1;
+    initGL();
+    reshape(lpBatch->size, lpBatch->size);
+
+    for (slot = 0; slot < BATCH_QUEUE_IMAGES; slot++) {
+        if ((lpQueue[slot] = (unsigned char*)malloc(imageBytes)) == NULL) {
+            fprintf(stderr, "%s:%u: Allocation of lpQueue failed\n", __FILE__, __LINE__);
+            goto done;
+        }
+    }
+    if (pthread_create(&writerThread, NULL, runWriter, NULL) != 0) {
+        fprintf(stderr, "%s:%u: Failed to start the image writer\n", __FILE__, __LINE__);
+        goto done;
+    }
+
+    start = nowSeconds();
+    for (i = k; i < attitudeCount; i += workers) {
+        roll = lpAttitudes[i].roll;
+        pitch = lpAttitudes[i].pitch;
+        yaw = lpAttitudes[i].yaw;
+        display();
+        queueImage(i);
+        lpResult->images++;
+    }
+
+    pthread_mutex_lock(&lock);
+    stopping = 1;
+    pthread_cond_signal(&imageQueued);
+    pthread_mutex_unlock(&lock);
+    pthread_join(writerThread, NULL);
+    lpResult->seconds = nowSeconds() - start;
+    status = writeFailed;
+
+done:
+    for (slot = 0; slot < BATCH_QUEUE_IMAGES; slot++)
+        free(lpQueue[slot]);
+    destroyHeadlessContext();
+    return status;
+}
+
+// -------------------------------------------------------------------------------
+
+/* Renders the list with lpOptions->workers processes and reports the throughput.
+ * Must be called before any GL context exists.  Returns the process exit status:
+ * 0 when every image was written.
+ */
+int runBatch(const struct batchOptions* lpOptions) {
+    struct batchResult* lpResults;
+    char filename[1024];
+    double start, seconds;
+    long images = 0;
+    int workers, started, k, status = 0;
+
+    lpBatch = lpOptions;
+    imageBytes = (size_t)lpOptions->size * lpOptions->size * 3;
+    if (!readAttitudeList(lpOptions->lpListPath))
+        return 1;
+    if (attitudeCount == 0) {
+        fprintf(stderr, "%s:%u: No attitudes in %s\n", __FILE__, __LINE__, lpOptions->lpListPath);
+        return 1;
+    }
+
+    workers = lpOptions->workers > 0 ? lpOptions->workers : (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (workers < 1)
+        workers = 1;
+    if (workers > attitudeCount)
+        workers = (int)attitudeCount;
+
+    if (lpOptions->format == BATCH_RAW) {
+        snprintf(filename, sizeof(filename), "%s/images.rgb", lpOptions->lpOutputDir);
+        rawFd = open(filename, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (rawFd < 0 || ftruncate(rawFd, (off_t)attitudeCount * imageBytes) != 0) {
+            fprintf(stderr, "%s:%u: Failed to create %s: %s\n", __FILE__, __LINE__, filename, strerror(errno));
+            return 1;
+        }
+    }
+
+    lpResults = (struct batchResult*)mmap(NULL, workers * sizeof(struct batchResult), PROT_READ | PROT_WRITE,
+                                          MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (lpResults == MAP_FAILED) {
+        fprintf(stderr, "%s:%u: Failed to map the worker results: %s\n", __FILE__, __LINE__, strerror(errno));
+        return 1;
+    }
+    memset(lpResults, 0, workers * sizeof(struct batchResult));
+
+    // Decode once; the workers get the pixels through fork().
+    startTextureDecode(lpOptions->size, lpOptions->size);
+    finishTextureDecode();
+    fflush(stdout);
+
+    start = nowSeconds();
+    for (started = 0; started < workers; started++) {
+        pid_t pid = fork();
+        if (pid == 0)
+            _exit(renderShard(started, workers, &lpResults[started]));
+        if (pid < 0) {
+            fprintf(stderr, "%s:%u: Failed to start worker %d: %s\n", __FILE__, __LINE__, started, strerror(errno));
+            status = 1;
+            break;
+        }
+    }
+    for (k = 0; k < started; k++) {
+        int workerStatus;
+        if (wait(&workerStatus) < 0 || !WIFEXITED(workerStatus) || WEXITSTATUS(workerStatus) != 0)
+            status = 1;
+    }
+    seconds = nowSeconds() - start;
+
+    for (k = 0; k < started; k++) {
+        printf("worker %d: %ld images in %.2f s, %.1f images/s\n", k, lpResults[k].images, lpResults[k].seconds,
+               lpResults[k].seconds > 0.0 ? lpResults[k].images / lpResults[k].seconds : 0.0);
+        images += lpResults[k].images;
+    }
+    printf("batch: %ld of %ld images at %dx%d by %d workers in %.2f s, %.1f images/s, %.1f images/s per worker\n",
+           images, attitudeCount, lpOptions->size, lpOptions->size, started, seconds,
+           images / seconds, started > 0 ? images / seconds / started : 0.0);
+    if (images != attitudeCount)
+        status = 1;
+
+    munmap(lpResults, workers * sizeof(struct batchResult));
+    if (rawFd >= 0)
+        close(rawFd);
+    free(lpAttitudes);
+    return status;
+}
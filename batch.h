@@ -0,0 +1,45 @@
+/* Batch rendering of attitude lists into image files, for synthetic training
+ * data.  runBatch() reads a list with one attitude per line,
+ *
+ *    ROLL PITCH
+ *    ROLL PITCH YAW
+ *
+ * in degrees (blank lines and lines starting with # are skipped), and renders
+ * every entry at size x size pixels.  Image i, counting from 0 over the entries,
+ * goes to
+ *
+ *    DIR/NNNNNNNN.ppm      with BATCH_PPM, i in eight digits
+ *    DIR/images.rgb        with BATCH_RAW, top-down RGB at offset i * size * size * 3
+ *
+ * The work is split over workers, each a forked process with its own headless
+ * context (see headless.h): the renderer keeps its state in module statics, one
+ * context per process.  The textures are decoded once before the fork and the
+ * workers share the decoded pixels.  Worker k renders entries k, k + workers,
+ * ..., so every worker gets the same mix of attitudes.  A writer thread per worker
+ * writes the files; the renderer hands it images through a queue of
+ * BATCH_QUEUE_IMAGES and waits when that is full, so memory stays bounded
+ * however long the list.
+ *
+ * At the end the images per second are reported, in total and per worker:
+ *
+ *    ./glut-starter --batch attitudes.txt out --batch-workers 4
+ */
+
+#ifndef BATCH_H
+#define BATCH_H
+
+#define BATCH_QUEUE_IMAGES 8
+
+enum batchFormat { BATCH_PPM, BATCH_RAW };
+
+struct batchOptions {
+    const char* lpListPath;     // attitude list
+    const char* lpOutputDir;    // existing directory the images are written to
+    int workers;                // processes, 0 for one per online CPU
+    int size;                   // width and height of the images
+    enum batchFormat format;
+};
+
+int runBatch(const struct batchOptions* lpOptions);
+
+#endif
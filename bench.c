@@ -0,0 +1,278 @@
+
+/* Headless benchmark, see bench.h.  Must be called with a current headless
+ * context after initGL().
+ */
+
+#include <GL/gl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+#include <errno.h>
+#include "indicator.h"
+#include "headless.h"
+#include "wall.h"
+#include "recording.h"
+#include "glstate.h"
+#include "bench.h"
+
+#define WARMUP_FRAMES 10
+#define GOLDEN_SIZE 256
+#define GOLDEN_TOLERANCE 16        // per channel difference still counted as equal
+#define GOLDEN_MAX_DIFFERING 0.005 // fraction of pixels allowed to differ
+
+static const int wallCounts[] = { 1, 4, 16, 64, 256, 1024 };
+
+static const int goldenAttitudes[][2] = {   // roll, pitch
+    {   0,   0 },
+    {  25,  15 },
+    { -40, 330 },
+    { 120,  90 },
+};
+
+static double nowMilliseconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+static int compareDoubles(const void* a, const void* b) {
+    double da = *(const double*)a, db = *(const double*)b;
+    return (da > db) - (da < db);
+}
+
+/* Nearest-rank percentile of an ascending array. */
+static double percentile(const double* lpSorted, int count, double p) {
+    int rank = (int)ceil(p / 100.0 * count);
+    if (rank < 1)
+        rank = 1;
+    return lpSorted[rank - 1];
+}
+
+/* Sets the attitude for frame i of n: three full roll oscillations of +-60 degrees
+ * while pitch turns twice all the way round.
+ */
+static void setSweepAttitude(int i, int n) {
+    double t = (double)i / n;
+    changeAttitude((float)(60.0 * sin(2 * M_PI * 3 * t)), (float)fmod(720.0 * t, 360.0));   // recorded with --record
+}
+
+static int checkGoldenImages(const struct benchOptions* lpOptions) {
+    char filename[1024];
+    unsigned char* lpFrame;
+    int failures = 0;
+    int k;
+
+    if (!resizeHeadlessFramebuffer(GOLDEN_SIZE, GOLDEN_SIZE))
+        return 1;
+    reshape(GOLDEN_SIZE, GOLDEN_SIZE);
+
+    if ((lpFrame = (unsigned char*)malloc(GOLDEN_SIZE * GOLDEN_SIZE * 3)) == NULL) {
+        fprintf(stderr, "%s:%u: Allocation of lpFrame failed\n", __FILE__, __LINE__);
+        return 1;
+    }
+
+    for (k = 0; k < (int)(sizeof(goldenAttitudes) / sizeof(goldenAttitudes[0])); k++) {
+        roll = goldenAttitudes[k][0];
+        pitch = goldenAttitudes[k][1];
+        display();
+        readHeadlessPixels(lpFrame);
+        snprintf(filename, sizeof(filename), "%s/roll%d_pitch%d.ppm", lpOptions->goldenDir,
+                 goldenAttitudes[k][0], goldenAttitudes[k][1]);
+
+        if (lpOptions->updateGolden) {
+            if (!writePPMFile(filename, lpFrame, GOLDEN_SIZE, GOLDEN_SIZE))
+                failures++;
+            else
+                printf("golden %s: written\n", filename);
+        }
+        else {
+            int goldenWidth, goldenHeight, differing = 0, i;
+            unsigned char* lpGolden = readPPMFile(filename, &goldenWidth, &goldenHeight);
+            if (lpGolden == NULL || goldenWidth != GOLDEN_SIZE || goldenHeight != GOLDEN_SIZE) {
+                printf("golden %s: MISSING\n", filename);
+                free(lpGolden);
+                failures++;
+                continue;
+            }
+            for (i = 0; i < GOLDEN_SIZE * GOLDEN_SIZE; i++) {
+                const unsigned char *a = lpFrame + i * 3, *b = lpGolden + i * 3;
+                if (abs(a[0] - b[0]) > GOLDEN_TOLERANCE || abs(a[1] - b[1]) > GOLDEN_TOLERANCE ||
+                        abs(a[2] - b[2]) > GOLDEN_TOLERANCE)
+                    differing++;
+            }
+            free(lpGolden);
+            if (differing > GOLDEN_MAX_DIFFERING * GOLDEN_SIZE * GOLDEN_SIZE) {
+                printf("golden %s: FAILED (%d pixels differ)\n", filename, differing);
+                failures++;
+            }
+            else {
+                printf("golden %s: ok (%d pixels differ)\n", filename, differing);
+            }
+        }
+    }
+    free(lpFrame);
+    return failures;
+}
+
+static unsigned long sweepIssued, sweepSkipped;    // GL state calls of the timed frames
+
+/* Renders the warmup and the timed sweep, leaving the frame times sorted in
+ * lpTimes and the GL state calls of the timed frames in sweepIssued and
+ * sweepSkipped.  Returns the total time in milliseconds.
+ */
+
+static double timeSweep(double* lpTimes, int frames) {
+    unsigned long issued, skipped;
+    double total = 0.0, start;
+    int i;
+
+    for (i = 0; i < WARMUP_FRAMES; i++) {
+        setSweepAttitude(i, frames);
+        display();
+    }
+    glStateCounts(&issued, &skipped);
+    for (i = 0; i < frames; i++) {
+        setSweepAttitude(i, frames);
+        start = nowMilliseconds();
+        display();
+        lpTimes[i] = nowMilliseconds() - start;
+        total += lpTimes[i];
+    }
+    glStateCounts(&sweepIssued, &sweepSkipped);
+    sweepIssued -= issued;
+    sweepSkipped -= skipped;
+    qsort(lpTimes, frames, sizeof(double), compareDoubles);
+    return total;
+}
+
+/* Times the wall for every entry of wallCounts.  Indicator 0 follows the sweep;
+ * the others hold fixed attitudes, so every indicator looks different.
+ */
+static void runWallSweep(double* lpTimes, int frames) {
+    double total;
+    int k, i;
+
+    printf("renderer: %s\n", (const char*)glGetString(GL_RENDERER));
+    printf("frames: %d per count at %dx%d\n", frames, width, height);
+    fleetTelemetry = 0;
+    for (k = 0; k < (int)(sizeof(wallCounts) / sizeof(wallCounts[0])); k++) {
+        wallCount = wallCounts[k];
+        setWallCount(wallCount);
+        for (i = 1; i < wallCount; i++)
+            setWallAttitude(i, (i * 37 % 61) - 30, (i * 23 % 41) - 20);
+        total = timeSweep(lpTimes, frames);
+        printf("wall %4d: frame time ms p50 %.3f p95 %.3f p99 %.3f, fps %.1f\n", wallCount,
+               percentile(lpTimes, frames, 50), percentile(lpTimes, frames, 95),
+               percentile(lpTimes, frames, 99), frames * 1000.0 / total);
+        fflush(stdout);
+    }
+    wallCount = 0;
+    fleetTelemetry = 1;
+}
+
+/* Sleeps until the CLOCK_MONOTONIC time of nowMilliseconds() reaches milliseconds. */
+static void sleepUntil(double milliseconds) {
+    struct timespec wake;
+
+    wake.tv_sec = (time_t)(milliseconds / 1000.0);
+    wake.tv_nsec = (long)((milliseconds - wake.tv_sec * 1000.0) * 1000000.0);
+    if (wake.tv_nsec >= 1000000000L) {
+        wake.tv_sec++;
+        wake.tv_nsec -= 1000000000L;
+    }
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wake, NULL) == EINTR)
+        ;
+}
+
+/* Times the frames of a replay.  Returns 0, or 1 if the log cannot be read. */
+static int runReplay(const struct benchOptions* lpOptions) {
+    struct replayRecord record;
+    double* lpTimes;
+    double total = 0.0, replayStart, due, start;
+    long records = 0;
+    int frames = 0;
+
+    if (!openReplay(lpOptions->lpReplayPath))
+        return 1;
+    if ((lpTimes = (double*)malloc(sizeof(double) * (replayLength() + 1))) == NULL) {
+        fprintf(stderr, "%s:%u: Allocation of lpTimes failed\n", __FILE__, __LINE__);
+        closeReplay();
+        return 1;
+    }
+
+    replayStart = nowMilliseconds();
+    while (peekReplay(&record)) {
+        if (lpOptions->replaySpeed > 0.0) {
+            sleepUntil(replayStart + record.time * 1000.0 / lpOptions->replaySpeed);
+            due = (nowMilliseconds() - replayStart) / 1000.0 * lpOptions->replaySpeed;
+            while (peekReplay(&record) && record.time <= due) {   // everything due goes in one frame
+                nextReplay(&record);
+                changeAttitude(record.roll, record.pitch);
+                changeBrightness(record.brightness);
+                records++;
+            }
+        }
+        else {
+            nextReplay(&record);
+            changeAttitude(record.roll, record.pitch);
+            changeBrightness(record.brightness);
+            records++;
+        }
+        start = nowMilliseconds();
+        display();
+        lpTimes[frames] = nowMilliseconds() - start;
+        total += lpTimes[frames++];
+    }
+    closeReplay();
+
+    printf("renderer: %s\n", (const char*)glGetString(GL_RENDERER));
+    printf("replay: %ld records in %d frames at %dx%d\n", records, frames, width, height);
+    if (frames > 0) {
+        qsort(lpTimes, frames, sizeof(double), compareDoubles);
+        printf("frame time ms: min %.3f p50 %.3f p95 %.3f p99 %.3f max %.3f\n",
+               lpTimes[0], percentile(lpTimes, frames, 50), percentile(lpTimes, frames, 95),
+               percentile(lpTimes, frames, 99), lpTimes[frames - 1]);
+        printf("fps: %.1f (drawing only)\n", frames * 1000.0 / total);
+    }
+    free(lpTimes);
+    return 0;
+}
+
+/* Runs the sweep and the golden check.  Returns the process exit status: 0 when
+ * all golden images match, 1 otherwise.
+ */
+int runBenchmark(const struct benchOptions* lpOptions) {
+    double* lpTimes;
+    double total;
+    int frames = lpOptions->frames;
+
+    if (lpOptions->lpReplayPath != NULL)
+        return runReplay(lpOptions);
+
+    if ((lpTimes = (double*)malloc(sizeof(double) * frames)) == NULL) {
+        fprintf(stderr, "%s:%u: Allocation of lpTimes failed\n", __FILE__, __LINE__);
+        return 1;
+    }
+
+    if (lpOptions->wallSweep) {
+        runWallSweep(lpTimes, frames);
+        free(lpTimes);
+        return 0;
+    }
+
+    total = timeSweep(lpTimes, frames);
+    printf("renderer: %s\n", (const char*)glGetString(GL_RENDERER));
+    printf("frames: %d at %dx%d\n", frames, width, height);
+    printf("frame time ms: min %.3f p50 %.3f p95 %.3f p99 %.3f max %.3f\n",
+           lpTimes[0], percentile(lpTimes, frames, 50), percentile(lpTimes, frames, 95),
+           percentile(lpTimes, frames, 99), lpTimes[frames - 1]);
+    printf("fps: %.1f\n", frames * 1000.0 / total);
+    printf("gl state calls per frame: %.1f issued, %.1f skipped\n", (double)sweepIssued / frames,
+           (double)sweepSkipped / frames);
+    free(lpTimes);
+
+    if (lpOptions->goldenDir == NULL)
+        return 0;
+    return checkGoldenImages(lpOptions) == 0 ? 0 : 1;
+}
@@ -0,0 +1,29 @@
+
+/* Headless frame-time benchmark and golden image check.  The benchmark drives
+ * display() for a number of frames over a scripted roll/pitch sweep, reports the
+ * p50/p95/p99 frame times and the frame rate, and then renders a fixed set of
+ * attitudes that are compared against (or stored as) golden images.
+ *
+ * With wallSweep, the same sweep is timed on the indicator wall for a growing
+ * number of indicators, one report line per count.
+ *
+ * With lpReplayPath, the frames come from an attitude log (see recording.h)
+ * instead: replaySpeed times as fast as recorded, records due together drawn in
+ * one frame, or with replaySpeed 0 one frame per record as fast as possible.
+ */
+
+#ifndef BENCH_H
+#define BENCH_H
+
+struct benchOptions {
+    int frames;             // number of timed frames in the sweep
+    const char* goldenDir;  // directory with golden PPM images, NULL to skip the check
+    int updateGolden;       // 1 to write the golden images instead of comparing them
+    int wallSweep;          // 1 to time the indicator wall for N = 1 to 1024 instead
+    const char* lpReplayPath;   // attitude log to time instead of the sweep, or NULL
+    double replaySpeed;     // playback speed of the log, 0 for as fast as possible
+};
+
+int runBenchmark(const struct benchOptions* lpOptions);
+
+#endif
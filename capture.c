@@ -0,0 +1,356 @@
+
+/* Frame capture, see capture.h. */
+
+#define GL_GLEXT_PROTOTYPES
+
+#include <GL/gl.h>
+#include <GL/glext.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
+#include "indicator.h"
+#include "capture.h"
+
+struct captureSlot {
+    GLuint buffer;              // GL_PIXEL_PACK_BUFFER of captureWidth * captureHeight * 4 bytes
+    GLsync fence;               // signaled when the readback is done, 0 when the slot is free
+};
+
+static enum captureFormat format;
+static int captureWidth, captureHeight;
+static size_t frameBytes;           // RGBA
+static int capturing;
+static int waitForWriter;
+static int outputFd = -1;
+
+// Render thread only.
+static struct captureSlot slots[CAPTURE_SLOTS];
+static int nextSlot;
+static unsigned long readbackWaits, skippedFrames;
+
+// Shared with the writer, guarded by lock.  The writer only touches queued
+// frames, so the render thread fills the next free one without the lock.
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t frameQueued, frameWritten;
+static unsigned char* lpQueue[CAPTURE_QUEUE_FRAMES];
+static int queueHead, queueCount;
+static int stopping;
+static unsigned long writtenFrames, droppedFrames;
+
+// Writer thread only.
+static pthread_t writerThread;
+static unsigned char* lpOutput;     // converted frame
+static size_t outputBytes;
+static int writeFailed;
+
+// ------------------------------- writer thread --------------------------------
+
+static int writeAll(int fd, const void* lpData, size_t size) {
+    const char* lpBytes = (const char*)lpData;
+    ssize_t written;
+
+    while (size > 0) {
+        written = write(fd, lpBytes, size);
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+            return 0;
+        }
+        lpBytes += written;
+        size -= written;
+    }
+    return 1;
+}
+
+/* Converts bottom-up RGBA to top-down planar 4:2:0 BT.601 (video range) in
+ * lpOutput.  Chroma is the average of each 2 x 2 block.
+ */
+static void convertToYuv(const unsigned char* lpRgba) {
+    int chromaWidth = (captureWidth + 1) / 2, chromaHeight = (captureHeight + 1) / 2;
+    unsigned char* lpY = lpOutput;
+    unsigned char* lpU = lpY + captureWidth * captureHeight;
+    unsigned char* lpV = lpU + chromaWidth * chromaHeight;
+    int x, y, dx, dy;
+
+    for (y = 0; y < captureHeight; y++) {
+        const unsigned char* lpPixel = lpRgba + (size_t)(captureHeight - 1 - y) * captureWidth * 4;
+        unsigned char* lpRow = lpY + (size_t)y * captureWidth;
+        for (x = 0; x < captureWidth; x++, lpPixel += 4)
+            lpRow[x] = (unsigned char)(((66 * lpPixel[0] + 129 * lpPixel[1] + 25 * lpPixel[2] + 128) >> 8) + 16);
+    }
+    for (y = 0; y < chromaHeight; y++) {
+        for (x = 0; x < chromaWidth; x++) {
+            int r = 0, g = 0, b = 0, n = 0;
+            for (dy = 0; dy < 2 && 2 * y + dy < captureHeight; dy++) {
+                const unsigned char* lpRow = lpRgba + (size_t)(captureHeight - 1 - 2 * y - dy) * captureWidth * 4;
+                for (dx = 0; dx < 2 && 2 * x + dx < captureWidth; dx++) {
+                    const unsigned char* lpPixel = lpRow + (2 * x + dx) * 4;
+                    r += lpPixel[0];
+                    g += lpPixel[1];
+                    b += lpPixel[2];
+                    n++;
+                }
+            }
+            r /= n;
+            g /= n;
+            b /= n;
+            lpU[y * chromaWidth + x] = (unsigned char)(((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+            lpV[y * chromaWidth + x] = (unsigned char)(((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+        }
+    }
+}
+
+/* Flips bottom-up RGBA into top-down RGBA in lpOutput. */
+static void convertToRgba(const unsigned char* lpRgba) {
+    size_t rowBytes = (size_t)captureWidth * 4;
+    int y;
+
+    for (y = 0; y < captureHeight; y++)
+        memcpy(lpOutput + y * rowBytes, lpRgba + (captureHeight - 1 - y) * rowBytes, rowBytes);
+}
+
+static void writeFrame(const unsigned char* lpRgba) {
+    static const char frameHeader[] = "FRAME\n";
+
+    if (writeFailed)
+        return;     // keep draining the queue, there is nowhere to write to
+    if (format == CAPTURE_Y4M)
+        convertToYuv(lpRgba);
+    else
+        convertToRgba(lpRgba);
+    if ((format == CAPTURE_Y4M && !writeAll(outputFd, frameHeader, sizeof(frameHeader) - 1)) ||
+            !writeAll(outputFd, lpOutput, outputBytes)) {
+        fprintf(stderr, "%s:%u: Capture stopped: %s\n", __FILE__, __LINE__, strerror(errno));
+        writeFailed = 1;
+    }
+}
+
+static void* runWriter(void* lpArgument) {
+    unsigned char* lpFrame;
+
+    (void)lpArgument;
+    pthread_mutex_lock(&lock);
+    for (;;) {
+        while (queueCount == 0 && !stopping)
+            pthread_cond_wait(&frameQueued, &lock);
+        if (queueCount == 0)
+            break;
+        lpFrame = lpQueue[queueHead];
+        pthread_mutex_unlock(&lock);
+
+        writeFrame(lpFrame);
+
+        pthread_mutex_lock(&lock);
+        queueHead = (queueHead + 1) % CAPTURE_QUEUE_FRAMES;
+        queueCount--;
+        if (!writeFailed)
+            writtenFrames++;
+        pthread_cond_signal(&frameWritten);
+    }
+    pthread_mutex_unlock(&lock);
+    return NULL;
+}
+
+// ------------------------------- render thread --------------------------------
+
+/* Copies a read back frame into the writer's queue, or drops it if the queue is
+ * full and waitForWriter is not set.
+ */
+static void queueFrame(const unsigned char* lpPixels) {
+    unsigned char* lpFrame;
+
+    pthread_mutex_lock(&lock);
+    while (queueCount == CAPTURE_QUEUE_FRAMES && waitForWriter)
+        pthread_cond_wait(&frameWritten, &lock);
+    if (queueCount == CAPTURE_QUEUE_FRAMES) {
+        droppedFrames++;
+        pthread_mutex_unlock(&lock);
+        return;
+    }
+    lpFrame = lpQueue[(queueHead + queueCount) % CAPTURE_QUEUE_FRAMES];
+    pthread_mutex_unlock(&lock);
+
+    memcpy(lpFrame, lpPixels, frameBytes);
+
+    pthread_mutex_lock(&lock);
+    queueCount++;
+    pthread_cond_signal(&frameQueued);
+    pthread_mutex_unlock(&lock);
+}
+
+/* Hands the frame in lpSlot to the writer once its readback is done.  Without
+ * wait, returns 0 and leaves the slot alone if the fence has not signaled yet.
+ */
+static int collectSlot(struct captureSlot* lpSlot, int wait) {
+    GLenum status;
+    void* lpPixels;
+
+    if (lpSlot->fence == 0)
+        return 1;
+    do {
+        status = glClientWaitSync(lpSlot->fence, GL_SYNC_FLUSH_COMMANDS_BIT, wait ? 100000000 : 0);
+    } while (wait && status == GL_TIMEOUT_EXPIRED);
+    if (status == GL_TIMEOUT_EXPIRED)
+        return 0;
+    glDeleteSync(lpSlot->fence);
+    lpSlot->fence = 0;
+    if (status == GL_WAIT_FAILED) {
+        fprintf(stderr, "%s:%u: Waiting for a frame readback failed\n", __FILE__, __LINE__);
+        return 1;
+    }
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, lpSlot->buffer);
+    lpPixels = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, frameBytes, GL_MAP_READ_BIT);
+    if (lpPixels != NULL) {
+        queueFrame((const unsigned char*)lpPixels);
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    return 1;
+}
+
+/* Collects finished readbacks, oldest first, stopping at the first that is not
+ * done unless wait is set.
+ */
+static void collectSlots(int wait) {
+    int k;
+
+    for (k = 0; k < CAPTURE_SLOTS; k++) {
+        if (!collectSlot(&slots[(nextSlot + k) % CAPTURE_SLOTS], wait))
+            break;
+    }
+}
+
+/* Opens the output, writes the stream header and starts the writer thread for
+ * frames of w x h pixels.  Must be called with a current context.  Returns 0
+ * on failure.
+ */
+int startCapture(const struct captureOptions* lpOptions, int w, int h) {
+    char header[128];
+    int k;
+
+    format = lpOptions->format;
+    captureWidth = w;
+    captureHeight = h;
+    frameBytes = (size_t)w * h * 4;
+    outputBytes = format == CAPTURE_Y4M ? (size_t)w * h + 2 * (size_t)((w + 1) / 2) * ((h + 1) / 2) : frameBytes;
+    waitForWriter = lpOptions->waitForWriter;
+
+    if (strcmp(lpOptions->lpPath, "-") == 0) {
+        fflush(stdout);
+        outputFd = dup(STDOUT_FILENO);
+        dup2(STDERR_FILENO, STDOUT_FILENO);     // printf() must not end up in the stream
+    }
+    else {
+        outputFd = open(lpOptions->lpPath, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    }
+    if (outputFd < 0) {
+        fprintf(stderr, "%s:%u: Failed to open %s: %s\n", __FILE__, __LINE__, lpOptions->lpPath, strerror(errno));
+        return 0;
+    }
+    signal(SIGPIPE, SIG_IGN);       // an encoder that quits is reported as a write error
+
+    if (format == CAPTURE_Y4M) {
+        snprintf(header, sizeof(header), "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg\n", w, h,
+                 lpOptions->fps > 0 ? lpOptions->fps : 60);
+        if (!writeAll(outputFd, header, strlen(header))) {
+            fprintf(stderr, "%s:%u: Failed to write %s: %s\n", __FILE__, __LINE__, lpOptions->lpPath, strerror(errno));
+            close(outputFd);
+            return 0;
+        }
+    }
+
+    for (k = 0; k < CAPTURE_QUEUE_FRAMES; k++) {
+        if ((lpQueue[k] = (unsigned char*)malloc(frameBytes)) == NULL) {
+            fprintf(stderr, "%s:%u: Allocation of lpQueue failed\n", __FILE__, __LINE__);
+            return 0;
+        }
+    }
+    if ((lpOutput = (unsigned char*)malloc(outputBytes)) == NULL) {
+        fprintf(stderr, "%s:%u: Allocation of lpOutput failed\n", __FILE__, __LINE__);
+        return 0;
+    }
+
+    for (k = 0; k < CAPTURE_SLOTS; k++) {
+        glGenBuffers(1, &slots[k].buffer);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, slots[k].buffer);
+        glBufferData(GL_PIXEL_PACK_BUFFER, frameBytes, NULL, GL_STREAM_READ);
+        slots[k].fence = 0;
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    nextSlot = 0;
+
+    pthread_cond_init(&frameQueued, NULL);
+    pthread_cond_init(&frameWritten, NULL);
+    queueHead = queueCount = stopping = 0;
+    if (pthread_create(&writerThread, NULL, runWriter, NULL) != 0) {
+        fprintf(stderr, "%s:%u: Failed to start the capture thread\n", __FILE__, __LINE__);
+        return 0;
+    }
+    capturing = 1;
+    return 1;
+}
+
+/* Starts the readback of the frame just drawn and passes on earlier frames whose
+ * readback is done.  Call before the swap (or finishHeadlessFrame()).
+ */
+void captureFrame() {
+    struct captureSlot* lpSlot;
+
+    if (!capturing)
+        return;
+    if (width != captureWidth || height != captureHeight) {
+        skippedFrames++;
+        return;
+    }
+    collectSlots(0);
+
+    lpSlot = &slots[nextSlot];
+    if (lpSlot->fence != 0) {       // all slots in flight: wait for the oldest
+        readbackWaits++;
+        collectSlot(lpSlot, 1);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, lpSlot->buffer);
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    glReadPixels(0, 0, captureWidth, captureHeight, GL_RGBA, GL_UNSIGNED_BYTE, (void*)0);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    lpSlot->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    nextSlot = (nextSlot + 1) % CAPTURE_SLOTS;
+}
+
+/* Writes out the frames still in flight, ends the writer and reports. */
+void stopCapture() {
+    int k;
+
+    if (!capturing)
+        return;
+    capturing = 0;
+    collectSlots(1);
+
+    pthread_mutex_lock(&lock);
+    stopping = 1;
+    pthread_cond_signal(&frameQueued);
+    pthread_mutex_unlock(&lock);
+    pthread_join(writerThread, NULL);
+    close(outputFd);
+    outputFd = -1;
+
+    for (k = 0; k < CAPTURE_SLOTS; k++)
+        glDeleteBuffers(1, &slots[k].buffer);
+    for (k = 0; k < CAPTURE_QUEUE_FRAMES; k++) {
+        free(lpQueue[k]);
+        lpQueue[k] = NULL;
+    }
+    free(lpOutput);
+    lpOutput = NULL;
+    pthread_cond_destroy(&frameQueued);
+    pthread_cond_destroy(&frameWritten);
+
+    fprintf(stderr, "capture: %lu frames written, %lu dropped, %lu skipped, %lu readback waits\n",
+            writtenFrames, droppedFrames, skippedFrames, readbackWaits);
+}
@@ -0,0 +1,41 @@
+
+/* Frame capture to a video stream.  captureFrame() is called by display() once
+ * the frame is drawn.  It starts an asynchronous glReadPixels() into one of
+ * CAPTURE_SLOTS pixel buffer objects and puts a fence behind it.  The pixels are
+ * only mapped a frame or two later, once the fence has signaled, so the readback
+ * of one frame overlaps the rendering of the next.  A writer thread converts the
+ * frames and writes them out, so a slow pipe never holds up the render thread.
+ *
+ * The stream is either YUV4MPEG2 (4:2:0, ready for ffmpeg or x264) or raw
+ * top-down RGBA with no header.  lpPath "-" writes to standard output; anything
+ * the program would print there goes to standard error instead.  For example
+ *
+ *    ./glut-starter --bench 600 --capture - | ffmpeg -i - indicator.mp4
+ *
+ * Frames are dropped, and counted, when CAPTURE_QUEUE_FRAMES frames are already
+ * waiting for the writer, unless waitForWriter is set (the headless default,
+ * where nothing is lost but time).  Frames of another size than the capture are
+ * skipped.  stopCapture() writes out what is still in flight and reports the
+ * counts on standard error.
+ */
+
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#define CAPTURE_SLOTS 3             // pixel buffer objects in flight
+#define CAPTURE_QUEUE_FRAMES 8      // converted frames waiting for the writer
+
+enum captureFormat { CAPTURE_Y4M, CAPTURE_RGBA };
+
+struct captureOptions {
+    const char* lpPath;         // output file, "-" for standard output, NULL for no capture
+    enum captureFormat format;
+    int fps;                    // frame rate in the Y4M header
+    int waitForWriter;          // 1 to wait instead of dropping frames when the writer is behind
+};
+
+int startCapture(const struct captureOptions* lpOptions, int w, int h);
+void captureFrame();
+void stopCapture();
+
+#endif
@@ -0,0 +1,145 @@
+/* GL state shadow, see glstate.h. */
+
+#define GL_GLEXT_PROTOTYPES
+
+#include <GL/gl.h>
+#include <GL/glext.h>
+#include "glstate.h"
+
+#define UNKNOWN_NAME 0xffffffffu    // no object has this name, so the next bind is issued
+#define UNKNOWN -1
+
+enum { TARGET_2D, TARGET_BUFFER, TARGETS };
+
+static const GLenum capabilities[] = { GL_BLEND, GL_DEPTH_TEST, GL_TEXTURE_2D, GL_LIGHTING };
+#define CAPABILITIES ((int)(sizeof(capabilities) / sizeof(capabilities[0])))
+
+static int caching = 1;
+static GLuint currentProgram = UNKNOWN_NAME;
+static GLuint currentArray = UNKNOWN_NAME;
+static int activeUnit = UNKNOWN;
+static GLuint boundTextures[GLSTATE_UNITS][TARGETS] = {
+    { UNKNOWN_NAME, UNKNOWN_NAME }, { UNKNOWN_NAME, UNKNOWN_NAME },
+    { UNKNOWN_NAME, UNKNOWN_NAME }, { UNKNOWN_NAME, UNKNOWN_NAME },
+};
+static int enabled[CAPABILITIES] = { UNKNOWN, UNKNOWN, UNKNOWN, UNKNOWN };
+static int depthMask = UNKNOWN;
+static GLenum blendSource, blendDestination;
+static int blendKnown;
+static GLfloat lineWidth = -1.0f;
+static unsigned long issuedCalls, skippedCalls;
+
+/* Counts one call; returns 1 if it has to reach GL. */
+static int changes(int differs) {
+    if (differs || !caching) {
+        issuedCalls++;
+        return 1;
+    }
+    skippedCalls++;
+    return 0;
+}
+
+void useProgram(GLuint program) {
+    if (changes(program != currentProgram)) {
+        glUseProgram(program);
+        currentProgram = program;
+    }
+}
+
+void bindVertexArray(GLuint array) {
+    if (changes(array != currentArray)) {
+        glBindVertexArray(array);
+        currentArray = array;
+    }
+}
+
+/* Binds texture to target on unit and leaves unit active.  Only GL_TEXTURE_2D and
+ * GL_TEXTURE_BUFFER on the first GLSTATE_UNITS units are tracked; anything else
+ * is always issued.
+ */
+void bindTexture(int unit, GLenum target, GLuint texture) {
+    int t = target == GL_TEXTURE_2D ? TARGET_2D : target == GL_TEXTURE_BUFFER ? TARGET_BUFFER : TARGETS;
+
+    if (changes(unit != activeUnit)) {
+        glActiveTexture(GL_TEXTURE0 + unit);
+        activeUnit = unit;
+    }
+    if (unit >= GLSTATE_UNITS || t == TARGETS) {
+        issuedCalls++;
+        glBindTexture(target, texture);
+        return;
+    }
+    if (changes(texture != boundTextures[unit][t])) {
+        glBindTexture(target, texture);
+        boundTextures[unit][t] = texture;
+    }
+}
+
+/* glEnable() or glDisable(). */
+void setCapability(GLenum capability, int enable) {
+    int k;
+
+    for (k = 0; k < CAPABILITIES && capabilities[k] != capability; k++)
+        ;
+    if (k < CAPABILITIES && !changes(enabled[k] != (enable != 0)))
+        return;
+    if (k < CAPABILITIES)
+        enabled[k] = enable != 0;
+    else
+        issuedCalls++;
+    if (enable)
+        glEnable(capability);
+    else
+        glDisable(capability);
+}
+
+void setDepthMask(GLboolean mask) {
+    if (changes(depthMask != (mask != GL_FALSE))) {
+        glDepthMask(mask);
+        depthMask = mask != GL_FALSE;
+    }
+}
+
+void setBlendFunc(GLenum source, GLenum destination) {
+    if (changes(!blendKnown || source != blendSource || destination != blendDestination)) {
+        glBlendFunc(source, destination);
+        blendSource = source;
+        blendDestination = destination;
+        blendKnown = 1;
+    }
+}
+
+void setLineWidth(GLfloat width) {
+    if (changes(width != lineWidth)) {
+        glLineWidth(width);
+        lineWidth = width;
+    }
+}
+
+/* Forgets everything, after GL state was changed behind the shadow's back. */
+void invalidateGLState() {
+    int unit, t, k;
+
+    currentProgram = UNKNOWN_NAME;
+    currentArray = UNKNOWN_NAME;
+    activeUnit = UNKNOWN;
+    for (unit = 0; unit < GLSTATE_UNITS; unit++)
+        for (t = 0; t < TARGETS; t++)
+            boundTextures[unit][t] = UNKNOWN_NAME;
+    for (k = 0; k < CAPABILITIES; k++)
+        enabled[k] = UNKNOWN;
+    depthMask = UNKNOWN;
+    blendKnown = 0;
+    lineWidth = -1.0f;
+}
+
+/* With enable 0, every call is issued (and counted as issued). */
+void setGLStateCache(int enable) {
+    caching = enable;
+}
+
+/* Calls issued and skipped since the start. */
+void glStateCounts(unsigned long* lpIssued, unsigned long* lpSkipped) {
+    *lpIssued = issuedCalls;
+    *lpSkipped = skippedCalls;
+}
@@ -0,0 +1,40 @@
+/* A shadow of the GL state that the frame changes back and forth: the program,
+ * the vertex array, the texture bound to each unit, a few capabilities, the
+ * depth mask, the blend function and the line width.  The draw code sets state
+ * through these functions instead of calling GL directly.  A call that would set
+ * what is already set is skipped, so the draws of a frame no longer unbind
+ * everything after themselves only for the next draw to bind it again, and a
+ * texture that stays bound from one frame to the next is not bound again.
+ *
+ * bindTexture() always leaves unit the active one, like glActiveTexture()
+ * followed by glBindTexture(), so glTexParameteri() and glTexSubImage2D() after
+ * it reach the texture just bound.
+ *
+ * Code that changes any of this state directly (setup, glDeleteTextures() of a
+ * bound texture) calls invalidateGLState() afterwards; the next call of each
+ * kind is then issued whatever it sets.
+ *
+ * Every call is counted as issued or skipped.  perf.h keeps the counts per
+ * frame, and the benchmark reports their averages.  setGLStateCache(0)
+ * (--no-state-cache) issues every call, for comparison.
+ */
+
+#ifndef GLSTATE_H
+#define GLSTATE_H
+
+#include <GL/gl.h>
+
+#define GLSTATE_UNITS 4     // texture units tracked, from GL_TEXTURE0
+
+void useProgram(GLuint program);
+void bindVertexArray(GLuint array);
+void bindTexture(int unit, GLenum target, GLuint texture);
+void setCapability(GLenum capability, int enable);
+void setDepthMask(GLboolean mask);
+void setBlendFunc(GLenum source, GLenum destination);
+void setLineWidth(GLfloat width);
+void invalidateGLState();
+void setGLStateCache(int enable);
+void glStateCounts(unsigned long* lpIssued, unsigned long* lpSkipped);
+
+#endif
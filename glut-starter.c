@@ -12,9 +12,13 @@
  *    This program must be linked to the GL and glut libraries.  
  * For example, in Linux with the gcc compiler:
  *
- *        gcc -o executableProg glut-starter.c -lGL -lglut
+ *        gcc -o executableProg glut-starter.c mesh.c image.c texture.c shader.c scene.c attitude.c overlay.c marks.c wall.c telemetry.c scheduler.c backlight.c perf.c recording.c capture.c headless.c bench.c -lGL -lglut -lEGL -ljpeg -pthread
+ *
+ * (The Makefile has the complete list of sources and libraries.)
  */
 
+#define GL_GLEXT_PROTOTYPES
+
 #include <GL/gl.h>
 #include <GL/glu.h>
 #include <GL/freeglut.h>   // Consider using freeglut.h instead, if available.
@@ -22,151 +26,66 @@
 #include <GL/glcorearb.h>
 #include <stdio.h>     // (Used only for some information messages to standard out.)
 #include <stdlib.h>    // (Used only for exit() function.)
+#include <string.h>
 #include <math.h>
-#include <glob.h>
-#include <jpeglib.h>
-#include <jerror.h>
+#include <time.h>
+#include "mesh.h"
+#include "scene.h"
+#include "texture.h"
+#include "overlay.h"
+#include "wall.h"
+#include "lod.h"
+#include "indicator.h"
+#include "headless.h"
+#include "bench.h"
+#include "batch.h"
+#include "telemetry.h"
+#include "attitude.h"
+#include "scheduler.h"
+#include "backlight.h"
+#include "perf.h"
+#include "recording.h"
+#include "capture.h"
+#include "vtex.h"
+#include "text.h"
+#include "glstate.h"
 
 //#define DEBUG 1
 #define ARC_INDICES 37
 
-struct imgRawImage {
-    unsigned int numComponents;
-    unsigned long int width, height;
-    unsigned char* lpData;
-};
-
 // --------------------------------- global variables --------------------------------
 
 int width, height;   // Size of the drawing area, to be set in reshape().
 
 int frameNumber = 0;     // For use in animation.
-int roll = 0;
-int pitch = 0;
+float roll = 0;
+float pitch = 0;
+float yaw = 0;      // From telemetry or Page Up/Down; turns the ball about the vertical axis.
+
+int headless = 0;        // Set by --headless/--bench: render offscreen instead of in a GLUT window.
+int coreProfile = 0;     // Set by --core: OpenGL 3.3 core profile, ball and ring drawn by scene.c.
+int impostor = 0;        // Set by --impostor: the ball is a ray-cast square instead of a mesh (see scene.h).
+int watchTextures = 0;   // Set by --watch-textures: reload sphere.jpg and ring.jpg when they change.
+int showReadouts = 0;    // Set by --readouts or toggled with R: digital roll, pitch, brightness and fps.
+int stateCache = 1;      // Cleared by --no-state-cache: every state call reaches GL (see glstate.h).
+int overlayLines = 0;    // Set by --overlay-lines: wide GL lines instead of SDF strokes (see overlay.h).
+int wallCount = 0;       // Set by --wall N: N indicators in a grid instead of one (see wall.h).
+int fleetTelemetry = 1;  // Wall indicators from vehicle telemetry; the wall benchmark sets its own.
+double fleetSampleTimes[WALL_MAX_INDICATORS];   // receive time of each indicator's sample, 0 for none
+double predictMilliseconds = -1;   // Set by --predict: telemetry prediction lead, -1 for scanoutLead().
+const char* lpVirtualTexturePath = NULL;   // Set by --virtual-texture: ball art streamed in tiles (see vtex.h).
 
 GLuint texture[2];
 GLfloat vertices[ARC_INDICES][2];
 
+int detailLevel = 2;     // Level of the ball and ring meshes for the window size (see lod.h).
 
-struct imgRawImage* loadJpegImageFile(char* lpFilename) {
-    struct jpeg_decompress_struct info;
-    struct jpeg_error_mgr err;
-
-    struct imgRawImage* lpNewImage;
-
-    unsigned long int imgWidth, imgHeight;
-    int numComponents;
-
-    unsigned long int dwBufferBytes;
-    unsigned char* lpData;
-
-    unsigned char* lpRowBuffer[1];
-
-    FILE* fHandle;
-
-    fHandle = fopen(lpFilename, "rb");
-    if(fHandle == NULL) {
-        fprintf(stderr, "%s:%u: Failed to read file %s\n", __FILE__, __LINE__, lpFilename);
-        return NULL; /* ToDo */
-    }
-
-    info.err = jpeg_std_error(&err);
-    jpeg_create_decompress(&info);
-
-    jpeg_stdio_src(&info, fHandle);
-    jpeg_read_header(&info, TRUE);
-
-    jpeg_start_decompress(&info);
-    imgWidth = info.output_width;
-    imgHeight = info.output_height;
-    numComponents = info.num_components;
-
-    #ifdef DEBUG
-    fprintf(
-        stderr,
-        "%s:%u: Reading JPEG with dimensions %lu x %lu and %u components\n",
-        __FILE__, __LINE__,
-        imgWidth, imgHeight, numComponents
-    );
-    #endif
-
-    dwBufferBytes = imgWidth * imgHeight * 3; /* We only read RGB, not A */
-    if ((lpData = (unsigned char*)malloc(sizeof(unsigned char)*dwBufferBytes)) == NULL) {
-        fprintf(stderr, "%s:%u: Allocation of lpData failed\n", __FILE__, __LINE__);
-        return NULL;
-    }
-
-    if ((lpNewImage = (struct imgRawImage*)malloc(sizeof(struct imgRawImage))) == NULL) {
-        fprintf(stderr, "%s:%u: Allocation of lpNewImage failed\n", __FILE__, __LINE__);
-        return NULL;
-    }
-
-    lpNewImage->numComponents = numComponents;
-    lpNewImage->width = imgWidth;
-    lpNewImage->height = imgHeight;
-    lpNewImage->lpData = lpData;
-
-    /* Read scanline by scanline */
-    while(info.output_scanline < info.output_height) {
-        lpRowBuffer[0] = (unsigned char *)(&lpData[3*info.output_width*info.output_scanline]);
-        jpeg_read_scanlines(&info, lpRowBuffer, 1);
-    }
+enum { READOUT_ROLL, READOUT_PITCH, READOUT_BRIGHTNESS, READOUT_FPS, READOUT_COUNT };
+int readoutFields[READOUT_COUNT];   // text fields, see text.h
 
-    jpeg_finish_decompress(&info);
-    jpeg_destroy_decompress(&info);
-    fclose(fHandle);
+extern int animating;    // See the animation support below.
+void updateFrame();
 
-    return lpNewImage;
-}
-
-void LoadGLTextures() {
-    struct imgRawImage *image, *image2;
-
-    image = loadJpegImageFile("./sphere.jpg");
-
-    // Create Texture Name and Bind it as current
-    glGenTextures(2, &texture[0]);
-    glBindTexture(GL_TEXTURE_2D, texture[0]);   // 2d texture (x and y size)
-
-    // Set Texture Parameters
-    //  Scale linearly when image bigger than texture
-    glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MAG_FILTER,GL_LINEAR);
-    //  Scale linearly when image smaller than texture
-    glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MIN_FILTER,GL_LINEAR);
-
-    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
-    // Load texture into OpenGL RC
-    glTexImage2D(GL_TEXTURE_2D,     // 2D texture
-        0,                  // level of detail 0 (normal)
-        3,	            // 3 color components
-        image->width,       // x size from image
-        image->height,      // y size from image
-        0,	            // border 0 (normal)
-        GL_RGB,             // rgb color data order
-        GL_UNSIGNED_BYTE,   // color component types
-        image->lpData       // image data itself
-    );
-
-    glEnable(GL_TEXTURE_2D);
-
-    image2 = loadJpegImageFile("./ring.jpg");
-    glBindTexture(GL_TEXTURE_2D, texture[1]);   // 2d texture (x and y size)
-    glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MAG_FILTER,GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MIN_FILTER,GL_LINEAR);
-    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
-    glTexImage2D(GL_TEXTURE_2D,     // 2D texture
-        0,                  // level of detail 0 (normal)
-        3,	            // 3 color components
-        image2->width,      // x size from image
-        image2->height,     // y size from image
-        0,	            // border 0 (normal)
-        GL_RGB,             // rgb color data order
-        GL_UNSIGNED_BYTE,   // color component types
-        image2->lpData      // image data itself
-    );
-
-    glEnable(GL_TEXTURE_2D);
-}
 
 // ------------------------ OpenGL initialization and rendering -----------------------
 
@@ -179,25 +98,50 @@ void initGL() {
 
     glEnable(GL_DEPTH_TEST);  // Required for 3D drawing, not usually for 2D.
     
-    // TODO: Uncomment the following 4 lines to do some typical initialization for 
-    // lighting and materials.
-
-    glEnable(GL_LIGHTING);        // Enable lighting.
-    glEnable(GL_LIGHT0);          // Turn on a light.  By default, shines from direction of viewer.
-    glEnable(GL_NORMALIZE);       // OpenGL will make all normal vectors into unit normals
-    glEnable(GL_COLOR_MATERIAL);  // Material ambient and diffuse colors can be set by glColor*
-
-    GLfloat position[] = {0.0f, 0.0f, 2.0f, 0.0f};
-    glLightfv(GL_LIGHT0, GL_POSITION, position);
-
-    GLfloat colorWhite[] = { 1.00, 1.00, 1.00, 1.0 };
-    GLfloat colorDarkGray[] = { 0.10, 0.10, 0.10, 1.0 };
-    GLfloat colorLightGray[] = { 0.75, 0.75, 0.75, 1.0 };
-    glLightfv(GL_LIGHT0, GL_AMBIENT, colorDarkGray);
-    glLightfv(GL_LIGHT0, GL_DIFFUSE, colorLightGray);
-    glLightfv(GL_LIGHT0, GL_SPECULAR, colorWhite);
+    // The same light and material as the fixed-function setup below: white
+    // glColor material (ambient = diffuse = 1) without specular, default 0.2
+    // light model ambient.  Used by --core and by the wall in either profile.
+    struct sceneLighting lighting = {
+        { 0.0f, 0.0f, 2.0f, 0.0f },         // light direction
+        { 0.10f, 0.10f, 0.10f, 1.0f },      // light ambient
+        { 0.75f, 0.75f, 0.75f, 1.0f },      // light diffuse
+        { 1.00f, 1.00f, 1.00f, 1.0f },      // light specular
+        { 0.20f, 0.20f, 0.20f, 1.0f },      // scene ambient
+        { 1.00f, 1.00f, 1.00f, 1.0f },      // material ambient
+        { 1.00f, 1.00f, 1.00f, 1.0f },      // material diffuse
+        { 0.00f, 0.00f, 0.00f, 0.0f },      // material specular, shininess
+    };
+    if (!buildScene(&lighting) || !buildWall()) {
+        fprintf(stderr, "%s:%u: Failed to build the scene shaders\n", __FILE__, __LINE__);
+        exit(1);
+    }
+    setWallCount(wallCount);
+
+    if (!coreProfile) {
+        glEnable(GL_LIGHTING);        // Enable lighting.
+        glEnable(GL_LIGHT0);          // Turn on a light.  By default, shines from direction of viewer.
+        glEnable(GL_NORMALIZE);       // OpenGL will make all normal vectors into unit normals
+        glEnable(GL_COLOR_MATERIAL);  // Material ambient and diffuse colors can be set by glColor*
+
+        GLfloat position[] = {0.0f, 0.0f, 2.0f, 0.0f};
+        glLightfv(GL_LIGHT0, GL_POSITION, position);
+
+        GLfloat colorWhite[] = { 1.00, 1.00, 1.00, 1.0 };
+        GLfloat colorDarkGray[] = { 0.10, 0.10, 0.10, 1.0 };
+        GLfloat colorLightGray[] = { 0.75, 0.75, 0.75, 1.0 };
+        glLightfv(GL_LIGHT0, GL_AMBIENT, colorDarkGray);
+        glLightfv(GL_LIGHT0, GL_DIFFUSE, colorLightGray);
+        glLightfv(GL_LIGHT0, GL_SPECULAR, colorWhite);
+        glLightModeli(GL_LIGHT_MODEL_TWO_SIDE, GL_TRUE);
+    }
 
     LoadGLTextures();
+    if (lpVirtualTexturePath != NULL && !openVirtualTexture(lpVirtualTexturePath))
+        exit(1);
+
+    // Build every level of the ball and ring once; display() only draws the retained meshes.
+    if (!buildLodMeshes())
+        exit(1);
 
     // Generate arc vertices
     for (int i = 0; i < ARC_INDICES; i++) {
@@ -206,6 +150,25 @@ void initGL() {
         vertices[i][1] = sin(rad) * -0.25f;
     }
 
+    if (!buildOverlay(vertices, ARC_INDICES, overlayLines ? OVERLAY_LINES : OVERLAY_SDF)) {
+        fprintf(stderr, "%s:%u: Failed to build the overlay\n", __FILE__, __LINE__);
+        exit(1);
+    }
+
+    // Readouts in the corners the ring leaves free.
+    if (!buildText()) {
+        fprintf(stderr, "%s:%u: Failed to build the text renderer\n", __FILE__, __LINE__);
+        exit(1);
+    }
+    readoutFields[READOUT_ROLL] = addTextField(TEXT_TOP_LEFT, 0, 11);
+    readoutFields[READOUT_PITCH] = addTextField(TEXT_TOP_LEFT, 1, 12);
+    readoutFields[READOUT_BRIGHTNESS] = addTextField(TEXT_TOP_RIGHT, 0, 8);
+    readoutFields[READOUT_FPS] = addTextField(TEXT_TOP_RIGHT, 1, 10);
+
+    // The setup above bound objects directly; draws go through glstate.h from here on.
+    setGLStateCache(stateCache);
+    invalidateGLState();
+
 }  // end initGL()
 
 void setlight(){
@@ -237,6 +200,78 @@ void setmaterial(){
     glMaterialfv(GL_FRONT_AND_BACK, GL_EMISSION, black);
 }
 
+/* Indicator 0 of the wall shows roll and pitch, indicator i the newest sample of
+ * vehicle i.  An indicator whose vehicle sent nothing for WALL_STALE_SECONDS is
+ * blanked rather than left showing its last attitude.
+ */
+void setFleetAttitudes() {
+    struct attitudeSample sample;
+    struct timespec ts;
+    double now;
+    int i;
+
+    setWallAttitude(0, roll, pitch);
+    if (!fleetTelemetry)
+        return;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    now = ts.tv_sec + ts.tv_nsec / 1e9;
+    for (i = 1; i < wallCount; i++) {
+        if (pollVehicleTelemetry(i, &sample)) {
+            setWallAttitude(i, sample.roll, sample.pitch);
+            fleetSampleTimes[i] = sample.receiveTime;
+        }
+        else if (fleetSampleTimes[i] == 0.0 || now - fleetSampleTimes[i] > WALL_STALE_SECONDS) {
+            setWallStale(i);
+        }
+    }
+}
+
+/* Seconds ahead of now that the attitude of the next frame is predicted for.
+ * Offscreen frames are never shown, so they are not predicted.
+ */
+double predictionLead() {
+    if (headless)
+        return 0.0;
+    return predictMilliseconds >= 0 ? predictMilliseconds / 1000.0 : scanoutLead();
+}
+
+/* Frames per second, averaged over about the last ten frames. */
+double measureFrameRate() {
+    static double lastSeconds, average;
+    struct timespec ts;
+    double seconds;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    seconds = ts.tv_sec + ts.tv_nsec / 1e9;
+    if (lastSeconds > 0.0 && seconds > lastSeconds)
+        average = average > 0.0 ? average + (1.0 / (seconds - lastSeconds) - average) * 0.1
+                                : 1.0 / (seconds - lastSeconds);
+    lastSeconds = seconds;
+    return average;
+}
+
+/* Writes the readouts of this frame; only the digits that changed reach the GPU. */
+void updateReadouts() {
+    char text[16];
+
+    snprintf(text, sizeof(text), "ROLL %6.1f", frameAttitude.roll);
+    setTextField(readoutFields[READOUT_ROLL], text);
+    snprintf(text, sizeof(text), "PITCH %6.1f", frameAttitude.pitch);
+    setTextField(readoutFields[READOUT_PITCH], text);
+    snprintf(text, sizeof(text), "BRT %3d%%", (brightness * 100 + 127) / 255);
+    setTextField(readoutFields[READOUT_BRIGHTNESS], text);
+    snprintf(text, sizeof(text), "FPS %6.1f", measureFrameRate());
+    setTextField(readoutFields[READOUT_FPS], text);
+}
+
+/* Draws the ball impostor, textured from the virtual texture if there is one. */
+void drawImpostorBall() {
+    if (lpVirtualTexturePath != NULL)
+        drawVirtualBall(frameAttitude.sphereMatrix);
+    else
+        drawBallImpostor(texture[0], frameAttitude.sphereMatrix);
+}
+
 /* display() is set up in main() as the function that is called when the window is
  * first opened, when glutPostRedisplay() is called, and possibly at other times when
  * the window needs to be redrawn.  Usually it will redraw the entire contents of
@@ -247,70 +282,83 @@ void setmaterial(){
 void display() {
         // called whenever the display needs to be redrawn
 
+    struct attitudeSample sample;
+    int reloading;
+
+    perfBeginFrame();
+    reloading = updateTextures();   // between frames: a reloaded texture is swapped in whole
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);  // For 2D, usually leave out the depth buffer.
-    glLightModeli(GL_LIGHT_MODEL_TWO_SIDE, GL_TRUE);
+
+    if (pollTelemetry(&sample))     // never blocks; keeps the last attitude if nothing new arrived
+        takeTelemetrySample(&sample);
+    if (animating)
+        updateFrame();
+    beginAttitudeFrame(roll, pitch, yaw, predictionLead());  // the matrices of this frame
+    if (lpVirtualTexturePath != NULL && wallCount == 0)     // offscreen frames wait for their tiles
+        updateVirtualTexture(frameAttitude.sphereMatrix, width, height, headless);
+    perfMark(PERF_CLEAR);
 
     // TODO: INSERT DRAWING CODE HERE
 
-    glPushMatrix();
-    glBindTexture(GL_TEXTURE_2D, texture[0]);
-    glTranslatef(0.0f, 0.0f, 0.0f);
-    glRotatef(roll + 90, 0.0f, 0.0f, 1.0f);
-    glRotatef(pitch, 0.0f, 1.0f, 0.0f);
-    glRotatef(90, 1.0f, 0.0f, 0.0f);
-    GLUquadric *sphere = gluNewQuadric();
-    gluQuadricDrawStyle(sphere, GLU_FILL);
-    gluQuadricNormals(sphere, GLU_SMOOTH);
-    gluQuadricTexture(sphere, GL_TRUE);
-    gluSphere(sphere, 0.9f, 36, 36);
-    gluDeleteQuadric(sphere);
-    glPopMatrix();
-
-    glPushMatrix();
-    glBindTexture(GL_TEXTURE_2D, texture[1]);
-    glTranslatef(0.0f, 0.0f, -0.7f);
-    glRotatef(roll, 0.0f, 0.0f, 1.0f);
-    GLUquadric *ring = gluNewQuadric();
-    gluQuadricDrawStyle(ring, GLU_FILL);
-    gluQuadricNormals(ring, GLU_SMOOTH);
-    gluQuadricTexture(ring, GL_TRUE);
-    gluDisk(ring, 0.8f, 1.0f, 72, 10);
-    gluDeleteQuadric(ring);
-    glPopMatrix();
-
-    glPushMatrix();
-    glDisable(GL_TEXTURE_2D);
-    glTranslatef(0.0f, 0.0f, -0.9f);
-    glLineWidth(4);
-    glBegin(GL_LINE_STRIP);
-    glColor3f(1.0f, 1.0f, 1.0f);
-    glVertex3f(-0.8f, 0.0f, 0.0f);
-    glVertex3f(-0.15f, 0.0f, 0.0f);
-    glVertex3f(-0.1f, 0.1f, 0.0f);
-    glVertex3f(0.1f, 0.1f, 0.0f);
-    glVertex3f(0.15f, 0.0f, 0.0f);
-    glVertex3f(0.8f, 0.0f, 0.0f);
-    glEnd();
-    glBegin(GL_LINE_STRIP);
-    glColor3f(1.0f, 1.0f, 1.0f);
-    for (int i = 0; i < ARC_INDICES; i++) {
-        glVertex3f(vertices[i][0], vertices[i][1], 0.0f);
+    if (wallCount > 0) {
+        setFleetAttitudes();
+        drawWall(texture[0], texture[1]);   // marks sphere, ring and overlay
+    }
+    else if (coreProfile) {
+        if (impostor)
+            drawImpostorBall();
+        drawScene(impostor ? NULL : lodSphere(detailLevel), lodRing(detailLevel), texture[0], texture[1], frameAttitude.sphereMatrix,
+                  frameAttitude.ringMatrix);   // marks PERF_SPHERE
+        perfMark(PERF_RING);
+    }
+    else {
+        if (impostor) {
+            drawImpostorBall();
+        }
+        else {
+            useProgram(0);
+            glPushMatrix();
+            bindTexture(0, GL_TEXTURE_2D, texture[0]);
+            glMultMatrixf(frameAttitude.sphereMatrix);
+            drawMesh(lodSphere(detailLevel));
+            glPopMatrix();
+        }
+        perfMark(PERF_SPHERE);
+
+        useProgram(0);      // fixed function
+        glPushMatrix();
+        bindTexture(0, GL_TEXTURE_2D, texture[1]);
+        glMultMatrixf(frameAttitude.ringMatrix);
+        drawMesh(lodRing(detailLevel));
+        glPopMatrix();
+        perfMark(PERF_RING);
     }
-    glEnd();
-    glBegin(GL_LINE_STRIP);
-    glColor3f(1.0f, 1.0f, 1.0f);
-    glVertex3f(0.0f, 0.1f, 0.0f);
-    glVertex3f(0.0f, 0.8f, 0.0f);
-    glVertex3f(0.3f, 0.2f, 0.0f);
-    glVertex3f(0.0f, 0.2f, 0.0f);
-    glEnd();
-    glEnable(GL_TEXTURE_2D);
-    glPopMatrix();
+
+    if (wallCount == 0) {
+        drawOverlay(frameAttitude.roll, frameAttitude.pitch);
+        if (showReadouts) {
+            updateReadouts();
+            drawText();
+        }
+        perfMark(PERF_OVERLAY);
+    }
+
+    captureFrame();     // starts the readback of this frame, never waits for it
 
     glFlush();
 
-    glutSwapBuffers();  // (Required for double-buffered drawing.)
-                        // (For GLUT_SINGLE display mode, use glFlush() instead.)
+    if (headless) {
+        finishHeadlessFrame();  // No window to swap; wait for the frame instead.
+    }
+    else {
+        glutSwapBuffers();  // (Required for double-buffered drawing.)
+                            // (For GLUT_SINGLE display mode, use glFlush() instead.)
+        frameSwapped();     // Pacing of the next frame starts here.
+        if (virtualTextureBusy() || reloading)
+            requestFrame(); // tiles or a reloaded texture still coming in
+    }
+    perfMark(PERF_SWAP);
+    perfEndFrame();
 }
 
 
@@ -323,6 +371,13 @@ void reshape(int w, int h) {
     width = w;   // Save width and height for possible use elsewhere.
     height = h;
     glViewport(0,0,width,height);  // If you have a reshape function, you MUST call glViewport!
+    layoutWall(width, height);
+    if (wallCount == 0) {    // the wall sets its own detail for its cell size
+        detailLevel = selectLod(width < height ? width : height);
+        setTextureDetail(width < height ? width : height);
+    }
+    resizeOverlay(width, height);
+    resizeText(width, height);
     // TODO: INSERT ANY OTHER CODE TO ACCOUNT FOR WINDOW SIZE (maybe set projection here).
 #ifdef DEBUG
     printf("Reshaped to width %d, height %d\n", width, height);
@@ -332,8 +387,8 @@ void reshape(int w, int h) {
 
 // --------------- support for animation ------------------------------------------
 
-/* You can call startAnimation() to run an animation.  A frame will be drawn every
- * 30 milliseconds (can be changed in the call to glutTimerFunc.  The global frameNumber
+/* You can call startAnimation() to run an animation.  Frames are then drawn back to
+ * back at the pace set with --pace (see scheduler.h).  The global frameNumber
  * variable will be incremented for each frame.  Call pauseAnimation() to stop animating.
  */
 
@@ -349,26 +404,18 @@ void updateFrame() {
 #endif
 }
 
-void timerFunction(int timerID) {
-      // used for animation; do not call this directly
-    if (animating) {
-        updateFrame();
-        glutTimerFunc(30, timerFunction, 0);  // Next frame in 30 milliseconds.
-        glutPostRedisplay(); // Causes display() to be called.
-    }
-}
-
 void startAnimation() {
       // call this to start or restart the animation
    if ( ! animating ) {
        animating = 1;
-       glutTimerFunc(30, timerFunction, 0);
+       setContinuous(1);
    }
 }
 
 void pauseAnimation() {
        // call this to pause the animation
     animating = 0;
+    setContinuous(0);
 }
 
 
@@ -389,8 +436,12 @@ void charTyped(unsigned char ch, int x, int y) {
         case 'S':
             startAnimation();
             break;
+        case 'r':
+        case 'R':
+            showReadouts = !showReadouts;
+            requestFrame();
+            break;
     }
-    glutPostRedisplay();  // Causes display() to be called.
 #ifdef DEBUG
     printf("User typed %c with ASCII code %d, mouse at (%d,%d)\n", ch, ch, x, y);
 #endif
@@ -406,30 +457,40 @@ void charTyped(unsigned char ch, int x, int y) {
  * parameters give the mouse position when the key was pressed.
  */
 void specialKeyPressed(int key, int x, int y) {
+    float newRoll = roll, newPitch = pitch;
+
     switch(key) {
+        case GLUT_KEY_PAGE_UP:
+        case GLUT_KEY_PAGE_DOWN:
+            yaw = remainderf(yaw + (key == GLUT_KEY_PAGE_UP ? 1 : -1), 360.0f);
+            requestFrame();
+            return;
         case 100:
-            roll += 1;
-            if (roll >= 180)
-                roll = -180;
+            newRoll += 1;
+            if (newRoll >= 180)
+                newRoll = -180;
             break;
         case 101:
-            pitch -= 1;
-            if (pitch <=0)
-                pitch = 360;
+            newPitch -= 1;
+            if (newPitch <=0)
+                newPitch = 360;
             break;
         case 102:
-            roll -= 1;
-            if (roll <= -180)
-                roll = 180;
+            newRoll -= 1;
+            if (newRoll <= -180)
+                newRoll = 180;
             break;
         case 103:
-            pitch += 1;
-            if (pitch >= 360)
-                pitch = 0;
+            newPitch += 1;
+            if (newPitch >= 360)
+                newPitch = 0;
             break;
+        default:
+            return;   // nothing changed, nothing to draw
     }
     // TODO: INSERT KEY-HANDLING CODE
-    glutPostRedisplay();  // Causes display() to be called.
+    if (changeAttitude(newRoll, newPitch))
+        requestFrame();
 #ifdef DEBUG
     printf("User pressed special key with code %d; mouse at (%d,%d)\n", key, x, y);
 #endif
@@ -443,23 +504,51 @@ int dragButton;      // which button started the drag operation
 int startX, startY;  // mouse position at start of drag
 int prevX, prevY;    // previous mouse position during drag
 int brightness = 100;
-glob_t globbuf;
 
+/* Hands the brightness to the backlight worker; never waits for the write. */
 void updateBrightness() {
-    char **found;
+    setBacklight(brightness);
+}
 
-    if (globbuf.gl_pathc == 0)
-        return;
+/* The one way the attitude changes, for the arrow keys, telemetry and replay.
+ * Records the change when --record is on.  Returns 1 if the attitude changed;
+ * the caller asks for the frame.
+ */
+int changeAttitude(float newRoll, float newPitch) {
+    if (newRoll == roll && newPitch == pitch)
+        return 0;
+    roll = newRoll;
+    pitch = newPitch;
+    recordAttitude(roll, pitch, brightness);
+    return 1;
+}
 
-#ifdef DEBUG
-    fprintf(stderr, "Found %d\n", globbuf.gl_pathc);
-#endif
-    found = globbuf.gl_pathv;
+/* Applies a telemetry sample: its yaw, and roll and pitch through changeAttitude().
+ * The attitude module keeps it for latency prediction.  Returns 1 if the
+ * attitude changed.
+ */
+int takeTelemetrySample(const struct attitudeSample* lpSample) {
+    int changed = lpSample->yaw != yaw;
 
-    FILE *fptr;
-    fptr = fopen(*found, "w");
-    fprintf(fptr, "%d\n", brightness);
-    fclose(fptr);
+    yaw = lpSample->yaw;
+    addAttitudeSample(lpSample->sourceTime, lpSample->receiveTime, lpSample->roll, lpSample->pitch, lpSample->yaw);
+    return changeAttitude(lpSample->roll, lpSample->pitch) || changed;
+}
+
+/* Same for the brightness, from mouse drags and replay.  Clamps the level to
+ * 0..255 and passes it on to the backlight.
+ */
+int changeBrightness(int level) {
+    if (level > 255)
+        level = 255;
+    if (level < 0)
+        level = 0;
+    if (level == brightness)
+        return 0;
+    brightness = level;
+    updateBrightness();
+    recordAttitude(roll, pitch, brightness);
+    return 1;
 }
 
 /*  mouseUpDown() is set up in main() to be called when the user presses or releases
@@ -502,12 +591,8 @@ void mouseDragged(int x, int y) {
     if ( ! dragging )
         return;  // This is not part of a drag that we want to respond to.
     // TODO:  INSERT CODE TO RESPOND TO NEW MOUSE POSITION
-    brightness -= (y - prevY);
-    if (brightness > 255)
-        brightness = 255;
-    if (brightness < 0)
-        brightness = 0;
-    updateBrightness();
+    if (changeBrightness(brightness - (y - prevY)))
+        requestFrame();
     prevX = x;
     prevY = y;
 #ifdef DEBUG
@@ -526,6 +611,12 @@ void doMenu( int itemCode ) {
    if (itemCode == 1) {
        exit(0);
    }
+   else if (itemCode == 2) {
+       perfDump(PERF_JSON);
+   }
+   else if (itemCode == 3) {
+       perfDump(PERF_CSV);
+   }
    // TODO: Add support for other commands.
 }
 
@@ -538,6 +629,8 @@ void createMenu() {
    glutAddMenuEntry("Quit", 1);  // Add a command named "Quit" to the menu with item code = 1.
                                  // The code will be passed as a parameter to doMenu() when
                                  // the user selects this command from the menu.
+   glutAddMenuEntry("Dump frame times (JSON)", 2);
+   glutAddMenuEntry("Dump frame times (CSV)", 3);
                                  
    // TODO: Add additional menu items.  (It is also possible to have submenus.)
                                 
@@ -546,12 +639,246 @@ void createMenu() {
 
 // ----------------- main routine -------------------------------------------------
 
+struct benchOptions bench = { 600, NULL, 0, 0, NULL, 1.0 };
+struct batchOptions batch = { NULL, NULL, 0, 256, BATCH_PPM };
+const char* lpTelemetrySource = NULL;
+enum pacingMode paceMode = PACE_VSYNC;
+double paceFps = 0.0;
+const char* lpPerfPrefix = NULL;
+const char* lpRecordPath = NULL;
+const char* lpReplayPath = NULL;
+double replaySpeed = 1.0;       // 0 for as fast as frames can be drawn
+struct captureOptions capture = { NULL, CAPTURE_Y4M, 60, 0 };
+struct backlightOptions backlight = { NULL, 30.0, 0.0, NULL };
+
+/* Removes the options of this program from argv, leaving the rest for glutInit().
+ *
+ *    --headless            render offscreen through EGL, no window system needed
+ *    --bench N             headless benchmark over N frames (default 600)
+ *    --golden DIR          compare the benchmark output with the golden images in DIR
+ *    --update-golden       write the golden images instead of comparing them
+ *    --batch LIST DIR      render every attitude in LIST into DIR and exit (see batch.h)
+ *    --batch-workers N     render with N processes (default one per CPU)
+ *    --batch-size N        batch images of N x N pixels (default 256)
+ *    --batch-format F      "ppm" (default, one file per image) or "raw" (DIR/images.rgb)
+ *    --core                OpenGL 3.3 core profile with the shader render path
+ *    --impostor            draw the ball as a ray-cast impostor instead of the sphere mesh
+ *    --virtual-texture F   stream the ball art from F, baked with "bake-textures --virtual"
+ *                          (see vtex.h); implies --impostor
+ *    --watch-textures      reload sphere.jpg and ring.jpg when they change on disk (see texture.h)
+ *    --readouts            show roll, pitch, brightness and frame rate as numbers (key R)
+ *    --no-state-cache      issue every GL state call, even when it changes nothing (see glstate.h)
+ *    --overlay-lines       draw the overlay with wide GL lines instead of SDF strokes
+ *    --wall N              show N indicators in a grid (see wall.h)
+ *    --wall-bench          headless benchmark of the wall for N = 1 to 1024
+ *    --telemetry SOURCE    follow the attitude from SOURCE ("-", "unix:PATH" or a FIFO, see telemetry.h)
+ *    --predict MS          aim the telemetry prediction MS ahead instead of the scanout
+ *                          estimate; 0 turns the prediction off (see attitude.h)
+ *    --pace MODE           "vsync" (default), "off" or a target frame rate in fps
+ *    --backlight PATH      brightness file instead of /sys/class/backlight/NAME/brightness
+ *    --backlight-rate HZ   at most HZ brightness writes per second (default 30)
+ *    --backlight-ramp MS   move to a new brightness over MS milliseconds
+ *    --ambient-light PATH  scale the brightness by an IIO light sensor, e.g. in_illuminance_raw
+ *    --perf-dump PREFIX    frame time dumps go to PREFIX.json/.csv (default /tmp/indicator-perf)
+ *    --record PATH         log every attitude and brightness change to PATH (see recording.h)
+ *    --replay PATH         play back a log written with --record; with --headless or
+ *                          --bench, time the frames of the replay instead of the sweep
+ *    --replay-speed X      replay X times as fast as recorded (default 1), or "max" for
+ *                          one record per frame, as fast as frames can be drawn
+ *    --capture PATH        stream the frames to PATH, "-" for standard output (see capture.h)
+ *    --capture-format F    "y4m" (default) or "rgba"
+ *    --capture-fps N       frame rate in the Y4M header (default 60)
+ */
+void parseOptions(int* lpArgc, char** argv) {
+    int i, kept = 1;
+
+    for (i = 1; i < *lpArgc; i++) {
+        if (strcmp(argv[i], "--headless") == 0) {
+            headless = 1;
+        }
+        else if (strcmp(argv[i], "--bench") == 0 && i + 1 < *lpArgc) {
+            headless = 1;
+            bench.frames = atoi(argv[++i]);
+            if (bench.frames < 1)
+                bench.frames = 1;
+        }
+        else if (strcmp(argv[i], "--golden") == 0 && i + 1 < *lpArgc) {
+            bench.goldenDir = argv[++i];
+        }
+        else if (strcmp(argv[i], "--update-golden") == 0) {
+            bench.updateGolden = 1;
+        }
+        else if (strcmp(argv[i], "--batch") == 0 && i + 2 < *lpArgc) {
+            headless = 1;
+            batch.lpListPath = argv[++i];
+            batch.lpOutputDir = argv[++i];
+        }
+        else if (strcmp(argv[i], "--batch-workers") == 0 && i + 1 < *lpArgc) {
+            batch.workers = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--batch-size") == 0 && i + 1 < *lpArgc) {
+            batch.size = atoi(argv[++i]);
+            if (batch.size < 1)
+                batch.size = 1;
+        }
+        else if (strcmp(argv[i], "--batch-format") == 0 && i + 1 < *lpArgc) {
+            i++;
+            batch.format = strcmp(argv[i], "raw") == 0 ? BATCH_RAW : BATCH_PPM;
+        }
+        else if (strcmp(argv[i], "--core") == 0) {
+            coreProfile = 1;
+        }
+        else if (strcmp(argv[i], "--impostor") == 0) {
+            impostor = 1;
+        }
+        else if (strcmp(argv[i], "--virtual-texture") == 0 && i + 1 < *lpArgc) {
+            lpVirtualTexturePath = argv[++i];
+            impostor = 1;
+        }
+        else if (strcmp(argv[i], "--watch-textures") == 0) {
+            watchTextures = 1;
+        }
+        else if (strcmp(argv[i], "--readouts") == 0) {
+            showReadouts = 1;
+        }
+        else if (strcmp(argv[i], "--no-state-cache") == 0) {
+            stateCache = 0;
+        }
+        else if (strcmp(argv[i], "--overlay-lines") == 0) {
+            overlayLines = 1;
+        }
+        else if (strcmp(argv[i], "--wall") == 0 && i + 1 < *lpArgc) {
+            wallCount = atoi(argv[++i]);
+            if (wallCount > WALL_MAX_INDICATORS)
+                wallCount = WALL_MAX_INDICATORS;
+        }
+        else if (strcmp(argv[i], "--wall-bench") == 0) {
+            headless = 1;
+            bench.wallSweep = 1;
+        }
+        else if (strcmp(argv[i], "--telemetry") == 0 && i + 1 < *lpArgc) {
+            lpTelemetrySource = argv[++i];
+        }
+        else if (strcmp(argv[i], "--predict") == 0 && i + 1 < *lpArgc) {
+            predictMilliseconds = atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--pace") == 0 && i + 1 < *lpArgc) {
+            i++;
+            if (strcmp(argv[i], "vsync") == 0) {
+                paceMode = PACE_VSYNC;
+            }
+            else if (strcmp(argv[i], "off") == 0) {
+                paceMode = PACE_NONE;
+            }
+            else {
+                paceMode = PACE_RATE;
+                paceFps = atof(argv[i]);
+                if (paceFps <= 0.0)
+                    paceMode = PACE_NONE;
+            }
+        }
+        else if (strcmp(argv[i], "--backlight") == 0 && i + 1 < *lpArgc) {
+            backlight.lpPath = argv[++i];
+        }
+        else if (strcmp(argv[i], "--backlight-rate") == 0 && i + 1 < *lpArgc) {
+            backlight.maxRate = atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--backlight-ramp") == 0 && i + 1 < *lpArgc) {
+            backlight.rampSeconds = atof(argv[++i]) / 1000.0;
+        }
+        else if (strcmp(argv[i], "--ambient-light") == 0 && i + 1 < *lpArgc) {
+            backlight.lpSensorPath = argv[++i];
+        }
+        else if (strcmp(argv[i], "--perf-dump") == 0 && i + 1 < *lpArgc) {
+            lpPerfPrefix = argv[++i];
+        }
+        else if (strcmp(argv[i], "--record") == 0 && i + 1 < *lpArgc) {
+            lpRecordPath = argv[++i];
+        }
+        else if (strcmp(argv[i], "--replay") == 0 && i + 1 < *lpArgc) {
+            lpReplayPath = argv[++i];
+        }
+        else if (strcmp(argv[i], "--capture") == 0 && i + 1 < *lpArgc) {
+            capture.lpPath = argv[++i];
+        }
+        else if (strcmp(argv[i], "--capture-format") == 0 && i + 1 < *lpArgc) {
+            i++;
+            capture.format = strcmp(argv[i], "rgba") == 0 ? CAPTURE_RGBA : CAPTURE_Y4M;
+        }
+        else if (strcmp(argv[i], "--capture-fps") == 0 && i + 1 < *lpArgc) {
+            capture.fps = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--replay-speed") == 0 && i + 1 < *lpArgc) {
+            i++;
+            replaySpeed = strcmp(argv[i], "max") == 0 ? 0.0 : atof(argv[i]);
+            if (replaySpeed < 0.0)
+                replaySpeed = 0.0;
+        }
+        else {
+            argv[kept++] = argv[i];
+        }
+    }
+    *lpArgc = kept;
+    argv[kept] = NULL;
+}
+
+/* Headless run: no GLUT and no backlight, just the render path in an offscreen
+ * framebuffer of the same size as the window.
+ */
+int runHeadless() {
+    int status;
+
+    startTextureDecode(720, 720);
+    if (!createHeadlessContext(720, 720))
+        return 1;
+    initGL();
+    initPerf(lpPerfPrefix);
+    reshape(720, 720);
+    if (watchTextures && !startTextureWatch())
+        return 1;
+    if (lpRecordPath != NULL) {
+        if (!startRecording(lpRecordPath))
+            return 1;
+        recordAttitude(roll, pitch, brightness);    // the state replay starts from
+    }
+    if (capture.lpPath != NULL) {
+        capture.waitForWriter = 1;      // no display to keep up with, so lose no frames
+        if (!startCapture(&capture, 720, 720))
+            return 1;
+    }
+    bench.lpReplayPath = lpReplayPath;
+    bench.replaySpeed = replaySpeed;
+    status = runBenchmark(&bench);      // golden images are another size, not captured
+    stopCapture();
+    stopRecording();
+    if (lpPerfPrefix != NULL) {
+        perfDump(PERF_JSON);
+        perfDump(PERF_CSV);
+    }
+    stopTextureWatch();
+    closeVirtualTexture();
+    destroyHeadlessContext();
+    return status;
+}
+
 int main(int argc, char** argv) {
+    parseOptions(&argc, argv);
+    if (batch.lpListPath != NULL)
+        return runBatch(&batch);
+    if (headless)
+        return runHeadless();
+
+    startTextureDecode(720, 720);       // decode the JPEGs while GLUT opens the window
+
     glutInit(&argc, argv); // Allows processing of certain GLUT command line options
     glutInitDisplayMode(GLUT_DOUBLE | GLUT_DEPTH);  // Usually, omit GLUT_DEPTH for 2D drawing!
     glutInitWindowSize(720,720);        // size of display area, in pixels
     
     glutInitWindowPosition(0,0);        // location in window coordinates
+    if (coreProfile) {
+        glutInitContextVersion(3, 3);
+        glutInitContextProfile(GLUT_CORE_PROFILE);
+    }
     glutCreateWindow("OpenGL Program"); // parameter is window title  
     glutDisplayFunc(display);           // call display() when the window needs to be redrawn
     glutReshapeFunc(reshape);           // call reshape() when the size of the window changes
@@ -568,20 +895,46 @@ int main(int argc, char** argv) {
     createMenu();
 
     initGL();
-    globbuf.gl_offs = 3;
-    int result = glob("/sys/class/backlight/*/brightness", GLOB_ERR, NULL, &globbuf);
-    if (result == GLOB_NOMATCH)
-        fprintf(stderr, "glob error: No match!\n");
-    else if (result == GLOB_NOSPACE)
-        fprintf(stderr, "glog error: No space!\n");
-    else if (result == GLOB_ABORTED)
-        fprintf(stderr, "glob error: Aborted!\n");
+    initPerf(lpPerfPrefix);
+    installPerfSignal();
+    if (capture.lpPath != NULL) {
+        if (!startCapture(&capture, 720, 720))
+            return 1;
+        atexit(stopCapture);
+    }
+    initScheduler(paceMode, paceFps);
+    if (startBacklight(&backlight))
+        atexit(stopBacklight);
     updateBrightness();
 
+    if (lpRecordPath != NULL) {
+        if (!startRecording(lpRecordPath))
+            return 1;
+        atexit(stopRecording);
+        recordAttitude(roll, pitch, brightness);    // the state replay starts from
+    }
+    if (lpReplayPath != NULL) {
+        if (!openReplay(lpReplayPath))
+            return 1;
+        startReplay(replaySpeed);       // through changeAttitude() and changeBrightness()
+    }
+
+    if (watchTextures) {
+        if (!startTextureWatch())
+            return 1;
+        watchTextureReloads();
+    }
+
+    if (lpTelemetrySource != NULL) {
+        if (!startTelemetry(lpTelemetrySource))
+            return 1;
+        atexit(stopTelemetry);
+        watchTelemetry();               // a frame for every sample that moves the indicator
+    }
+
     /* TODO: Uncomment the next line to start a timer-controlled animation. */
     //startAnimation();
     
     glutMainLoop(); // Run the event loop!  This function does not return.
-    globfree(&globbuf);
     return 0;
 }
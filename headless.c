@@ -0,0 +1,206 @@
+
+/* Offscreen EGL rendering, see headless.h. */
+
+#define GL_GLEXT_PROTOTYPES
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <GL/gl.h>
+#include <GL/glext.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "indicator.h"
+#include "headless.h"
+
+static EGLDisplay eglDisplay = EGL_NO_DISPLAY;
+static EGLContext eglContext = EGL_NO_CONTEXT;
+static GLuint framebuffer, colorBuffer, depthBuffer;
+static int fbWidth, fbHeight;
+
+/* Returns a display on the surfaceless platform if the EGL implementation offers
+ * it, and the default display otherwise.
+ */
+static EGLDisplay getHeadlessDisplay() {
+    PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay;
+    const char* lpExtensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+
+    if (lpExtensions != NULL && strstr(lpExtensions, "EGL_MESA_platform_surfaceless") != NULL) {
+        getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+        if (getPlatformDisplay != NULL)
+            return getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+    }
+    return eglGetDisplay(EGL_DEFAULT_DISPLAY);
+}
+
+/* Creates an OpenGL context without any surface (compatibility profile, or 3.3
+ * core profile with --core), makes it current and binds a w x h framebuffer
+ * object to draw into.  Returns 0 on failure.
+ */
+int createHeadlessContext(int w, int h) {
+    static const EGLint coreAttributes[] = {
+        EGL_CONTEXT_MAJOR_VERSION, 3,
+        EGL_CONTEXT_MINOR_VERSION, 3,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+        EGL_NONE
+    };
+    EGLint major, minor;
+
+    eglDisplay = getHeadlessDisplay();
+    if (eglDisplay == EGL_NO_DISPLAY || !eglInitialize(eglDisplay, &major, &minor)) {
+        fprintf(stderr, "%s:%u: Failed to initialize EGL (0x%x)\n", __FILE__, __LINE__, eglGetError());
+        return 0;
+    }
+    if (!eglBindAPI(EGL_OPENGL_API)) {
+        fprintf(stderr, "%s:%u: EGL has no desktop OpenGL support\n", __FILE__, __LINE__);
+        return 0;
+    }
+
+    // No config and no surface: EGL_KHR_no_config_context and EGL_KHR_surfaceless_context.
+    eglContext = eglCreateContext(eglDisplay, (EGLConfig)0, EGL_NO_CONTEXT, coreProfile ? coreAttributes : NULL);
+    if (eglContext == EGL_NO_CONTEXT) {
+        fprintf(stderr, "%s:%u: Failed to create EGL context (0x%x)\n", __FILE__, __LINE__, eglGetError());
+        return 0;
+    }
+    if (!eglMakeCurrent(eglDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, eglContext)) {
+        fprintf(stderr, "%s:%u: Failed to make EGL context current (0x%x)\n", __FILE__, __LINE__, eglGetError());
+        return 0;
+    }
+
+#ifdef DEBUG
+    fprintf(stderr, "%s:%u: EGL %d.%d, renderer %s\n", __FILE__, __LINE__, major, minor,
+            (const char*)glGetString(GL_RENDERER));
+#endif
+
+    glGenFramebuffers(1, &framebuffer);
+    glGenRenderbuffers(1, &colorBuffer);
+    glGenRenderbuffers(1, &depthBuffer);
+    return resizeHeadlessFramebuffer(w, h);
+}
+
+/* (Re)allocates the offscreen color and depth buffers at w x h.  The caller is
+ * responsible for calling reshape() afterwards.
+ */
+int resizeHeadlessFramebuffer(int w, int h) {
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+
+    glBindRenderbuffer(GL_RENDERBUFFER, colorBuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, w, h);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colorBuffer);
+
+    glBindRenderbuffer(GL_RENDERBUFFER, depthBuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, w, h);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthBuffer);
+
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        fprintf(stderr, "%s:%u: Offscreen framebuffer %d x %d is incomplete\n", __FILE__, __LINE__, w, h);
+        return 0;
+    }
+    fbWidth = w;
+    fbHeight = h;
+    return 1;
+}
+
+/* Takes the place of glutSwapBuffers(): waits until the frame is completely
+ * rendered, so frame times measured around display() include the GPU work.
+ */
+void finishHeadlessFrame() {
+    glFinish();
+}
+
+/* Reads the current frame as tightly packed RGB, top row first (the order used by
+ * image files rather than by OpenGL).  lpRgb must hold width * height * 3 bytes.
+ */
+int readHeadlessPixels(unsigned char* lpRgb) {
+    int rowBytes = fbWidth * 3;
+    unsigned char* lpRow;
+    int y;
+
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, fbWidth, fbHeight, GL_RGB, GL_UNSIGNED_BYTE, lpRgb);
+
+    if ((lpRow = (unsigned char*)malloc(rowBytes)) == NULL) {
+        fprintf(stderr, "%s:%u: Allocation of lpRow failed\n", __FILE__, __LINE__);
+        return 0;
+    }
+    for (y = 0; y < fbHeight / 2; y++) {
+        unsigned char* lpTop = lpRgb + y * rowBytes;
+        unsigned char* lpBottom = lpRgb + (fbHeight - 1 - y) * rowBytes;
+        memcpy(lpRow, lpTop, rowBytes);
+        memcpy(lpTop, lpBottom, rowBytes);
+        memcpy(lpBottom, lpRow, rowBytes);
+    }
+    free(lpRow);
+    return 1;
+}
+
+void destroyHeadlessContext() {
+    if (eglContext == EGL_NO_CONTEXT)
+        return;
+    glDeleteFramebuffers(1, &framebuffer);
+    glDeleteRenderbuffers(1, &colorBuffer);
+    glDeleteRenderbuffers(1, &depthBuffer);
+    eglMakeCurrent(eglDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    eglDestroyContext(eglDisplay, eglContext);
+    eglTerminate(eglDisplay);
+    eglContext = EGL_NO_CONTEXT;
+    eglDisplay = EGL_NO_DISPLAY;
+}
+
+// ------------------------------- PPM image files ----------------------------------
+
+/* Writes a binary (P6) PPM file from top-down RGB data.  Returns 0 on failure. */
+int writePPMFile(const char* lpFilename, const unsigned char* lpRgb, int w, int h) {
+    FILE* fHandle;
+    size_t dwBytes = (size_t)w * h * 3;
+
+    fHandle = fopen(lpFilename, "wb");
+    if (fHandle == NULL) {
+        fprintf(stderr, "%s:%u: Failed to write file %s\n", __FILE__, __LINE__, lpFilename);
+        return 0;
+    }
+    fprintf(fHandle, "P6\n%d %d\n255\n", w, h);
+    if (fwrite(lpRgb, 1, dwBytes, fHandle) != dwBytes) {
+        fprintf(stderr, "%s:%u: Short write to %s\n", __FILE__, __LINE__, lpFilename);
+        fclose(fHandle);
+        return 0;
+    }
+    fclose(fHandle);
+    return 1;
+}
+
+/* Reads a binary (P6) PPM file with 8-bit channels written by writePPMFile().
+ * Returns a malloc()ed top-down RGB buffer, or NULL if the file is missing or not
+ * understood.
+ */
+unsigned char* readPPMFile(const char* lpFilename, int* lpWidth, int* lpHeight) {
+    FILE* fHandle;
+    unsigned char* lpRgb;
+    int w, h, maxValue;
+    size_t dwBytes;
+
+    fHandle = fopen(lpFilename, "rb");
+    if (fHandle == NULL)
+        return NULL;
+    if (fscanf(fHandle, "P6 %d %d %d", &w, &h, &maxValue) != 3 || maxValue != 255 || fgetc(fHandle) == EOF) {
+        fprintf(stderr, "%s:%u: %s is not a binary 8-bit PPM file\n", __FILE__, __LINE__, lpFilename);
+        fclose(fHandle);
+        return NULL;
+    }
+    dwBytes = (size_t)w * h * 3;
+    if ((lpRgb = (unsigned char*)malloc(dwBytes)) == NULL) {
+        fprintf(stderr, "%s:%u: Allocation of lpRgb failed\n", __FILE__, __LINE__);
+        fclose(fHandle);
+        return NULL;
+    }
+    if (fread(lpRgb, 1, dwBytes, fHandle) != dwBytes) {
+        fprintf(stderr, "%s:%u: %s is truncated\n", __FILE__, __LINE__, lpFilename);
+        free(lpRgb);
+        fclose(fHandle);
+        return NULL;
+    }
+    fclose(fHandle);
+    *lpWidth = w;
+    *lpHeight = h;
+    return lpRgb;
+}
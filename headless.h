@@ -0,0 +1,21 @@
+
+/* Offscreen rendering without a window system.  An EGL context is created on the
+ * Mesa surfaceless platform (which runs on llvmpipe without any GPU or X server),
+ * and everything is drawn into a framebuffer object with color and depth
+ * renderbuffers.  This is what CI uses to drive display() for benchmarks and
+ * golden image checks.
+ */
+
+#ifndef HEADLESS_H
+#define HEADLESS_H
+
+int createHeadlessContext(int w, int h);
+int resizeHeadlessFramebuffer(int w, int h);
+void finishHeadlessFrame();
+int readHeadlessPixels(unsigned char* lpRgb);
+void destroyHeadlessContext();
+
+int writePPMFile(const char* lpFilename, const unsigned char* lpRgb, int w, int h);
+unsigned char* readPPMFile(const char* lpFilename, int* lpWidth, int* lpHeight);
+
+#endif
@@ -0,0 +1,298 @@
+
+/* JPEG decoding and mip level generation, see image.h. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <setjmp.h>
+#include <jpeglib.h>
+#include <jerror.h>
+#include "image.h"
+
+#define SCANLINES_PER_READ 16
+
+/* libjpeg's standard error manager ends the process on an error.  This one jumps
+ * back to the decoder instead, so a damaged file only fails its own decode.
+ */
+struct jpegErrorManager {
+    struct jpeg_error_mgr std;      // first, so info.err points to the whole struct
+    void (*stdEmitMessage)(j_common_ptr lpInfo, int level);
+    jmp_buf escape;
+};
+
+static void escapeJpegError(j_common_ptr lpInfo) {
+    struct jpegErrorManager* lpErr = (struct jpegErrorManager*)lpInfo->err;
+
+    (*lpInfo->err->output_message)(lpInfo);
+    longjmp(lpErr->escape, 1);
+}
+
+/* libjpeg only warns about a file that ends early and pads the image with gray.
+ * That is how a file caught half written looks, so it is an error here.
+ */
+static void emitJpegMessage(j_common_ptr lpInfo, int level) {
+    struct jpegErrorManager* lpErr = (struct jpegErrorManager*)lpInfo->err;
+
+    if (level < 0 && lpInfo->err->msg_code == JWRN_JPEG_EOF)
+        escapeJpegError(lpInfo);
+    lpErr->stdEmitMessage(lpInfo, level);
+}
+
+/* Sets up lpErr; the caller still has to setjmp(lpErr->escape). */
+static struct jpeg_error_mgr* jpegErrors(struct jpegErrorManager* lpErr) {
+    jpeg_std_error(&lpErr->std);
+    lpErr->std.error_exit = escapeJpegError;
+    lpErr->stdEmitMessage = lpErr->std.emit_message;
+    lpErr->std.emit_message = emitJpegMessage;
+    return &lpErr->std;
+}
+
+/* Size of a dimension after libjpeg DCT scaling by 1/denom. */
+static unsigned long scaledSize(unsigned long size, unsigned int denom) {
+    return (size + denom - 1) / denom;
+}
+
+/* Picks a libjpeg DCT scale of 1/1, 1/2, 1/4 or 1/8: the strongest reduction that
+ * still gives at least neededWidth x neededHeight (zero means full resolution),
+ * reduced further if needed until neither side exceeds maxSize (zero means no
+ * limit).  Must be called after jpeg_read_header().
+ */
+static void chooseScale(struct jpeg_decompress_struct* lpInfo, unsigned long neededWidth,
+                        unsigned long neededHeight, unsigned long maxSize) {
+    unsigned int denom = 1;
+
+    if (neededWidth != 0 && neededHeight != 0) {
+        while (denom < 8 && scaledSize(lpInfo->image_width, denom * 2) >= neededWidth &&
+                scaledSize(lpInfo->image_height, denom * 2) >= neededHeight)
+            denom *= 2;
+    }
+    if (maxSize != 0) {
+        while (denom < 8 && (scaledSize(lpInfo->image_width, denom) > maxSize ||
+                scaledSize(lpInfo->image_height, denom) > maxSize))
+            denom *= 2;
+    }
+    lpInfo->scale_num = 1;
+    lpInfo->scale_denom = denom;
+}
+
+/* Decodes lpFilename into an RGB buffer, using DCT scaling to get no more pixels
+ * than neededWidth x neededHeight calls for and no side larger than maxSize (see
+ * chooseScale()).  Returns NULL on failure.
+ */
+struct imgRawImage* loadJpegImageFileScaled(char* lpFilename, unsigned long neededWidth,
+                                            unsigned long neededHeight, unsigned long maxSize) {
+    struct jpeg_decompress_struct info;
+    struct jpegErrorManager err;
+
+    struct imgRawImage* volatile lpNewImage = NULL;    // volatile: still valid after longjmp()
+
+    unsigned long int imgWidth, imgHeight;
+    int numComponents;
+
+    unsigned long int dwBufferBytes;
+    unsigned char* volatile lpData = NULL;
+
+    unsigned char* lpRowBuffer[SCANLINES_PER_READ];
+
+    FILE* fHandle;
+
+    fHandle = fopen(lpFilename, "rb");
+    if(fHandle == NULL) {
+        fprintf(stderr, "%s:%u: Failed to read file %s\n", __FILE__, __LINE__, lpFilename);
+        return NULL; /* ToDo */
+    }
+
+    info.err = jpegErrors(&err);
+    jpeg_create_decompress(&info);
+    if (setjmp(err.escape)) {
+        fprintf(stderr, "%s:%u: Failed to decode %s\n", __FILE__, __LINE__, lpFilename);
+        free(lpNewImage);
+        free(lpData);
+        jpeg_destroy_decompress(&info);
+        fclose(fHandle);
+        return NULL;
+    }
+
+    jpeg_stdio_src(&info, fHandle);
+    jpeg_read_header(&info, TRUE);
+
+    info.out_color_space = JCS_RGB;  /* We only read RGB, also for grayscale files */
+    chooseScale(&info, neededWidth, neededHeight, maxSize);
+
+    jpeg_start_decompress(&info);
+    imgWidth = info.output_width;
+    imgHeight = info.output_height;
+    numComponents = info.num_components;
+
+    #ifdef DEBUG
+    fprintf(
+        stderr,
+        "%s:%u: Reading JPEG with dimensions %lu x %lu (scale 1/%u) and %u components\n",
+        __FILE__, __LINE__,
+        imgWidth, imgHeight, info.scale_denom, numComponents
+    );
+    #endif
+
+    dwBufferBytes = imgWidth * imgHeight * 3; /* We only read RGB, not A */
+    if ((lpData = (unsigned char*)malloc(sizeof(unsigned char)*dwBufferBytes)) == NULL) {
+        fprintf(stderr, "%s:%u: Allocation of lpData failed\n", __FILE__, __LINE__);
+        jpeg_destroy_decompress(&info);
+        fclose(fHandle);
+        return NULL;
+    }
+
+    if ((lpNewImage = (struct imgRawImage*)malloc(sizeof(struct imgRawImage))) == NULL) {
+        fprintf(stderr, "%s:%u: Allocation of lpNewImage failed\n", __FILE__, __LINE__);
+        free(lpData);
+        jpeg_destroy_decompress(&info);
+        fclose(fHandle);
+        return NULL;
+    }
+
+    lpNewImage->numComponents = numComponents;
+    lpNewImage->width = imgWidth;
+    lpNewImage->height = imgHeight;
+    lpNewImage->lpData = lpData;
+
+    /* Read a batch of scanlines per call; libjpeg fills as many as it can */
+    while(info.output_scanline < info.output_height) {
+        JDIMENSION rows = info.output_height - info.output_scanline;
+        JDIMENSION i;
+        if (rows > SCANLINES_PER_READ)
+            rows = SCANLINES_PER_READ;
+        for (i = 0; i < rows; i++)
+            lpRowBuffer[i] = (unsigned char *)(&lpData[3*info.output_width*(info.output_scanline + i)]);
+        jpeg_read_scanlines(&info, lpRowBuffer, rows);
+    }
+
+    jpeg_finish_decompress(&info);
+    jpeg_destroy_decompress(&info);
+    fclose(fHandle);
+
+    return lpNewImage;
+}
+
+struct imgRawImage* loadJpegImageFile(char* lpFilename) {
+    return loadJpegImageFileScaled(lpFilename, 0, 0, 0);
+}
+
+// ------------------------------- row streaming ---------------------------------
+
+struct jpegRowReader {
+    struct jpeg_decompress_struct info;
+    struct jpegErrorManager err;
+    FILE* fHandle;
+    int failed;             // a decode error left info unusable
+};
+
+/* Starts decoding lpFilename at full resolution without keeping the image: the
+ * rows come out of readJpegRows() in order, so images far larger than memory can
+ * be processed.  Returns NULL on failure.
+ */
+struct jpegRowReader* openJpegRows(char* lpFilename, unsigned long* lpWidth, unsigned long* lpHeight) {
+    struct jpegRowReader* lpReader;
+
+    if ((lpReader = (struct jpegRowReader*)malloc(sizeof(struct jpegRowReader))) == NULL) {
+        fprintf(stderr, "%s:%u: Allocation of lpReader failed\n", __FILE__, __LINE__);
+        return NULL;
+    }
+    if ((lpReader->fHandle = fopen(lpFilename, "rb")) == NULL) {
+        fprintf(stderr, "%s:%u: Failed to read file %s\n", __FILE__, __LINE__, lpFilename);
+        free(lpReader);
+        return NULL;
+    }
+    lpReader->failed = 0;
+    lpReader->info.err = jpegErrors(&lpReader->err);
+    jpeg_create_decompress(&lpReader->info);
+    if (setjmp(lpReader->err.escape)) {
+        fprintf(stderr, "%s:%u: Failed to decode %s\n", __FILE__, __LINE__, lpFilename);
+        jpeg_destroy_decompress(&lpReader->info);
+        fclose(lpReader->fHandle);
+        free(lpReader);
+        return NULL;
+    }
+    jpeg_stdio_src(&lpReader->info, lpReader->fHandle);
+    jpeg_read_header(&lpReader->info, TRUE);
+    lpReader->info.out_color_space = JCS_RGB;
+    jpeg_start_decompress(&lpReader->info);
+    *lpWidth = lpReader->info.output_width;
+    *lpHeight = lpReader->info.output_height;
+    return lpReader;
+}
+
+/* Decodes up to count RGB rows into lpRows.  Returns the number of rows, 0 at the
+ * end of the image or after a decode error, so a damaged file comes out short.
+ */
+unsigned int readJpegRows(struct jpegRowReader* lpReader, unsigned char* lpRows, unsigned int count) {
+    unsigned char* lpRowBuffer[SCANLINES_PER_READ];
+    unsigned int done = 0, rows, i;
+
+    if (lpReader->failed)
+        return 0;
+    if (setjmp(lpReader->err.escape)) {
+        lpReader->failed = 1;
+        return 0;
+    }
+    while (done < count && lpReader->info.output_scanline < lpReader->info.output_height) {
+        rows = count - done < SCANLINES_PER_READ ? count - done : SCANLINES_PER_READ;
+        for (i = 0; i < rows; i++)
+            lpRowBuffer[i] = lpRows + (size_t)(done + i) * lpReader->info.output_width * 3;
+        done += jpeg_read_scanlines(&lpReader->info, lpRowBuffer, rows);
+    }
+    return done;
+}
+
+void closeJpegRows(struct jpegRowReader* lpReader) {
+    jpeg_abort_decompress(&lpReader->info);
+    jpeg_destroy_decompress(&lpReader->info);
+    fclose(lpReader->fHandle);
+    free(lpReader);
+}
+
+void freeImage(struct imgRawImage* lpImage) {
+    if (lpImage == NULL)
+        return;
+    free(lpImage->lpData);
+    free(lpImage);
+}
+
+
+/* Returns the next mip level of an RGB image: max(1, width/2) x max(1, height/2)
+ * pixels, each the rounded average of the 2x2 source block it covers (edge pixels
+ * are repeated for odd sizes).  Returns NULL on allocation failure.
+ */
+struct imgRawImage* downsampleImage(const struct imgRawImage* lpImage) {
+    struct imgRawImage* lpNewImage;
+    unsigned long w = lpImage->width > 1 ? lpImage->width / 2 : 1;
+    unsigned long h = lpImage->height > 1 ? lpImage->height / 2 : 1;
+    unsigned long x, y;
+    int c;
+
+    if ((lpNewImage = (struct imgRawImage*)malloc(sizeof(struct imgRawImage))) == NULL) {
+        fprintf(stderr, "%s:%u: Allocation of lpNewImage failed\n", __FILE__, __LINE__);
+        return NULL;
+    }
+    if ((lpNewImage->lpData = (unsigned char*)malloc(w * h * 3)) == NULL) {
+        fprintf(stderr, "%s:%u: Allocation of lpData failed\n", __FILE__, __LINE__);
+        free(lpNewImage);
+        return NULL;
+    }
+    lpNewImage->numComponents = 3;
+    lpNewImage->width = w;
+    lpNewImage->height = h;
+
+    for (y = 0; y < h; y++) {
+        unsigned long y0 = y * 2 < lpImage->height ? y * 2 : lpImage->height - 1;
+        unsigned long y1 = y * 2 + 1 < lpImage->height ? y * 2 + 1 : lpImage->height - 1;
+        for (x = 0; x < w; x++) {
+            unsigned long x0 = x * 2 < lpImage->width ? x * 2 : lpImage->width - 1;
+            unsigned long x1 = x * 2 + 1 < lpImage->width ? x * 2 + 1 : lpImage->width - 1;
+            const unsigned char* p00 = &lpImage->lpData[3 * (y0 * lpImage->width + x0)];
+            const unsigned char* p01 = &lpImage->lpData[3 * (y0 * lpImage->width + x1)];
+            const unsigned char* p10 = &lpImage->lpData[3 * (y1 * lpImage->width + x0)];
+            const unsigned char* p11 = &lpImage->lpData[3 * (y1 * lpImage->width + x1)];
+            for (c = 0; c < 3; c++)
+                lpNewImage->lpData[3 * (y * w + x) + c] = (p00[c] + p01[c] + p10[c] + p11[c] + 2) / 4;
+        }
+    }
+    return lpNewImage;
+}
@@ -0,0 +1,26 @@
+
+/* CPU-side images: JPEG decoding through libjpeg and mip level generation.  This
+ * part does not use GL, so the offline bake tool shares it with the program.
+ */
+
+#ifndef IMAGE_H
+#define IMAGE_H
+
+struct imgRawImage {
+    unsigned int numComponents;
+    unsigned long int width, height;
+    unsigned char* lpData;  // tightly packed RGB rows, first row at the top of the image
+};
+
+struct imgRawImage* loadJpegImageFile(char* lpFilename);
+struct imgRawImage* loadJpegImageFileScaled(char* lpFilename, unsigned long neededWidth,
+                                            unsigned long neededHeight, unsigned long maxSize);
+struct imgRawImage* downsampleImage(const struct imgRawImage* lpImage);
+void freeImage(struct imgRawImage* lpImage);
+
+struct jpegRowReader;
+struct jpegRowReader* openJpegRows(char* lpFilename, unsigned long* lpWidth, unsigned long* lpHeight);
+unsigned int readJpegRows(struct jpegRowReader* lpReader, unsigned char* lpRows, unsigned int count);
+void closeJpegRows(struct jpegRowReader* lpReader);
+
+#endif
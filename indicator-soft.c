@@ -0,0 +1,352 @@
+
+/* indicator-soft: the attitude indicator without GL, for panels that have a
+ * Linux framebuffer but no usable GPU driver.  Draws with the software renderer
+ * (soft.h) either into /dev/fbN or into a PPM file.
+ *
+ *    indicator-soft [--threads N] [--size N] [--roll DEG] [--pitch DEG]
+ *                   [--telemetry SRC] [--output /dev/fb0|FILE.ppm] [--bench FRAMES]
+ *
+ * Without --telemetry one frame is drawn at the given attitude.  With it, the
+ * panel follows the attitude source (see telemetry.h) until killed, drawing at
+ * most 60 frames per second and only when the attitude changed.  --bench times
+ * the same sweep as glut-starter --bench, so both renderers can be compared on
+ * one board.
+ *
+ * Compile with
+ *    gcc -O2 -o indicator-soft indicator-soft.c soft.c marks.c image.c telemetry.c -ljpeg -lm -pthread
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <linux/fb.h>
+#include "image.h"
+#include "marks.h"
+#include "telemetry.h"
+#include "soft.h"
+
+#define ARC_INDICES 37
+#define DEFAULT_SIZE 720
+#define WARMUP_FRAMES 10
+#define FRAME_INTERVAL_MS (1000.0 / 60.0)
+#define POLL_INTERVAL_NS 2000000L
+
+static int threadCount = 0;            // 0: one per online CPU
+static int size = DEFAULT_SIZE;
+static float roll = 0.0f, pitch = 0.0f;
+static const char* lpTelemetrySource;
+static const char* lpOutputPath;
+static int benchFrames = 0;
+
+// The Linux framebuffer, when lpOutputPath names one.
+static int fbFd = -1;
+static unsigned char* lpFbMemory;
+static size_t fbMemorySize;
+static struct fb_var_screeninfo fbVar;
+static struct fb_fix_screeninfo fbFix;
+
+static double nowMilliseconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+static int compareDoubles(const void* a, const void* b) {
+    double da = *(const double*)a, db = *(const double*)b;
+    return (da > db) - (da < db);
+}
+
+/* Nearest-rank percentile of an ascending array. */
+static double percentile(const double* lpSorted, int count, double p) {
+    int rank = (int)ceil(p / 100.0 * count);
+    if (rank < 1)
+        rank = 1;
+    return lpSorted[rank - 1];
+}
+
+// ------------------------------- textures -------------------------------------
+
+/* Decodes a JPEG at the resolution a panel of the given size can show and packs
+ * it into 0x00RRGGBB texels.  Returns 0 on failure.
+ */
+static int loadSoftTexture(char* lpFilename, unsigned long neededWidth, unsigned long neededHeight,
+                           struct softTexture* lpTexture) {
+    struct imgRawImage* lpImage = loadJpegImageFileScaled(lpFilename, neededWidth, neededHeight, 0);
+    unsigned long i, count;
+
+    if (lpImage == NULL)
+        return 0;
+    count = lpImage->width * lpImage->height;
+    if ((lpTexture->lpTexels = (uint32_t*)malloc(count * sizeof(uint32_t))) == NULL) {
+        fprintf(stderr, "%s:%u: Allocation of lpTexels failed\n", __FILE__, __LINE__);
+        freeImage(lpImage);
+        return 0;
+    }
+    for (i = 0; i < count; i++) {
+        const unsigned char* lpPixel = lpImage->lpData + i * lpImage->numComponents;
+        if (lpImage->numComponents >= 3)
+            lpTexture->lpTexels[i] = (uint32_t)lpPixel[0] << 16 | (uint32_t)lpPixel[1] << 8 | lpPixel[2];
+        else
+            lpTexture->lpTexels[i] = (uint32_t)lpPixel[0] * 0x010101u;
+    }
+    lpTexture->width = (int)lpImage->width;
+    lpTexture->height = (int)lpImage->height;
+    freeImage(lpImage);
+    return 1;
+}
+
+// ------------------------------- output ---------------------------------------
+
+/* Maps the framebuffer device at lpPath and takes the panel size from it.
+ * Returns 0 on failure or for pixel formats other than 32 and 16 bits.
+ */
+static int openFramebuffer(const char* lpPath) {
+    if ((fbFd = open(lpPath, O_RDWR)) < 0) {
+        fprintf(stderr, "%s:%u: Failed to open %s: %s\n", __FILE__, __LINE__, lpPath, strerror(errno));
+        return 0;
+    }
+    if (ioctl(fbFd, FBIOGET_VSCREENINFO, &fbVar) < 0 || ioctl(fbFd, FBIOGET_FSCREENINFO, &fbFix) < 0) {
+        fprintf(stderr, "%s:%u: %s is not a framebuffer: %s\n", __FILE__, __LINE__, lpPath, strerror(errno));
+        return 0;
+    }
+    if (fbVar.bits_per_pixel != 32 && fbVar.bits_per_pixel != 16) {
+        fprintf(stderr, "%s:%u: %s has %u bits per pixel, need 32 or 16\n", __FILE__, __LINE__, lpPath,
+                fbVar.bits_per_pixel);
+        return 0;
+    }
+    fbMemorySize = (size_t)fbFix.line_length * fbVar.yres_virtual;
+    lpFbMemory = (unsigned char*)mmap(NULL, fbMemorySize, PROT_READ | PROT_WRITE, MAP_SHARED, fbFd, 0);
+    if (lpFbMemory == MAP_FAILED) {
+        fprintf(stderr, "%s:%u: Failed to map %s: %s\n", __FILE__, __LINE__, lpPath, strerror(errno));
+        lpFbMemory = NULL;
+        return 0;
+    }
+    return 1;
+}
+
+/* Copies a finished frame to the visible part of the framebuffer. */
+static void showFrame(const struct softFramebuffer* lpFrame) {
+    int x, y;
+
+    for (y = 0; y < lpFrame->height; y++) {
+        const uint32_t* lpIn = lpFrame->lpPixels + y * lpFrame->width;
+        unsigned char* lpLine = lpFbMemory + (size_t)(y + fbVar.yoffset) * fbFix.line_length
+                                + fbVar.xoffset * (fbVar.bits_per_pixel / 8);
+        if (fbVar.bits_per_pixel == 32) {
+            memcpy(lpLine, lpIn, lpFrame->width * sizeof(uint32_t));
+            continue;
+        }
+        for (x = 0; x < lpFrame->width; x++) {   // RGB565
+            uint32_t c = lpIn[x];
+            ((uint16_t*)lpLine)[x] = (uint16_t)((c >> 8 & 0xf800) | (c >> 5 & 0x07e0) | (c >> 3 & 0x001f));
+        }
+    }
+}
+
+/* Writes a frame as a binary PPM file, through a temporary file so that a
+ * viewer never sees half a frame.  Returns 0 on failure.
+ */
+static int writeFrameFile(const char* lpPath, const struct softFramebuffer* lpFrame) {
+    char tempPath[1024];
+    FILE* lpFile;
+    unsigned char* lpRow;
+    int x, y, ok;
+
+    snprintf(tempPath, sizeof(tempPath), "%s.tmp", lpPath);
+    if ((lpFile = fopen(tempPath, "wb")) == NULL) {
+        fprintf(stderr, "%s:%u: Failed to create %s: %s\n", __FILE__, __LINE__, tempPath, strerror(errno));
+        return 0;
+    }
+    if ((lpRow = (unsigned char*)malloc(lpFrame->width * 3)) == NULL) {
+        fprintf(stderr, "%s:%u: Allocation of lpRow failed\n", __FILE__, __LINE__);
+        fclose(lpFile);
+        return 0;
+    }
+    fprintf(lpFile, "P6\n%d %d\n255\n", lpFrame->width, lpFrame->height);
+    for (y = 0; y < lpFrame->height; y++) {
+        for (x = 0; x < lpFrame->width; x++) {
+            uint32_t c = lpFrame->lpPixels[y * lpFrame->width + x];
+            lpRow[x * 3] = c >> 16 & 0xff;
+            lpRow[x * 3 + 1] = c >> 8 & 0xff;
+            lpRow[x * 3 + 2] = c & 0xff;
+        }
+        fwrite(lpRow, 1, lpFrame->width * 3, lpFile);
+    }
+    free(lpRow);
+    ok = fclose(lpFile) == 0 && rename(tempPath, lpPath) == 0;
+    if (!ok)
+        fprintf(stderr, "%s:%u: Failed to write %s: %s\n", __FILE__, __LINE__, lpPath, strerror(errno));
+    return ok;
+}
+
+static void outputFrame(const struct softFramebuffer* lpFrame) {
+    if (lpFbMemory != NULL)
+        showFrame(lpFrame);
+    else if (lpOutputPath != NULL)
+        writeFrameFile(lpOutputPath, lpFrame);
+}
+
+// ------------------------------- modes ----------------------------------------
+
+/* The sweep of glut-starter --bench: three full roll oscillations of +-60
+ * degrees while pitch turns twice all the way round.
+ */
+static int runSoftBenchmark(struct softFramebuffer* lpFrame) {
+    double* lpTimes;
+    double total = 0.0, start, t;
+    int i;
+
+    if ((lpTimes = (double*)malloc(sizeof(double) * benchFrames)) == NULL) {
+        fprintf(stderr, "%s:%u: Allocation of lpTimes failed\n", __FILE__, __LINE__);
+        return 1;
+    }
+    for (i = -WARMUP_FRAMES; i < benchFrames; i++) {
+        t = (double)(i < 0 ? i + WARMUP_FRAMES : i) / benchFrames;
+        start = nowMilliseconds();
+        renderSoft(lpFrame, (float)(60.0 * sin(2 * M_PI * 3 * t)), (float)fmod(720.0 * t, 360.0));
+        if (i >= 0) {
+            lpTimes[i] = nowMilliseconds() - start;
+            total += lpTimes[i];
+        }
+    }
+    qsort(lpTimes, benchFrames, sizeof(double), compareDoubles);
+    printf("renderer: software, %d threads\n", threadCount);
+    printf("frames: %d at %dx%d\n", benchFrames, lpFrame->width, lpFrame->height);
+    printf("frame time ms: min %.3f p50 %.3f p95 %.3f p99 %.3f max %.3f\n",
+           lpTimes[0], percentile(lpTimes, benchFrames, 50), percentile(lpTimes, benchFrames, 95),
+           percentile(lpTimes, benchFrames, 99), lpTimes[benchFrames - 1]);
+    printf("fps: %.1f\n", benchFrames * 1000.0 / total);
+    free(lpTimes);
+    outputFrame(lpFrame);
+    return 0;
+}
+
+/* Follows the telemetry source until the process is killed, drawing only when
+ * the attitude changed and no more often than every FRAME_INTERVAL_MS.
+ */
+static int followTelemetry(struct softFramebuffer* lpFrame) {
+    struct attitudeSample sample;
+    struct timespec pollInterval = { 0, POLL_INTERVAL_NS };
+    double lastFrame = 0.0;
+    int changed = 1;
+
+    if (!startTelemetry(lpTelemetrySource))
+        return 1;
+    for (;;) {
+        while (pollTelemetry(&sample)) {
+            if (sample.roll != roll || sample.pitch != pitch) {
+                roll = sample.roll;
+                pitch = sample.pitch;
+                changed = 1;
+            }
+        }
+        if (changed && nowMilliseconds() - lastFrame >= FRAME_INTERVAL_MS) {
+            lastFrame = nowMilliseconds();
+            renderSoft(lpFrame, roll, pitch);
+            outputFrame(lpFrame);
+            changed = 0;
+        }
+        nanosleep(&pollInterval, NULL);
+    }
+}
+
+static void usage(const char* lpProgram) {
+    fprintf(stderr, "usage: %s [--threads N] [--size N] [--roll DEG] [--pitch DEG] [--telemetry SRC]\n"
+                    "       [--output /dev/fbN|FILE.ppm] [--bench FRAMES]\n", lpProgram);
+    exit(2);
+}
+
+static void parseOptions(int argc, char** argv) {
+    int i;
+
+    for (i = 1; i < argc; i++) {
+        if (i + 1 >= argc)
+            usage(argv[0]);
+        if (strcmp(argv[i], "--threads") == 0)
+            threadCount = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--size") == 0)
+            size = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--roll") == 0)
+            roll = (float)atof(argv[++i]);
+        else if (strcmp(argv[i], "--pitch") == 0)
+            pitch = (float)atof(argv[++i]);
+        else if (strcmp(argv[i], "--telemetry") == 0)
+            lpTelemetrySource = argv[++i];
+        else if (strcmp(argv[i], "--output") == 0)
+            lpOutputPath = argv[++i];
+        else if (strcmp(argv[i], "--bench") == 0)
+            benchFrames = atoi(argv[++i]);
+        else
+            usage(argv[0]);
+    }
+    if (size < 1 || benchFrames < 0)
+        usage(argv[0]);
+}
+
+int main(int argc, char** argv) {
+    float arc[ARC_INDICES][2];
+    struct softTexture sphereTexture, ringTexture;
+    struct softFramebuffer frame;
+    unsigned long sphereWidth;
+    int i, status;
+
+    parseOptions(argc, argv);
+    if (threadCount < 1)
+        threadCount = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (threadCount < 1)
+        threadCount = 1;
+
+    frame.width = frame.height = size;
+    if (lpOutputPath != NULL && strncmp(lpOutputPath, "/dev/fb", 7) == 0) {
+        if (!openFramebuffer(lpOutputPath))
+            return 1;
+        frame.width = (int)fbVar.xres;
+        frame.height = (int)fbVar.yres;
+    }
+    if ((frame.lpPixels = (uint32_t*)malloc(sizeof(uint32_t) * frame.width * frame.height)) == NULL) {
+        fprintf(stderr, "%s:%u: Allocation of lpPixels failed\n", __FILE__, __LINE__);
+        return 1;
+    }
+
+    // The same texture resolutions as startTextureDecode() picks for a window of this size.
+    size = frame.width < frame.height ? frame.width : frame.height;
+    sphereWidth = (unsigned long)ceil(M_PI * 0.9 * size);
+    if (!loadSoftTexture("sphere.jpg", sphereWidth, sphereWidth / 2, &sphereTexture) ||
+            !loadSoftTexture("ring.jpg", size, size, &ringTexture))
+        return 1;
+
+    for (i = 0; i < ARC_INDICES; i++) {
+        double rad = (i / (double)(ARC_INDICES - 1)) * M_PI;
+        arc[i][0] = cos(rad) * -0.25f;
+        arc[i][1] = sin(rad) * -0.25f;
+    }
+    if (!buildMarks(arc, ARC_INDICES) || !initSoftRenderer(threadCount, &sphereTexture, &ringTexture))
+        return 1;
+
+    if (benchFrames > 0)
+        status = runSoftBenchmark(&frame);
+    else if (lpTelemetrySource != NULL)
+        status = followTelemetry(&frame);
+    else {
+        renderSoft(&frame, roll, pitch);
+        outputFrame(&frame);
+        status = 0;
+    }
+
+    stopSoftRenderer();
+    if (lpFbMemory != NULL)
+        munmap(lpFbMemory, fbMemorySize);
+    if (fbFd >= 0)
+        close(fbFd);
+    free(frame.lpPixels);
+    free(sphereTexture.lpTexels);
+    free(ringTexture.lpTexels);
+    return status;
+}
@@ -0,0 +1,34 @@
+
+/* Globals and entry points of the attitude indicator in glut-starter.c that the
+ * other modules (headless rendering, benchmarking, ...) need to reach.
+ */
+
+#ifndef INDICATOR_H
+#define INDICATOR_H
+
+#include <GL/gl.h>
+
+struct attitudeSample;
+
+extern int width, height;   // Size of the drawing area, set in reshape().
+extern int frameNumber;
+extern float roll;          // degrees, from the arrow keys or from telemetry
+extern float pitch;
+extern float yaw;
+extern int brightness;
+extern int headless;        // 1 when rendering into an offscreen framebuffer without GLUT.
+extern int coreProfile;     // 1 for the OpenGL 3.3 core profile shader path (--core).
+extern int impostor;        // 1 to draw the ball as a ray-cast impostor (--impostor).
+extern int wallCount;       // number of indicators in wall mode, 0 for the single indicator
+extern int fleetTelemetry;  // 1 to fill wall indicators 1 and up from vehicle telemetry
+
+extern GLuint texture[2];
+
+void initGL();
+void display();
+void reshape(int w, int h);
+int changeAttitude(float newRoll, float newPitch);
+int takeTelemetrySample(const struct attitudeSample* lpSample);
+int changeBrightness(int level);
+
+#endif
@@ -0,0 +1,82 @@
+/* Mesh levels of detail, see lod.h. */
+
+#include <GL/gl.h>
+#include <stdio.h>
+#include <math.h>
+#include "marks.h"
+#include "lod.h"
+
+#define RING_INNER_RADIUS 0.8f
+#define RING_OUTER_RADIUS 1.0f
+
+struct lodLevel {
+    int sphereSlices;       // and as many stacks
+    int ringSlices;
+    int ringLoops;          // the ring is flat and lit evenly, so few loops do
+};
+
+static const struct lodLevel levels[LOD_LEVELS] = {
+    {  12,  24,  1 },
+    {  24,  48,  4 },
+    {  36,  72, 10 },
+    {  64, 128, 10 },
+    { 128, 256, 10 },
+};
+
+static struct mesh spheres[LOD_LEVELS];
+static struct mesh rings[LOD_LEVELS];
+
+/* Builds every level.  Returns 0 on failure. */
+int buildLodMeshes() {
+    int k;
+
+    for (k = 0; k < LOD_LEVELS; k++) {
+        if (!buildSphereMesh(&spheres[k], BALL_RADIUS, levels[k].sphereSlices, levels[k].sphereSlices) ||
+                !buildDiskMesh(&rings[k], RING_INNER_RADIUS, RING_OUTER_RADIUS, levels[k].ringSlices,
+                               levels[k].ringLoops)) {
+            fprintf(stderr, "%s:%u: Failed to build level %d of the indicator meshes\n", __FILE__, __LINE__, k);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* Largest distance in pixels between a circle of radius pixels and the polygon
+ * of sides sides inscribed in it.
+ */
+static float outlineError(float radius, int sides) {
+    return radius * (1.0f - cosf((float)M_PI / sides));
+}
+
+/* Returns the cheapest level for an indicator drawn in a square of pixels
+ * pixels, where the ring's outer edge touches the sides.
+ */
+int selectLod(float pixels) {
+    float ringRadius = RING_OUTER_RADIUS * pixels / 2;
+    float ballRadius = BALL_RADIUS * pixels / 2;
+    int k;
+
+    for (k = 0; k < LOD_LEVELS - 1; k++) {
+        if (outlineError(ballRadius, levels[k].sphereSlices) <= LOD_PIXEL_ERROR &&
+                outlineError(ringRadius, levels[k].ringSlices) <= LOD_PIXEL_ERROR)
+            break;
+    }
+    return k;
+}
+
+const struct mesh* lodSphere(int level) {
+    return &spheres[level];
+}
+
+const struct mesh* lodRing(int level) {
+    return &rings[level];
+}
+
+void deleteLodMeshes() {
+    int k;
+
+    for (k = 0; k < LOD_LEVELS; k++) {
+        deleteMesh(&spheres[k]);
+        deleteMesh(&rings[k]);
+    }
+}
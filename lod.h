@@ -0,0 +1,37 @@
+/* Levels of detail for the ball and ring meshes.  buildLodMeshes() builds
+ * LOD_LEVELS versions of both once, from a 12-slice ball for thumbnails up to a
+ * 128-slice ball for 4K panels.  selectLod() picks the cheapest level whose
+ * outline stays within LOD_PIXEL_ERROR pixels of the true circle at the size the
+ * indicator is drawn.  A circle of radius r drawn as a polygon of n sides is off
+ * by at most r (1 - cos(pi / n)) pixels.
+ *
+ * reshape() selects the level of the single indicator from the window size.  The
+ * wall selects one for its cell size (see wall.h), so a wall of thumbnails draws
+ * the coarse meshes.  The textures follow the same sizes through their mip
+ * range, see setTextureDetail() in texture.h.
+ *
+ *    level   ball slices x stacks   ring slices x loops   used up to about
+ *      0          12 x 12               24 x 1                 30 pixels
+ *      1          24 x 24               48 x 4                130 pixels
+ *      2          36 x 36               72 x 10               290 pixels
+ *      3          64 x 64              128 x 10               920 pixels
+ *      4         128 x 128             256 x 10               and above
+ *
+ * Level 2 is the tessellation used before there were levels.
+ */
+
+#ifndef LOD_H
+#define LOD_H
+
+#include "mesh.h"
+
+#define LOD_LEVELS 5
+#define LOD_PIXEL_ERROR 0.5f
+
+int buildLodMeshes();
+int selectLod(float pixels);
+const struct mesh* lodSphere(int level);
+const struct mesh* lodRing(int level);
+void deleteLodMeshes();
+
+#endif
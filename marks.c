@@ -0,0 +1,142 @@
+
+/* Overlay geometry, see marks.h. */
+
+#include <stdio.h>
+#include "marks.h"
+
+float markVertices[MARKS_MAX_VERTICES][2];
+int markVertexCount;
+struct markInstance markInstances[MARKS_MAX_INSTANCES];
+int markInstanceCount;
+struct markRange markRanges[TEMPLATE_COUNT];
+int symbolFirst, symbolCount;
+
+static void addVertex(float x, float y) {
+    if (markVertexCount < MARKS_MAX_VERTICES) {
+        markVertices[markVertexCount][0] = x;
+        markVertices[markVertexCount][1] = y;
+    }
+    markVertexCount++;
+}
+
+static void addLine(float x0, float y0, float x1, float y1) {
+    addVertex(x0, y0);
+    addVertex(x1, y1);
+}
+
+/* Adds a line strip as separate GL_LINES segments. */
+static void addStrip(const float (*lpPoints)[2], int count) {
+    int i;
+    for (i = 0; i + 1 < count; i++)
+        addLine(lpPoints[i][0], lpPoints[i][1], lpPoints[i + 1][0], lpPoints[i + 1][1]);
+}
+
+static void addInstance(float angle, float pitch, float yScale, int mode) {
+    if (markInstanceCount < MARKS_MAX_INSTANCES) {
+        markInstances[markInstanceCount].angle = angle;
+        markInstances[markInstanceCount].pitch = pitch;
+        markInstances[markInstanceCount].yScale = yScale;
+        markInstances[markInstanceCount].mode = mode;
+    }
+    markInstanceCount++;
+}
+
+static void beginTemplate(enum markTemplate t) {
+    markRanges[t].first = markVertexCount;
+    markRanges[t].baseInstance = markInstanceCount;
+}
+
+static void endTemplate(enum markTemplate t) {
+    markRanges[t].count = markVertexCount - markRanges[t].first;
+    markRanges[t].instanceCount = markInstanceCount - markRanges[t].baseInstance;
+}
+
+/* Fills the template and instance arrays.  Each template is added together with
+ * its instances, so every template owns a contiguous range of both.  lpArc holds
+ * the points of the arc under the reference bar.  Returns 0 if the geometry does
+ * not fit the arrays.
+ */
+int buildMarks(const float (*lpArc)[2], int arcCount) {
+    static const float bar[][2] = {
+        { -0.8f, 0.0f }, { -0.15f, 0.0f }, { -0.1f, 0.1f }, { 0.1f, 0.1f }, { 0.15f, 0.0f }, { 0.8f, 0.0f },
+    };
+    static const float pointer[][2] = {
+        { 0.0f, 0.1f }, { 0.0f, 0.8f }, { 0.3f, 0.2f }, { 0.0f, 0.2f },
+    };
+    static const float rollScale[] = { 0.0f, 10.0f, 20.0f, 30.0f, 45.0f, 60.0f };
+    int i;
+
+    markVertexCount = 0;
+    markInstanceCount = 0;
+
+    // Aircraft symbol; its instance must be number 0, which non-instanced draws use.
+    symbolFirst = markVertexCount;
+    addStrip(bar, sizeof(bar) / sizeof(bar[0]));
+    addStrip(lpArc, arcCount);
+    addStrip(pointer, sizeof(pointer) / sizeof(pointer[0]));
+    symbolCount = markVertexCount - symbolFirst;
+    addInstance(0.0f, 0.0f, 1.0f, MODE_STATIC);
+
+    // Pitch ladder, except the horizon lines the ball texture already shows.  The
+    // end ticks of the 10 degree rungs point towards the horizon.
+    beginTemplate(TEMPLATE_RUNG_10);
+    addLine(-0.30f, 0.0f, -0.10f, 0.0f);
+    addLine(0.10f, 0.0f, 0.30f, 0.0f);
+    addLine(-0.30f, 0.0f, -0.30f, -0.03f);
+    addLine(0.30f, 0.0f, 0.30f, -0.03f);
+    for (i = 1; i < 36; i++) {
+        if (i != 18)
+            addInstance(0.0f, i * 10.0f, i < 18 ? 1.0f : -1.0f, MODE_PITCH);
+    }
+    endTemplate(TEMPLATE_RUNG_10);
+
+    beginTemplate(TEMPLATE_RUNG_5);
+    addLine(-0.14f, 0.0f, 0.14f, 0.0f);
+    for (i = 0; i < 36; i++)
+        addInstance(0.0f, i * 10.0f + 5.0f, 1.0f, MODE_PITCH);
+    endTemplate(TEMPLATE_RUNG_5);
+
+    beginTemplate(TEMPLATE_RUNG_2_5);
+    addLine(-0.07f, 0.0f, 0.07f, 0.0f);
+    for (i = 0; i < 72; i++)
+        addInstance(0.0f, i * 5.0f + 2.5f, 1.0f, MODE_PITCH);
+    endTemplate(TEMPLATE_RUNG_2_5);
+
+    // Roll scale, fixed to the window: long marks at 0, 30 and 60 degrees.
+    beginTemplate(TEMPLATE_TICK_LONG);
+    addLine(0.0f, 0.70f, 0.0f, 0.79f);
+    for (i = 0; i < (int)(sizeof(rollScale) / sizeof(rollScale[0])); i++) {
+        if (rollScale[i] == 0.0f)
+            addInstance(0.0f, 0.0f, 1.0f, MODE_FIXED);
+        else if (rollScale[i] == 30.0f || rollScale[i] == 60.0f) {
+            addInstance(rollScale[i], 0.0f, 1.0f, MODE_FIXED);
+            addInstance(-rollScale[i], 0.0f, 1.0f, MODE_FIXED);
+        }
+    }
+    endTemplate(TEMPLATE_TICK_LONG);
+
+    beginTemplate(TEMPLATE_TICK_SHORT);
+    addLine(0.0f, 0.74f, 0.0f, 0.79f);
+    for (i = 0; i < (int)(sizeof(rollScale) / sizeof(rollScale[0])); i++) {
+        if (rollScale[i] == 10.0f || rollScale[i] == 20.0f || rollScale[i] == 45.0f) {
+            addInstance(rollScale[i], 0.0f, 1.0f, MODE_FIXED);
+            addInstance(-rollScale[i], 0.0f, 1.0f, MODE_FIXED);
+        }
+    }
+    endTemplate(TEMPLATE_TICK_SHORT);
+
+    // Bank pointer, pointing at the roll scale and turning with the roll ring.
+    beginTemplate(TEMPLATE_BANK_POINTER);
+    addLine(0.0f, 0.69f, -0.035f, 0.63f);
+    addLine(-0.035f, 0.63f, 0.035f, 0.63f);
+    addLine(0.035f, 0.63f, 0.0f, 0.69f);
+    addInstance(0.0f, 0.0f, 1.0f, MODE_ROLL);
+    endTemplate(TEMPLATE_BANK_POINTER);
+
+    if (markVertexCount > MARKS_MAX_VERTICES || markInstanceCount > MARKS_MAX_INSTANCES) {
+        fprintf(stderr, "%s:%u: Overlay geometry does not fit its arrays\n", __FILE__, __LINE__);
+        return 0;
+    }
+    return 1;
+}
+
@@ -0,0 +1,67 @@
+
+/* Geometry of the instrument overlay (see overlay.h), without any GL, so that
+ * overlay.c and the software renderer (soft.h) draw the very same marks.
+ *
+ * Every kind of mark is a template of line segments (vertex pairs) in
+ * markVertices, drawn once per instance record in markInstances.  An instance
+ * says how the template is placed from the current roll and pitch:
+ *
+ *    MODE_STATIC   template coordinates are screen coordinates
+ *    MODE_FIXED    rotated by the instance angle (roll scale)
+ *    MODE_ROLL     rotated by the instance angle plus roll (bank pointer)
+ *    MODE_PITCH    moved to the instance pitch on the ball, rotated by roll (ladder)
+ *
+ * The aircraft symbol is markVertices[symbolFirst .. symbolFirst + symbolCount)
+ * with instance 0.  markRanges[t] gives the vertex and instance range of template
+ * t, laid out like a DrawArraysIndirectCommand.
+ */
+
+#ifndef MARKS_H
+#define MARKS_H
+
+#define BALL_RADIUS 0.9f
+#define LADDER_RANGE 30.0f          // rungs further than this from the current pitch are hidden
+#define SYMBOL_LINE_WIDTH 4.0f      // pixels at 720 x 720
+#define MARK_LINE_WIDTH 2.0f
+#define MARKS_MAX_VERTICES 256
+#define MARKS_MAX_INSTANCES 256
+
+#define MODE_STATIC 0
+#define MODE_FIXED 1
+#define MODE_ROLL 2
+#define MODE_PITCH 3
+
+enum markTemplate {
+    TEMPLATE_RUNG_10,
+    TEMPLATE_RUNG_5,
+    TEMPLATE_RUNG_2_5,
+    TEMPLATE_TICK_LONG,
+    TEMPLATE_TICK_SHORT,
+    TEMPLATE_BANK_POINTER,
+    TEMPLATE_COUNT
+};
+
+struct markInstance {
+    float angle;            // degrees, counterclockwise
+    float pitch;            // ladder rung value in degrees, 0..360 like the pitch global
+    float yScale;           // 1, or -1 to mirror the template vertically
+    float mode;             // one of the MODE_ constants
+};
+
+struct markRange {
+    unsigned int count;             // vertices
+    unsigned int instanceCount;
+    unsigned int first;             // vertex
+    unsigned int baseInstance;
+};
+
+extern float markVertices[MARKS_MAX_VERTICES][2];
+extern int markVertexCount;
+extern struct markInstance markInstances[MARKS_MAX_INSTANCES];
+extern int markInstanceCount;
+extern struct markRange markRanges[TEMPLATE_COUNT];
+extern int symbolFirst, symbolCount;
+
+int buildMarks(const float (*lpArc)[2], int arcCount);
+
+#endif
@@ -0,0 +1,222 @@
+
+/* Retained sphere and disk meshes, see mesh.h.
+ *
+ * The vertex grids below follow the GLU quadric code (quad.c) step by step:
+ * gluSphere() walks stacks from the +z pole (t = 1) to the -z pole (t = 0) and
+ * slices with x = sin(theta), y = cos(theta), s = 1 - i/slices; gluDisk() walks
+ * loops from the outer to the inner radius.  Every GL_QUAD_STRIP that GLU would
+ * issue is turned into two triangles with the same orientation, so two-sided
+ * lighting picks the same face as before.
+ */
+
+#define GL_GLEXT_PROTOTYPES
+
+#include <GL/gl.h>
+#include <GL/glext.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <math.h>
+#include "indicator.h"
+#include "glstate.h"
+#include "mesh.h"
+
+/* Adds the two triangles of one quad strip step.  hi0/lo0 are the strip vertices
+ * emitted for column i, hi1/lo1 those for column i+1, in GLU emission order.  The
+ * quad (hi0, lo0, lo1, hi1) is split as a fan from hi0, the same diagonal the GL
+ * uses for GL_QUAD_STRIP, so texture coordinates interpolate identically.
+ */
+static GLushort* addQuad(GLushort* lpIndex, GLushort hi0, GLushort lo0, GLushort hi1, GLushort lo1) {
+    *lpIndex++ = hi0;
+    *lpIndex++ = lo0;
+    *lpIndex++ = lo1;
+    *lpIndex++ = hi0;
+    *lpIndex++ = lo1;
+    *lpIndex++ = hi1;
+    return lpIndex;
+}
+
+/* Creates the buffers and vertex array object for the given vertex and index data.
+ * The data is copied into GL buffers, so the caller keeps ownership of both arrays.
+ */
+static int uploadMesh(struct mesh* lpMesh, const struct meshVertex* lpVertices, GLsizei vertexCount,
+                      const GLushort* lpIndices, GLsizei indexCount) {
+    lpMesh->vertexCount = vertexCount;
+    lpMesh->indexCount = indexCount;
+
+    glGenVertexArrays(1, &lpMesh->vao);
+    glBindVertexArray(lpMesh->vao);
+
+    glGenBuffers(1, &lpMesh->vbo);
+    glBindBuffer(GL_ARRAY_BUFFER, lpMesh->vbo);
+    glBufferData(GL_ARRAY_BUFFER, vertexCount * sizeof(struct meshVertex), lpVertices, GL_STATIC_DRAW);
+
+    glGenBuffers(1, &lpMesh->ibo);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, lpMesh->ibo);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexCount * sizeof(GLushort), lpIndices, GL_STATIC_DRAW);
+
+    // Generic attributes 0, 1 and 2 for shader programs.
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(struct meshVertex), (void*)offsetof(struct meshVertex, position));
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(struct meshVertex), (void*)offsetof(struct meshVertex, normal));
+    glEnableVertexAttribArray(2);
+    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(struct meshVertex), (void*)offsetof(struct meshVertex, texCoord));
+
+    // Fixed-function attribute layout; the VAO records the client state.
+    if (!coreProfile) {
+        glEnableClientState(GL_VERTEX_ARRAY);
+        glVertexPointer(3, GL_FLOAT, sizeof(struct meshVertex), (void*)offsetof(struct meshVertex, position));
+        glEnableClientState(GL_NORMAL_ARRAY);
+        glNormalPointer(GL_FLOAT, sizeof(struct meshVertex), (void*)offsetof(struct meshVertex, normal));
+        glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+        glTexCoordPointer(2, GL_FLOAT, sizeof(struct meshVertex), (void*)offsetof(struct meshVertex, texCoord));
+    }
+
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    return 1;
+}
+
+/* Builds the equivalent of gluSphere(radius, slices, stacks) with smooth normals
+ * and texture coordinates.  Returns 0 if the mesh does not fit 16-bit indices or
+ * memory runs out.
+ */
+int buildSphereMesh(struct mesh* lpMesh, GLfloat radius, int slices, int stacks) {
+    struct meshVertex* lpVertices;
+    GLushort *lpIndices, *lpIndex;
+    GLsizei vertexCount = (slices + 1) * (stacks + 1);
+    GLsizei indexCount = slices * stacks * 6;
+    int i, j, result;
+
+    if (vertexCount > 65536) {
+        fprintf(stderr, "%s:%u: Sphere with %d x %d slices is too large\n", __FILE__, __LINE__, slices, stacks);
+        return 0;
+    }
+    lpVertices = (struct meshVertex*)malloc(sizeof(struct meshVertex) * vertexCount);
+    lpIndices = (GLushort*)malloc(sizeof(GLushort) * indexCount);
+    if (lpVertices == NULL || lpIndices == NULL) {
+        fprintf(stderr, "%s:%u: Allocation of sphere mesh failed\n", __FILE__, __LINE__);
+        free(lpVertices);
+        free(lpIndices);
+        return 0;
+    }
+
+    // Vertex (i, j) lives at j * (slices + 1) + i; row j = 0 is the +z pole.
+    for (j = 0; j <= stacks; j++) {
+        double rho = M_PI * j / stacks;
+        GLfloat sinRho = (j == 0 || j == stacks) ? 0.0f : (GLfloat)sin(rho);
+        GLfloat normalSinRho = (GLfloat)sin(rho);
+        GLfloat cosRho = (GLfloat)cos(rho);
+        for (i = 0; i <= slices; i++) {
+            double theta = 2 * M_PI * (i == slices ? 0 : i) / slices;
+            GLfloat sinTheta = (GLfloat)sin(theta);
+            GLfloat cosTheta = (GLfloat)cos(theta);
+            struct meshVertex* v = &lpVertices[j * (slices + 1) + i];
+            v->position[0] = radius * sinRho * sinTheta;
+            v->position[1] = radius * sinRho * cosTheta;
+            v->position[2] = radius * cosRho;
+            v->normal[0] = sinTheta * normalSinRho;
+            v->normal[1] = cosTheta * normalSinRho;
+            v->normal[2] = cosRho;
+            v->texCoord[0] = 1 - (GLfloat)i / slices;
+            v->texCoord[1] = 1 - (GLfloat)j / stacks;
+        }
+    }
+
+    // GLU strips emit row j+1 before row j for every column.
+    lpIndex = lpIndices;
+    for (j = 0; j < stacks; j++) {
+        for (i = 0; i < slices; i++) {
+            GLushort lo0 = j * (slices + 1) + i;
+            GLushort hi0 = (j + 1) * (slices + 1) + i;
+            lpIndex = addQuad(lpIndex, hi0, lo0, hi0 + 1, lo0 + 1);
+        }
+    }
+
+    result = uploadMesh(lpMesh, lpVertices, vertexCount, lpIndices, indexCount);
+    free(lpVertices);
+    free(lpIndices);
+    return result;
+}
+
+/* Builds the equivalent of gluDisk(innerRadius, outerRadius, slices, loops) with
+ * a +z normal and texture coordinates.  innerRadius must be larger than zero; the
+ * centre fan GLU uses for a full disk is not needed by the indicator.
+ */
+int buildDiskMesh(struct mesh* lpMesh, GLfloat innerRadius, GLfloat outerRadius, int slices, int loops) {
+    struct meshVertex* lpVertices;
+    GLushort *lpIndices, *lpIndex;
+    GLsizei vertexCount = (slices + 1) * (loops + 1);
+    GLsizei indexCount = slices * loops * 6;
+    GLfloat deltaRadius = outerRadius - innerRadius;
+    int i, j, result;
+
+    if (vertexCount > 65536) {
+        fprintf(stderr, "%s:%u: Disk with %d x %d slices is too large\n", __FILE__, __LINE__, slices, loops);
+        return 0;
+    }
+    lpVertices = (struct meshVertex*)malloc(sizeof(struct meshVertex) * vertexCount);
+    lpIndices = (GLushort*)malloc(sizeof(GLushort) * indexCount);
+    if (lpVertices == NULL || lpIndices == NULL) {
+        fprintf(stderr, "%s:%u: Allocation of disk mesh failed\n", __FILE__, __LINE__);
+        free(lpVertices);
+        free(lpIndices);
+        return 0;
+    }
+
+    // Vertex (i, j) lives at j * (slices + 1) + i; row j = 0 is the outer edge.
+    for (j = 0; j <= loops; j++) {
+        GLfloat r = outerRadius - deltaRadius * ((GLfloat)j / loops);
+        GLfloat tex = r / outerRadius / 2;
+        for (i = 0; i <= slices; i++) {
+            double angle = 2 * M_PI * (i == slices ? 0 : i) / slices;
+            GLfloat sinAngle = (GLfloat)sin(angle);
+            GLfloat cosAngle = (GLfloat)cos(angle);
+            struct meshVertex* v = &lpVertices[j * (slices + 1) + i];
+            v->position[0] = r * sinAngle;
+            v->position[1] = r * cosAngle;
+            v->position[2] = 0.0f;
+            v->normal[0] = 0.0f;
+            v->normal[1] = 0.0f;
+            v->normal[2] = 1.0f;
+            v->texCoord[0] = tex * sinAngle + 0.5f;
+            v->texCoord[1] = tex * cosAngle + 0.5f;
+        }
+    }
+
+    // GLU strips emit the outer row j before the inner row j+1 for every column.
+    lpIndex = lpIndices;
+    for (j = 0; j < loops; j++) {
+        for (i = 0; i < slices; i++) {
+            GLushort outer0 = j * (slices + 1) + i;
+            GLushort inner0 = (j + 1) * (slices + 1) + i;
+            lpIndex = addQuad(lpIndex, outer0, inner0, outer0 + 1, inner0 + 1);
+        }
+    }
+
+    result = uploadMesh(lpMesh, lpVertices, vertexCount, lpIndices, indexCount);
+    free(lpVertices);
+    free(lpIndices);
+    return result;
+}
+
+void drawMesh(const struct mesh* lpMesh) {
+    bindVertexArray(lpMesh->vao);
+    glDrawElements(GL_TRIANGLES, lpMesh->indexCount, GL_UNSIGNED_SHORT, (void*)0);
+}
+
+/* Draws instanceCount copies in one call; the shader tells them apart with gl_InstanceID. */
+void drawMeshInstanced(const struct mesh* lpMesh, int instanceCount) {
+    bindVertexArray(lpMesh->vao);
+    glDrawElementsInstanced(GL_TRIANGLES, lpMesh->indexCount, GL_UNSIGNED_SHORT, (void*)0, instanceCount);
+}
+
+void deleteMesh(struct mesh* lpMesh) {
+    glDeleteVertexArrays(1, &lpMesh->vao);
+    glDeleteBuffers(1, &lpMesh->vbo);
+    glDeleteBuffers(1, &lpMesh->ibo);
+    lpMesh->vao = lpMesh->vbo = lpMesh->ibo = 0;
+    lpMesh->vertexCount = lpMesh->indexCount = 0;
+}
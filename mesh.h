@@ -0,0 +1,40 @@
+
+/* Retained, indexed triangle meshes for the attitude indicator.  The meshes are
+ * built once (normally from initGL()) into a vertex buffer with interleaved
+ * position/normal/texture coordinates and an index buffer, wrapped in a vertex
+ * array object, and are then drawn with a single glDrawElements() call.  The
+ * vertex array feeds both the fixed-function arrays (except with --core) and the
+ * generic attributes 0 (position), 1 (normal) and 2 (texture coordinates).
+ *
+ * The geometry generators reproduce the vertices, smooth normals and texture
+ * coordinates that gluSphere() and gluDisk() emit for GLU_FILL, GLU_SMOOTH,
+ * GLU_OUTSIDE and gluQuadricTexture(GL_TRUE), including their winding, so the
+ * result is lit and textured exactly like the GLU quadrics it replaces.
+ */
+
+#ifndef MESH_H
+#define MESH_H
+
+#include <GL/gl.h>
+
+struct meshVertex {
+    GLfloat position[3];
+    GLfloat normal[3];
+    GLfloat texCoord[2];
+};
+
+struct mesh {
+    GLuint vao;             // vertex array object holding the attribute layout
+    GLuint vbo;             // interleaved struct meshVertex data
+    GLuint ibo;             // GL_UNSIGNED_SHORT triangle indices
+    GLsizei vertexCount;
+    GLsizei indexCount;
+};
+
+int buildSphereMesh(struct mesh* lpMesh, GLfloat radius, int slices, int stacks);
+int buildDiskMesh(struct mesh* lpMesh, GLfloat innerRadius, GLfloat outerRadius, int slices, int loops);
+void drawMesh(const struct mesh* lpMesh);
+void drawMeshInstanced(const struct mesh* lpMesh, int instanceCount);
+void deleteMesh(struct mesh* lpMesh);
+
+#endif
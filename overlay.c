@@ -0,0 +1,359 @@
+
+/* Instrument overlay, see overlay.h. */
+
+#define GL_GLEXT_PROTOTYPES
+
+#include <GL/gl.h>
+#include <GL/glext.h>
+#include <stdio.h>
+#include <string.h>
+#include "shader.h"
+#include "marks.h"
+#include "glstate.h"
+#include "overlay.h"
+
+#define OVERLAY_DEPTH -0.9f        // in front of the ring (-0.7) and the ball
+#define INDICATOR_UNIT 1            // texture unit of the wall's indicator buffer texture
+
+static const char* lpVertexSource =
+    "#version 330 core\n"
+    "layout(location = 0) in vec2 position;\n"
+    "layout(location = 1) in vec4 instance;   // angle, pitch, yScale, mode\n"
+    "#ifdef WALL\n"
+    "uniform samplerBuffer indicators;   // roll, pitch, cell center x, y in every 4th texel\n"
+    "uniform int indicatorCount;\n"
+    "uniform vec2 cellScale;\n"
+    "float roll, pitch;\n"
+    "#else\n"
+    "uniform float roll;\n"
+    "uniform float pitch;\n"
+    "#endif\n"
+    "uniform float depth;\n"
+    "uniform float ballRadius;\n"
+    "uniform float ladderRange;\n"
+    "vec2 rotate(vec2 p, float degrees) {\n"
+    "    float c = cos(radians(degrees)), s = sin(radians(degrees));\n"
+    "    return vec2(c * p.x - s * p.y, s * p.x + c * p.y);\n"
+    "}\n"
+    "void main() {\n"
+    "#ifdef WALL\n"
+    "    // The instance attribute advances every indicatorCount instances, so\n"
+    "    // consecutive instances draw the same mark on every indicator.\n"
+    "    vec4 indicator = texelFetch(indicators, gl_InstanceID % indicatorCount * 4);\n"
+    "    if (texelFetch(indicators, gl_InstanceID % indicatorCount * 4 + 3).w != 0.0) {\n"
+    "        gl_Position = vec4(0.0, 0.0, 2.0, 1.0);   // stale indicator: clipped\n"
+    "        return;\n"
+    "    }\n"
+    "    roll = indicator.x;\n"
+    "    pitch = indicator.y;\n"
+    "#endif\n"
+    "    vec2 p = vec2(position.x, position.y * instance.z);\n"
+    "    int mode = int(instance.w);\n"
+    "    if (mode == 1) {\n"
+    "        p = rotate(p, instance.x);\n"
+    "    }\n"
+    "    else if (mode == 2) {\n"
+    "        p = rotate(p, instance.x + roll);\n"
+    "    }\n"
+    "    else if (mode == 3) {\n"
+    "        float delta = mod(instance.y - pitch + 180.0, 360.0) - 180.0;\n"
+    "        if (abs(delta) > ladderRange) {\n"
+    "            gl_Position = vec4(0.0, 0.0, 2.0, 1.0);   // behind the far plane: clipped\n"
+    "            return;\n"
+    "        }\n"
+    "        // On the ball, lines of constant pitch are ellipses through the poles at\n"
+    "        // x = +-ballRadius; put every template vertex on the one for delta.\n"
+    "        p.y += sin(radians(delta)) * sqrt(max(ballRadius * ballRadius - p.x * p.x, 0.0));\n"
+    "        p = rotate(p, roll);\n"
+    "    }\n"
+    "#ifdef WALL\n"
+    "    p = indicator.zw + p * cellScale;\n"
+    "#endif\n"
+    "    gl_Position = vec4(p, depth, 1.0);\n"
+    "}\n";
+
+// Turns every line into a rectangle around its stroke, in window coordinates.
+static const char* lpGeometrySource =
+    "#version 330 core\n"
+    "layout(lines) in;\n"
+    "layout(triangle_strip, max_vertices = 4) out;\n"
+    "uniform vec2 viewport;     // pixels\n"
+    "uniform float halfWidth;   // pixels\n"
+    "flat out vec2 segmentStart;\n"
+    "flat out vec2 segmentEnd;\n"
+    "void main() {\n"
+    "    vec4 a = gl_in[0].gl_Position, b = gl_in[1].gl_Position;\n"
+    "    if (a.z > 1.0 || b.z > 1.0)\n"
+    "        return;            // a hidden ladder rung\n"
+    "    vec2 p0 = (a.xy * 0.5 + 0.5) * viewport, p1 = (b.xy * 0.5 + 0.5) * viewport;\n"
+    "    vec2 d = p1 != p0 ? normalize(p1 - p0) : vec2(1.0, 0.0);\n"
+    "    vec2 n = vec2(-d.y, d.x);\n"
+    "    float r = halfWidth + 1.0;     // and the pixel over which the edge fades\n"
+    "    vec2 corners[4] = vec2[4](p0 - r * (d + n), p0 - r * (d - n), p1 + r * (d - n), p1 + r * (d + n));\n"
+    "    for (int i = 0; i < 4; i++) {\n"
+    "        segmentStart = p0;\n"
+    "        segmentEnd = p1;\n"
+    "        gl_Position = vec4(corners[i] / viewport * 2.0 - 1.0, a.z, 1.0);\n"
+    "        EmitVertex();\n"
+    "    }\n"
+    "}\n";
+
+static const char* lpFragmentSource =
+    "#version 330 core\n"
+    "uniform vec4 color;\n"
+    "out vec4 fragColor;\n"
+    "#ifdef SDF\n"
+    "uniform float halfWidth;\n"
+    "flat in vec2 segmentStart;\n"
+    "flat in vec2 segmentEnd;\n"
+    "void main() {\n"
+    "    // The stroke is a capsule: pixels within halfWidth of the segment.  Its\n"
+    "    // signed distance gives the coverage of the pixel at the edge.\n"
+    "    vec2 p = gl_FragCoord.xy - segmentStart, d = segmentEnd - segmentStart;\n"
+    "    float u = clamp(dot(p, d) / max(dot(d, d), 1e-6), 0.0, 1.0);\n"
+    "    float coverage = clamp(halfWidth + 0.5 - length(p - u * d), 0.0, 1.0);\n"
+    "    if (coverage == 0.0)\n"
+    "        discard;\n"
+    "    fragColor = vec4(color.rgb, color.a * coverage);\n"
+    "}\n"
+    "#else\n"
+    "void main() {\n"
+    "    fragColor = color;\n"
+    "}\n"
+    "#endif\n";
+
+static enum overlayStyle style;
+static GLuint program;
+static GLint rollLocation, pitchLocation, viewportLocation, halfWidthLocation;
+static int viewportWidth = 1, viewportHeight = 1;
+static GLuint vao, templateBuffer, instanceBuffer, commandBuffer;
+static int multiDrawIndirect;       // GL 4.3 / GL_ARB_multi_draw_indirect available
+
+// The wall variant shares the buffers; its VAO sets the instance divisor to the
+// number of indicators and its commands multiply the instance counts by it.
+static GLuint wallProgram;
+static GLint indicatorCountLocation, cellScaleLocation, wallViewportLocation, wallHalfWidthLocation;
+static GLuint wallVao, wallCommandBuffer;
+static struct markRange wallCommands[TEMPLATE_COUNT];
+static int wallDivisor;
+
+static int hasExtension(const char* lpName) {
+    GLint count, i;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+    for (i = 0; i < count; i++) {
+        if (strcmp((const char*)glGetStringi(GL_EXTENSIONS, i), lpName) == 0)
+            return 1;
+    }
+    return 0;
+}
+
+/* Sets the uniforms both programs share and leaves shaderProgram in use. */
+static void setCommonUniforms(GLuint shaderProgram) {
+    glUseProgram(shaderProgram);
+    glUniform1f(glGetUniformLocation(shaderProgram, "depth"), OVERLAY_DEPTH);
+    glUniform1f(glGetUniformLocation(shaderProgram, "ballRadius"), BALL_RADIUS);
+    glUniform1f(glGetUniformLocation(shaderProgram, "ladderRange"), LADDER_RANGE);
+    glUniform4f(glGetUniformLocation(shaderProgram, "color"), 1.0f, 1.0f, 1.0f, 1.0f);
+}
+
+/* Creates a vertex array over the template and instance buffers, with an
+ * instance divisor of 1.
+ */
+static GLuint buildVertexArray() {
+    GLuint array;
+
+    glGenVertexArrays(1, &array);
+    glBindVertexArray(array);
+    glBindBuffer(GL_ARRAY_BUFFER, templateBuffer);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(markVertices[0]), (void*)0);
+    glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(struct markInstance), (void*)0);
+    glVertexAttribDivisor(1, 1);
+    glBindVertexArray(0);
+    return array;
+}
+
+/* Builds the overlay program and buffers.  lpArc holds the precomputed points of
+ * the arc under the reference bar.  Returns 0 on failure.
+ */
+int buildOverlay(const GLfloat (*lpArc)[2], int arcCount, enum overlayStyle overlayStyle) {
+    const char* lpGeometry = overlayStyle == OVERLAY_SDF ? lpGeometrySource : NULL;
+    const char* lpDefines = overlayStyle == OVERLAY_SDF ? "#define SDF\n" : "";
+
+    if (!buildMarks(lpArc, arcCount))
+        return 0;
+
+    style = overlayStyle;
+    program = buildGeometryProgram(lpVertexSource, lpGeometry, lpFragmentSource, lpDefines, "overlay");
+    wallProgram = buildGeometryProgram(lpVertexSource, lpGeometry, lpFragmentSource,
+                                       overlayStyle == OVERLAY_SDF ? "#define SDF\n#define WALL\n" : "#define WALL\n",
+                                       "wall overlay");
+    if (program == 0 || wallProgram == 0)
+        return 0;
+    setCommonUniforms(program);
+    rollLocation = glGetUniformLocation(program, "roll");
+    pitchLocation = glGetUniformLocation(program, "pitch");
+    viewportLocation = glGetUniformLocation(program, "viewport");
+    halfWidthLocation = glGetUniformLocation(program, "halfWidth");
+    setCommonUniforms(wallProgram);
+    glUniform1i(glGetUniformLocation(wallProgram, "indicators"), INDICATOR_UNIT);
+    indicatorCountLocation = glGetUniformLocation(wallProgram, "indicatorCount");
+    cellScaleLocation = glGetUniformLocation(wallProgram, "cellScale");
+    wallViewportLocation = glGetUniformLocation(wallProgram, "viewport");
+    wallHalfWidthLocation = glGetUniformLocation(wallProgram, "halfWidth");
+    glUseProgram(0);
+
+    glGenBuffers(1, &templateBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, templateBuffer);
+    glBufferData(GL_ARRAY_BUFFER, markVertexCount * sizeof(markVertices[0]), markVertices, GL_STATIC_DRAW);
+    glGenBuffers(1, &instanceBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+    glBufferData(GL_ARRAY_BUFFER, markInstanceCount * sizeof(struct markInstance), markInstances, GL_STATIC_DRAW);
+
+    vao = buildVertexArray();
+    wallVao = buildVertexArray();
+    wallDivisor = 1;
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    multiDrawIndirect = hasExtension("GL_ARB_multi_draw_indirect");
+    if (multiDrawIndirect) {
+        glGenBuffers(1, &commandBuffer);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+        glBufferData(GL_DRAW_INDIRECT_BUFFER, sizeof(markRanges), markRanges, GL_STATIC_DRAW);
+        glGenBuffers(1, &wallCommandBuffer);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, wallCommandBuffer);
+        glBufferData(GL_DRAW_INDIRECT_BUFFER, sizeof(wallCommands), markRanges, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    }
+    return 1;
+}
+
+/* Draws all marks except the aircraft symbol, each instance repeated repeat times
+ * (the attribute divisor of the bound vertex array must be repeat).
+ */
+static void drawMarks(GLuint indirectBuffer, int repeat) {
+    int t;
+
+    if (multiDrawIndirect) {
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer);
+        glMultiDrawArraysIndirect(GL_LINES, (void*)0, TEMPLATE_COUNT, 0);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    }
+    else {
+        // Without base instances, point the instance attribute at each range instead.
+        glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+        for (t = 0; t < TEMPLATE_COUNT; t++) {
+            glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(struct markInstance),
+                                  (void*)(markRanges[t].baseInstance * sizeof(struct markInstance)));
+            glDrawArraysInstanced(GL_LINES, markRanges[t].first, markRanges[t].count, markRanges[t].instanceCount * repeat);
+        }
+        glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(struct markInstance), (void*)0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+}
+
+/* Tells the overlay the size of the viewport it draws into, in pixels. */
+void resizeOverlay(int width, int height) {
+    viewportWidth = width > 0 ? width : 1;
+    viewportHeight = height > 0 ? height : 1;
+}
+
+/* Sets the stroke width for the next draws: the line width, or the width the
+ * distance test of the SDF program uses.
+ */
+static void setStrokeWidth(GLint location, float pixels) {
+    if (pixels < 1.0f)
+        pixels = 1.0f;
+    if (style == OVERLAY_SDF)
+        glUniform1f(location, pixels * 0.5f);
+    else
+        setLineWidth(pixels);
+}
+
+/* The strokes are blended by their coverage and must not write depth, where
+ * their transparent fringes would hide the strokes they cross.
+ */
+static void beginStrokes(GLint location) {
+    if (style == OVERLAY_SDF) {
+        glUniform2f(location, (GLfloat)viewportWidth, (GLfloat)viewportHeight);
+        setCapability(GL_BLEND, 1);
+        setBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        setDepthMask(GL_FALSE);
+    }
+}
+
+static void endStrokes() {
+    if (style == OVERLAY_SDF) {
+        setDepthMask(GL_TRUE);
+        setCapability(GL_BLEND, 0);
+    }
+}
+
+void drawOverlay(float rollDegrees, float pitchDegrees) {
+    useProgram(program);
+    glUniform1f(rollLocation, rollDegrees);
+    glUniform1f(pitchLocation, pitchDegrees);
+    bindVertexArray(vao);
+    beginStrokes(viewportLocation);
+
+    setStrokeWidth(halfWidthLocation, SYMBOL_LINE_WIDTH);
+    glDrawArrays(GL_LINES, symbolFirst, symbolCount);
+
+    setStrokeWidth(halfWidthLocation, MARK_LINE_WIDTH);
+    drawMarks(commandBuffer, 1);
+
+    endStrokes();
+}
+
+/* Draws the overlay of count indicators (see drawSceneWall() in scene.h for the
+ * indicator buffer texture and cellScale) with the same two draw calls as a single
+ * overlay.  lineScale scales the line widths to the cell size.
+ */
+void drawOverlayWall(GLuint indicatorTexture, int count, float cellScaleX, float cellScaleY, float lineScale) {
+    int t;
+
+    useProgram(wallProgram);
+    glUniform1i(indicatorCountLocation, count);
+    glUniform2f(cellScaleLocation, cellScaleX, cellScaleY);
+    bindTexture(INDICATOR_UNIT, GL_TEXTURE_BUFFER, indicatorTexture);
+    bindVertexArray(wallVao);
+
+    if (count != wallDivisor) {
+        glVertexAttribDivisor(1, count);
+        wallDivisor = count;
+        if (multiDrawIndirect) {
+            for (t = 0; t < TEMPLATE_COUNT; t++) {
+                wallCommands[t] = markRanges[t];
+                wallCommands[t].instanceCount *= count;
+            }
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, wallCommandBuffer);
+            glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, sizeof(wallCommands), wallCommands);
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+        }
+    }
+
+    beginStrokes(wallViewportLocation);
+    setStrokeWidth(wallHalfWidthLocation, SYMBOL_LINE_WIDTH * lineScale);
+    glDrawArraysInstanced(GL_LINES, symbolFirst, symbolCount, count);
+
+    setStrokeWidth(wallHalfWidthLocation, MARK_LINE_WIDTH * lineScale);
+    drawMarks(wallCommandBuffer, count);
+
+    endStrokes();
+}
+
+void deleteOverlay() {
+    glDeleteProgram(program);
+    glDeleteProgram(wallProgram);
+    glDeleteVertexArrays(1, &vao);
+    glDeleteVertexArrays(1, &wallVao);
+    glDeleteBuffers(1, &templateBuffer);
+    glDeleteBuffers(1, &instanceBuffer);
+    if (multiDrawIndirect) {
+        glDeleteBuffers(1, &commandBuffer);
+        glDeleteBuffers(1, &wallCommandBuffer);
+    }
+    program = wallProgram = vao = wallVao = templateBuffer = instanceBuffer = commandBuffer = wallCommandBuffer = 0;
+}
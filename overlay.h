@@ -0,0 +1,40 @@
+
+/* The instrument overlay drawn in front of the ball and ring: the aircraft symbol
+ * (reference bar, arc and vertical pointer), a pitch ladder with rungs every 2.5,
+ * 5 and 10 degrees, a fixed roll scale and a bank pointer that turns with roll.
+ *
+ * All geometry is built once by buildOverlay() into static buffers: one line
+ * template per kind of mark, plus one instance record per mark that says where it
+ * goes (see marks.h).  A small vertex shader places every instance from the
+ * current roll and pitch, so drawOverlay() only sets two uniforms and issues two
+ * draw calls: the aircraft symbol and, with one multi-draw-indirect call, all
+ * repeated marks.
+ * drawOverlayWall() draws the overlays of a whole indicator wall with the same
+ * two calls.
+ *
+ * With OVERLAY_SDF (the default) the lines are not rasterized as wide lines,
+ * which core profiles deprecate and drivers draw unevenly, and which alias
+ * without multisampling.  A geometry shader turns each line into a rectangle
+ * around its stroke, and the fragment shader evaluates the signed distance to
+ * the segment: the stroke is a capsule whose edge pixels are blended by their
+ * coverage.  This gives anti-aliased strokes of any width in the same single
+ * pass, without a multisampled framebuffer; 4x MSAA at 720 x 720 would add
+ * about 16 MB of color and depth samples and shade four samples per edge pixel.
+ * OVERLAY_LINES (--overlay-lines) keeps the glLineWidth() path for comparison;
+ * "make bench-overlay" writes the per-phase GPU times of both.
+ */
+
+#ifndef OVERLAY_H
+#define OVERLAY_H
+
+#include <GL/gl.h>
+
+enum overlayStyle { OVERLAY_SDF, OVERLAY_LINES };
+
+int buildOverlay(const GLfloat (*lpArc)[2], int arcCount, enum overlayStyle overlayStyle);
+void resizeOverlay(int width, int height);
+void drawOverlay(float rollDegrees, float pitchDegrees);
+void drawOverlayWall(GLuint indicatorTexture, int count, float cellScaleX, float cellScaleY, float lineScale);
+void deleteOverlay();
+
+#endif
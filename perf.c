@@ -0,0 +1,376 @@
+
+/* Frame time instrumentation, see perf.h. */
+
+#define GL_GLEXT_PROTOTYPES
+
+#include <GL/gl.h>
+#include <GL/glext.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <signal.h>
+#include <time.h>
+#include "glstate.h"
+#include "perf.h"
+
+#define PERF_QUERY_LATENCY 4        // frames in flight before GPU results are read
+#define PERF_BUCKETS 13
+#define PERF_BUDGET_MS (1000.0 / 60.0)
+
+struct perfFrame {
+    uint64_t frame;
+    double start;                   // CLOCK_MONOTONIC milliseconds
+    double interval;                // since the previous frame started
+    float cpu[PERF_PHASES];         // milliseconds
+    float gpu[PERF_PHASES];         // milliseconds, valid when gpuValid
+    int gpuValid;
+    unsigned int glIssued;          // state calls that reached GL, see glstate.h
+    unsigned int glSkipped;         // state calls that changed nothing and were dropped
+};
+
+struct perfQuerySet {
+    GLuint queries[PERF_PHASES + 1];   // GL_TIMESTAMP before the frame and after each phase
+    uint64_t frame;
+    int issued;
+};
+
+static const char* lpPhaseNames[PERF_PHASES] = { "clear", "sphere", "ring", "overlay", "swap" };
+
+// Upper bucket bounds in milliseconds; the last bucket takes everything above.
+static const double bucketBounds[PERF_BUCKETS - 1] = {
+    0.05, 0.1, 0.25, 0.5, 1.0, 2.0, 4.0, 8.0, PERF_BUDGET_MS, 33.3, 50.0, 100.0
+};
+
+static const char* lpPrefix = "/tmp/indicator-perf";
+static int gpuTiming;
+
+// Render thread only.
+static struct perfFrame current;
+static double phaseStart, previousStart;
+static unsigned long issuedBefore, skippedBefore;   // glStateCounts() at the start of the frame
+static int markedPhases;
+static struct perfQuerySet querySets[PERF_QUERY_LATENCY];
+static struct perfQuerySet* lpQuerySet;
+
+// Shared with the dump, guarded by lock.
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static struct perfFrame ring[PERF_RING_FRAMES];
+static uint64_t frameCount;
+static uint64_t overBudget;         // frames with more CPU time than PERF_BUDGET_MS
+static uint64_t gpuMissed;          // frames whose GPU results were not ready in time
+static unsigned int cpuHistogram[PERF_PHASES + 1][PERF_BUCKETS];    // last row: whole frame
+static unsigned int gpuHistogram[PERF_PHASES + 1][PERF_BUCKETS];
+static double cpuMax[PERF_PHASES + 1];
+
+// Dump side.
+static pthread_mutex_t dumpLock = PTHREAD_MUTEX_INITIALIZER;
+static struct perfFrame snapshot[PERF_RING_FRAMES];
+static sem_t dumpRequest;
+static pthread_t dumpThread;
+
+static double nowMilliseconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+static int bucketOf(double ms) {
+    int k = 0;
+    while (k < PERF_BUCKETS - 1 && ms > bucketBounds[k])
+        k++;
+    return k;
+}
+
+/* Must be called with a current context, before the first frame.  The dump files
+ * are lpDumpPrefix.json and lpDumpPrefix.csv; NULL keeps the default.
+ */
+void initPerf(const char* lpDumpPrefix) {
+    GLint major = 0, minor = 0;
+    int k;
+
+    if (lpDumpPrefix != NULL)
+        lpPrefix = lpDumpPrefix;
+
+    glGetIntegerv(GL_MAJOR_VERSION, &major);
+    glGetIntegerv(GL_MINOR_VERSION, &minor);
+    gpuTiming = major > 3 || (major == 3 && minor >= 3);
+    if (!gpuTiming) {
+        GLint extensions = 0, i;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &extensions);
+        for (i = 0; i < extensions && !gpuTiming; i++)
+            gpuTiming = strcmp((const char*)glGetStringi(GL_EXTENSIONS, i), "GL_ARB_timer_query") == 0;
+    }
+    if (gpuTiming) {
+        for (k = 0; k < PERF_QUERY_LATENCY; k++)
+            glGenQueries(PERF_PHASES + 1, querySets[k].queries);
+    }
+    glGetError();   // GL_NUM_EXTENSIONS is missing from old contexts
+}
+
+/* Stores the GPU times of an earlier frame if its queries are done, so the query
+ * set can be reused.  Never waits.
+ */
+static void collectQueries(struct perfQuerySet* lpSet) {
+    GLuint64 stamps[PERF_PHASES + 1];
+    GLint available = 0;
+    struct perfFrame* lpFrame;
+    int phase;
+
+    if (!lpSet->issued)
+        return;
+    lpSet->issued = 0;
+    glGetQueryObjectiv(lpSet->queries[PERF_PHASES], GL_QUERY_RESULT_AVAILABLE, &available);
+
+    pthread_mutex_lock(&lock);
+    if (!available) {
+        gpuMissed++;
+        pthread_mutex_unlock(&lock);
+        return;
+    }
+    pthread_mutex_unlock(&lock);
+
+    for (phase = 0; phase <= PERF_PHASES; phase++)
+        glGetQueryObjectui64v(lpSet->queries[phase], GL_QUERY_RESULT, &stamps[phase]);
+
+    pthread_mutex_lock(&lock);
+    lpFrame = &ring[lpSet->frame % PERF_RING_FRAMES];
+    if (lpFrame->frame == lpSet->frame) {   // not yet overwritten
+        double total = 0.0;
+        for (phase = 0; phase < PERF_PHASES; phase++) {
+            lpFrame->gpu[phase] = (float)((stamps[phase + 1] - stamps[phase]) / 1e6);
+            total += lpFrame->gpu[phase];
+            gpuHistogram[phase][bucketOf(lpFrame->gpu[phase])]++;
+        }
+        gpuHistogram[PERF_PHASES][bucketOf(total)]++;
+        lpFrame->gpuValid = 1;
+    }
+    pthread_mutex_unlock(&lock);
+}
+
+void perfBeginFrame() {
+    phaseStart = nowMilliseconds();
+    memset(&current, 0, sizeof(current));
+    current.frame = frameCount;
+    current.start = phaseStart;
+    current.interval = previousStart > 0.0 ? phaseStart - previousStart : 0.0;
+    previousStart = phaseStart;
+    markedPhases = 0;
+    glStateCounts(&issuedBefore, &skippedBefore);
+
+    if (gpuTiming) {
+        lpQuerySet = &querySets[current.frame % PERF_QUERY_LATENCY];
+        collectQueries(lpQuerySet);
+        glQueryCounter(lpQuerySet->queries[0], GL_TIMESTAMP);
+    }
+}
+
+/* Ends a phase.  Phases must be marked in order; a skipped phase counts as 0. */
+void perfMark(enum perfPhase phase) {
+    double now = nowMilliseconds();
+
+    current.cpu[phase] = (float)(now - phaseStart);
+    phaseStart = now;
+    if (gpuTiming) {
+        // Skipped phases get the same timestamp, so their GPU time is 0 as well.
+        while (markedPhases <= (int)phase)
+            glQueryCounter(lpQuerySet->queries[++markedPhases], GL_TIMESTAMP);
+    }
+    else {
+        markedPhases = phase + 1;
+    }
+}
+
+void perfEndFrame() {
+    unsigned long issued, skipped;
+    double total = 0.0;
+    int phase;
+
+    if (markedPhases < PERF_PHASES)
+        perfMark(PERF_PHASES - 1);
+    glStateCounts(&issued, &skipped);
+    current.glIssued = (unsigned int)(issued - issuedBefore);
+    current.glSkipped = (unsigned int)(skipped - skippedBefore);
+    if (gpuTiming) {
+        lpQuerySet->frame = current.frame;
+        lpQuerySet->issued = 1;
+    }
+
+    pthread_mutex_lock(&lock);
+    ring[current.frame % PERF_RING_FRAMES] = current;
+    for (phase = 0; phase < PERF_PHASES; phase++) {
+        total += current.cpu[phase];
+        cpuHistogram[phase][bucketOf(current.cpu[phase])]++;
+        if (current.cpu[phase] > cpuMax[phase])
+            cpuMax[phase] = current.cpu[phase];
+    }
+    cpuHistogram[PERF_PHASES][bucketOf(total)]++;
+    if (total > cpuMax[PERF_PHASES])
+        cpuMax[PERF_PHASES] = total;
+    if (total > PERF_BUDGET_MS)
+        overBudget++;
+    frameCount++;
+    pthread_mutex_unlock(&lock);
+}
+
+// ------------------------------------ dumps ------------------------------------
+
+static void writeHistogram(FILE* fHandle, const unsigned int* lpCounts) {
+    int k;
+    fputc('[', fHandle);
+    for (k = 0; k < PERF_BUCKETS; k++)
+        fprintf(fHandle, k == 0 ? "%u" : ", %u", lpCounts[k]);
+    fputc(']', fHandle);
+}
+
+static void writeJson(FILE* fHandle, const struct perfFrame* lpFrames, int count,
+                      uint64_t frames, uint64_t over, uint64_t missed,
+                      unsigned int (*lpCpu)[PERF_BUCKETS], unsigned int (*lpGpu)[PERF_BUCKETS], const double* lpMax) {
+    int i, phase;
+
+    fprintf(fHandle, "{\n  \"frames\": %llu,\n  \"over_budget\": %llu,\n  \"budget_ms\": %.3f,\n",
+            (unsigned long long)frames, (unsigned long long)over, PERF_BUDGET_MS);
+    fprintf(fHandle, "  \"gpu_timing\": %s,\n  \"gpu_missed\": %llu,\n", gpuTiming ? "true" : "false",
+            (unsigned long long)missed);
+    fprintf(fHandle, "  \"bucket_bounds_ms\": [");
+    for (i = 0; i < PERF_BUCKETS - 1; i++)
+        fprintf(fHandle, i == 0 ? "%.3f" : ", %.3f", bucketBounds[i]);
+    fprintf(fHandle, "],\n  \"phases\": [\n");
+    for (phase = 0; phase <= PERF_PHASES; phase++) {
+        fprintf(fHandle, "    { \"name\": \"%s\", \"cpu_max_ms\": %.3f, \"cpu_histogram\": ",
+                phase < PERF_PHASES ? lpPhaseNames[phase] : "frame", lpMax[phase]);
+        writeHistogram(fHandle, lpCpu[phase]);
+        fprintf(fHandle, ", \"gpu_histogram\": ");
+        writeHistogram(fHandle, lpGpu[phase]);
+        fprintf(fHandle, phase < PERF_PHASES ? " },\n" : " }\n");
+    }
+    fprintf(fHandle, "  ],\n  \"recent\": [\n");
+    for (i = 0; i < count; i++) {
+        const struct perfFrame* lpFrame = &lpFrames[i];
+        fprintf(fHandle, "    { \"frame\": %llu, \"start_ms\": %.3f, \"interval_ms\": %.3f, \"cpu_ms\": [",
+                (unsigned long long)lpFrame->frame, lpFrame->start, lpFrame->interval);
+        for (phase = 0; phase < PERF_PHASES; phase++)
+            fprintf(fHandle, phase == 0 ? "%.4f" : ", %.4f", lpFrame->cpu[phase]);
+        fprintf(fHandle, "], \"gpu_ms\": ");
+        if (lpFrame->gpuValid) {
+            fputc('[', fHandle);
+            for (phase = 0; phase < PERF_PHASES; phase++)
+                fprintf(fHandle, phase == 0 ? "%.4f" : ", %.4f", lpFrame->gpu[phase]);
+            fputc(']', fHandle);
+        }
+        else {
+            fprintf(fHandle, "null");
+        }
+        fprintf(fHandle, ", \"gl_issued\": %u, \"gl_skipped\": %u", lpFrame->glIssued, lpFrame->glSkipped);
+        fprintf(fHandle, i + 1 < count ? " },\n" : " }\n");
+    }
+    fprintf(fHandle, "  ]\n}\n");
+}
+
+static void writeCsv(FILE* fHandle, const struct perfFrame* lpFrames, int count) {
+    int i, phase;
+
+    fprintf(fHandle, "frame,start_ms,interval_ms");
+    for (phase = 0; phase < PERF_PHASES; phase++)
+        fprintf(fHandle, ",cpu_%s_ms", lpPhaseNames[phase]);
+    for (phase = 0; phase < PERF_PHASES; phase++)
+        fprintf(fHandle, ",gpu_%s_ms", lpPhaseNames[phase]);
+    fprintf(fHandle, ",gl_issued,gl_skipped\n");
+
+    for (i = 0; i < count; i++) {
+        const struct perfFrame* lpFrame = &lpFrames[i];
+        fprintf(fHandle, "%llu,%.3f,%.3f", (unsigned long long)lpFrame->frame, lpFrame->start, lpFrame->interval);
+        for (phase = 0; phase < PERF_PHASES; phase++)
+            fprintf(fHandle, ",%.4f", lpFrame->cpu[phase]);
+        for (phase = 0; phase < PERF_PHASES; phase++) {
+            if (lpFrame->gpuValid)
+                fprintf(fHandle, ",%.4f", lpFrame->gpu[phase]);
+            else
+                fputc(',', fHandle);
+        }
+        fprintf(fHandle, ",%u,%u\n", lpFrame->glIssued, lpFrame->glSkipped);
+    }
+}
+
+/* Writes the counters, histograms and the frames in the ring, oldest first, to
+ * the dump file for format.  Safe to call from any thread.  Returns 0 on failure.
+ */
+int perfDump(enum perfFormat format) {
+    static unsigned int cpu[PERF_PHASES + 1][PERF_BUCKETS], gpu[PERF_PHASES + 1][PERF_BUCKETS];
+    static double maxima[PERF_PHASES + 1];
+    char filename[1024];
+    uint64_t frames, over, missed, first, i;
+    FILE* fHandle;
+    int count;
+
+    pthread_mutex_lock(&dumpLock);
+
+    // Copy under the lock, write without it, so the render thread never waits on the file.
+    pthread_mutex_lock(&lock);
+    frames = frameCount;
+    over = overBudget;
+    missed = gpuMissed;
+    first = frames > PERF_RING_FRAMES ? frames - PERF_RING_FRAMES : 0;
+    for (i = first; i < frames; i++)
+        snapshot[i - first] = ring[i % PERF_RING_FRAMES];
+    memcpy(cpu, cpuHistogram, sizeof(cpu));
+    memcpy(gpu, gpuHistogram, sizeof(gpu));
+    memcpy(maxima, cpuMax, sizeof(maxima));
+    pthread_mutex_unlock(&lock);
+    count = (int)(frames - first);
+
+    snprintf(filename, sizeof(filename), "%s.%s", lpPrefix, format == PERF_JSON ? "json" : "csv");
+    fHandle = fopen(filename, "w");
+    if (fHandle == NULL) {
+        fprintf(stderr, "%s:%u: Failed to write file %s\n", __FILE__, __LINE__, filename);
+        pthread_mutex_unlock(&dumpLock);
+        return 0;
+    }
+    if (format == PERF_JSON)
+        writeJson(fHandle, snapshot, count, frames, over, missed, cpu, gpu, maxima);
+    else
+        writeCsv(fHandle, snapshot, count);
+    fclose(fHandle);
+    fprintf(stderr, "performance data written to %s\n", filename);
+
+    pthread_mutex_unlock(&dumpLock);
+    return 1;
+}
+
+// ---------------------------------- SIGUSR1 ------------------------------------
+
+static void requestDump(int signalNumber) {
+    sem_post(&dumpRequest);     // async-signal-safe; the dump runs on dumpThread
+}
+
+static void* runDumps(void* lpArg) {
+    for (;;) {
+        if (sem_wait(&dumpRequest) != 0) {
+            if (errno == EINTR)
+                continue;
+            return NULL;
+        }
+        perfDump(PERF_JSON);
+        perfDump(PERF_CSV);
+    }
+}
+
+/* Makes SIGUSR1 write both dump files. */
+void installPerfSignal() {
+    struct sigaction action;
+
+    sem_init(&dumpRequest, 0, 0);
+    if (pthread_create(&dumpThread, NULL, runDumps, NULL) != 0) {
+        fprintf(stderr, "%s:%u: Failed to start the dump thread\n", __FILE__, __LINE__);
+        return;
+    }
+    pthread_detach(dumpThread);
+
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = requestDump;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGUSR1, &action, NULL);
+}
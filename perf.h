@@ -0,0 +1,36 @@
+
+/* Frame time instrumentation, always compiled in.  display() calls
+ * perfBeginFrame() first and perfMark() at the end of every phase.  Each mark
+ * reads CLOCK_MONOTONIC and, where GL_ARB_timer_query is available, issues a
+ * GL_TIMESTAMP query, so a phase costs two clock reads and one query.
+ *
+ * The last PERF_RING_FRAMES frames are kept in a fixed ring, with CPU and GPU
+ * time per phase.  GPU results are collected a few frames later, once they are
+ * available, without ever waiting for them.  Counters and per-phase histograms
+ * cover the whole run.  Every frame also records how many GL state calls it
+ * issued and how many the state shadow skipped (see glstate.h).  Nothing is
+ * allocated after initPerf().
+ *
+ * perfDump() writes everything to PREFIX.json or PREFIX.csv.  SIGUSR1 writes both
+ * from a separate thread, so a running panel can be inspected with
+ *
+ *    kill -USR1 $(pidof glut-starter)
+ */
+
+#ifndef PERF_H
+#define PERF_H
+
+#define PERF_RING_FRAMES 1024
+
+enum perfPhase { PERF_CLEAR, PERF_SPHERE, PERF_RING, PERF_OVERLAY, PERF_SWAP, PERF_PHASES };
+
+enum perfFormat { PERF_JSON, PERF_CSV };
+
+void initPerf(const char* lpDumpPrefix);
+void perfBeginFrame();
+void perfMark(enum perfPhase phase);
+void perfEndFrame();
+int perfDump(enum perfFormat format);
+void installPerfSignal();
+
+#endif
@@ -0,0 +1,281 @@
+
+/* Attitude recording and replay, see recording.h. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "recording.h"
+
+#define FLUSH_INTERVAL_MS 250       // the writer wakes at least this often
+#define REPLAY_RELEASE_BYTES (4 << 20)  // give back read pages in steps of this size
+
+// Single-producer/single-consumer ring.  Only recordAttitude() writes ringHead
+// and the slots, only the writer thread writes ringTail.
+static struct attitudeRecord ring[RECORDING_RING_SIZE];
+static _Alignas(64) atomic_uint ringHead;
+static _Alignas(64) atomic_uint ringTail;
+static atomic_ulong droppedRecords;
+static atomic_int stopping;
+
+static int recording;
+static int recordFd = -1;
+static sem_t writerWake;
+static pthread_t writerThread;
+static struct timespec lastRecordTime;
+static int haveRecord;
+
+static const unsigned char* lpReplayData;
+static size_t replaySize;
+static size_t replayOffset;         // of the next record
+static size_t releasedOffset;       // everything before this was given back
+static uint64_t replayTime;         // microseconds since the first record, up to replayOffset
+
+// ------------------------------- recording -----------------------------------
+
+static int writeAll(int fd, const void* lpData, size_t size) {
+    const char* lpBytes = (const char*)lpData;
+    ssize_t written;
+
+    while (size > 0) {
+        written = write(fd, lpBytes, size);
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+            return 0;
+        }
+        lpBytes += written;
+        size -= written;
+    }
+    return 1;
+}
+
+/* Writes everything between ringTail and ringHead, in at most two pieces. */
+static void flushRing() {
+    unsigned int tail = atomic_load_explicit(&ringTail, memory_order_relaxed);
+    unsigned int head = atomic_load_explicit(&ringHead, memory_order_acquire);
+    unsigned int start, count;
+
+    while (head != tail) {
+        start = tail & (RECORDING_RING_SIZE - 1);
+        count = head - tail;
+        if (count > RECORDING_RING_SIZE - start)
+            count = RECORDING_RING_SIZE - start;
+        if (!writeAll(recordFd, &ring[start], count * sizeof(ring[0]))) {
+            fprintf(stderr, "%s:%u: Failed to write the recording: %s\n", __FILE__, __LINE__, strerror(errno));
+            count = head - tail;    // drop the rest rather than retrying forever
+        }
+        tail += count;
+        atomic_store_explicit(&ringTail, tail, memory_order_release);
+    }
+}
+
+static void* runWriter(void* lpArgument) {
+    struct timespec deadline;
+
+    (void)lpArgument;
+    while (!atomic_load(&stopping)) {
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_nsec += FLUSH_INTERVAL_MS * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+        sem_timedwait(&writerWake, &deadline);
+        flushRing();
+    }
+    flushRing();
+    return NULL;
+}
+
+/* Creates (or truncates) the log at lpPath and starts the writer thread.
+ * Returns 0 on failure.
+ */
+int startRecording(const char* lpPath) {
+    struct recordingHeader header;
+    struct timespec now;
+
+    recordFd = open(lpPath, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (recordFd < 0) {
+        fprintf(stderr, "%s:%u: Failed to create %s: %s\n", __FILE__, __LINE__, lpPath, strerror(errno));
+        return 0;
+    }
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, RECORDING_MAGIC, sizeof(header.magic));
+    clock_gettime(CLOCK_REALTIME, &now);
+    header.startTime = (uint64_t)now.tv_sec * 1000000000u + now.tv_nsec;
+    if (!writeAll(recordFd, &header, sizeof(header))) {
+        fprintf(stderr, "%s:%u: Failed to write %s: %s\n", __FILE__, __LINE__, lpPath, strerror(errno));
+        close(recordFd);
+        recordFd = -1;
+        return 0;
+    }
+
+    sem_init(&writerWake, 0, 0);
+    atomic_store(&stopping, 0);
+    if (pthread_create(&writerThread, NULL, runWriter, NULL) != 0) {
+        fprintf(stderr, "%s:%u: Failed to start the recording thread\n", __FILE__, __LINE__);
+        sem_destroy(&writerWake);
+        close(recordFd);
+        recordFd = -1;
+        return 0;
+    }
+    haveRecord = 0;
+    recording = 1;
+    return 1;
+}
+
+/* Appends the current state to the recording, if one was started.  Costs a
+ * clock read and a copy; never waits for the file.
+ */
+void recordAttitude(float roll, float pitch, int brightness) {
+    struct attitudeRecord* lpRecord;
+    struct timespec now;
+    unsigned int head, tail;
+    int64_t delta;
+
+    if (!recording)
+        return;
+    head = atomic_load_explicit(&ringHead, memory_order_relaxed);
+    tail = atomic_load_explicit(&ringTail, memory_order_acquire);
+    if (head - tail == RECORDING_RING_SIZE) {
+        atomic_fetch_add_explicit(&droppedRecords, 1, memory_order_relaxed);
+        return;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    delta = haveRecord ? (now.tv_sec - lastRecordTime.tv_sec) * 1000000LL +
+                         (now.tv_nsec - lastRecordTime.tv_nsec) / 1000 : 0;
+    lastRecordTime = now;
+    haveRecord = 1;
+
+    lpRecord = &ring[head & (RECORDING_RING_SIZE - 1)];
+    lpRecord->delta = delta > UINT32_MAX ? UINT32_MAX : (uint32_t)delta;
+    lpRecord->roll = roll;
+    lpRecord->pitch = pitch;
+    lpRecord->brightness = brightness < 0 ? 0 : brightness > UINT16_MAX ? UINT16_MAX : brightness;
+    lpRecord->reserved = 0;
+    atomic_store_explicit(&ringHead, head + 1, memory_order_release);
+
+    if (head + 1 - tail == RECORDING_RING_SIZE / 2)
+        sem_post(&writerWake);      // half full: flush now instead of at the next interval
+}
+
+/* Number of records dropped because the ring was full. */
+unsigned long recordingDropped() {
+    return atomic_load_explicit(&droppedRecords, memory_order_relaxed);
+}
+
+/* Writes what is left in the ring and closes the log. */
+void stopRecording() {
+    if (!recording)
+        return;
+    recording = 0;
+    atomic_store(&stopping, 1);
+    sem_post(&writerWake);
+    pthread_join(writerThread, NULL);
+    sem_destroy(&writerWake);
+    close(recordFd);
+    recordFd = -1;
+    if (recordingDropped() > 0)
+        fprintf(stderr, "%s:%u: %lu attitude records dropped\n", __FILE__, __LINE__, recordingDropped());
+}
+
+// ------------------------------- replay --------------------------------------
+
+/* Maps the log at lpPath for replay from its first record.  Returns 0 on failure. */
+int openReplay(const char* lpPath) {
+    struct stat st;
+    void* lpMapping;
+    int fd;
+
+    if ((fd = open(lpPath, O_RDONLY | O_CLOEXEC)) < 0) {
+        fprintf(stderr, "%s:%u: Failed to open %s: %s\n", __FILE__, __LINE__, lpPath, strerror(errno));
+        return 0;
+    }
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(struct recordingHeader)) {
+        fprintf(stderr, "%s:%u: %s is not an attitude recording\n", __FILE__, __LINE__, lpPath);
+        close(fd);
+        return 0;
+    }
+    lpMapping = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (lpMapping == MAP_FAILED) {
+        fprintf(stderr, "%s:%u: Failed to map %s: %s\n", __FILE__, __LINE__, lpPath, strerror(errno));
+        return 0;
+    }
+    if (memcmp(lpMapping, RECORDING_MAGIC, 8) != 0) {
+        fprintf(stderr, "%s:%u: %s is not an attitude recording\n", __FILE__, __LINE__, lpPath);
+        munmap(lpMapping, st.st_size);
+        return 0;
+    }
+    madvise(lpMapping, st.st_size, MADV_SEQUENTIAL);   // read ahead, drop behind
+
+    lpReplayData = (const unsigned char*)lpMapping;
+    replaySize = st.st_size;
+    replayOffset = sizeof(struct recordingHeader);
+    releasedOffset = 0;
+    replayTime = 0;
+    return 1;
+}
+
+/* Reads the next record and its time in microseconds.  Returns 0 at the end of the log. */
+static int readReplay(struct replayRecord* lpRecord, uint64_t* lpTime) {
+    struct attitudeRecord record;
+
+    if (lpReplayData == NULL || replayOffset + sizeof(record) > replaySize)
+        return 0;
+    memcpy(&record, lpReplayData + replayOffset, sizeof(record));
+    *lpTime = replayTime + record.delta;
+    lpRecord->time = *lpTime / 1e6;
+    lpRecord->roll = record.roll;
+    lpRecord->pitch = record.pitch;
+    lpRecord->brightness = record.brightness;
+    return 1;
+}
+
+/* Copies the next record into lpRecord without moving past it.  Returns 0 at the
+ * end of the log.
+ */
+int peekReplay(struct replayRecord* lpRecord) {
+    uint64_t time;
+    return readReplay(lpRecord, &time);
+}
+
+/* Like peekReplay(), but moves on to the record after it. */
+int nextReplay(struct replayRecord* lpRecord) {
+    size_t keep;
+
+    if (!readReplay(lpRecord, &replayTime))
+        return 0;
+    replayOffset += sizeof(struct attitudeRecord);
+
+    keep = replayOffset & ~(size_t)(sysconf(_SC_PAGESIZE) - 1);
+    if (keep - releasedOffset >= REPLAY_RELEASE_BYTES) {
+        madvise((void*)(lpReplayData + releasedOffset), keep - releasedOffset, MADV_DONTNEED);
+        releasedOffset = keep;
+    }
+    return 1;
+}
+
+/* Number of records in the log. */
+unsigned long replayLength() {
+    if (lpReplayData == NULL)
+        return 0;
+    return (replaySize - sizeof(struct recordingHeader)) / sizeof(struct attitudeRecord);
+}
+
+void closeReplay() {
+    if (lpReplayData == NULL)
+        return;
+    munmap((void*)lpReplayData, replaySize);
+    lpReplayData = NULL;
+}
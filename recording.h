@@ -0,0 +1,57 @@
+
+/* Attitude recording and replay.  With a recording started, every change of
+ * roll, pitch or brightness is appended to a binary log: a recordingHeader
+ * followed by one 16-byte attitudeRecord per change, in the byte order of the
+ * machine that wrote it.  Each record holds the whole state, so any record can
+ * be shown on its own.
+ *
+ * recordAttitude() never blocks.  It puts the record into a single-producer/
+ * single-consumer ring of RECORDING_RING_SIZE entries, and a writer thread
+ * moves the ring to the file in large writes.  If the writer falls a whole
+ * ring behind, new records are dropped and counted.
+ *
+ * Replay maps the log with mmap() and walks it front to back.  Pages that were
+ * already read are given back to the kernel as replay moves on, so a log of
+ * several hours never has to fit in memory.
+ */
+
+#ifndef RECORDING_H
+#define RECORDING_H
+
+#include <stdint.h>
+
+#define RECORDING_MAGIC "ATTLOG1\n"
+#define RECORDING_RING_SIZE 8192    // power of two
+
+struct recordingHeader {
+    char magic[8];              // RECORDING_MAGIC
+    uint64_t startTime;         // CLOCK_REALTIME nanoseconds of the first record
+};
+
+struct attitudeRecord {
+    uint32_t delta;             // microseconds since the previous record, saturated
+    float roll;                 // degrees
+    float pitch;
+    uint16_t brightness;
+    uint16_t reserved;
+};
+
+struct replayRecord {
+    double time;                // seconds since the first record
+    float roll;
+    float pitch;
+    int brightness;
+};
+
+int startRecording(const char* lpPath);
+void recordAttitude(float roll, float pitch, int brightness);
+unsigned long recordingDropped();
+void stopRecording();
+
+int openReplay(const char* lpPath);
+int peekReplay(struct replayRecord* lpRecord);
+int nextReplay(struct replayRecord* lpRecord);
+unsigned long replayLength();
+void closeReplay();
+
+#endif
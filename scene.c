@@ -0,0 +1,328 @@
+
+/* Core profile ball and ring renderer, see scene.h. */
+
+#define GL_GLEXT_PROTOTYPES
+
+#include <GL/gl.h>
+#include <GL/glext.h>
+#include <stdio.h>
+#include <string.h>
+#include "shader.h"
+#include "perf.h"
+#include "glstate.h"
+#include "scene.h"
+
+#define LIGHTING_BINDING 0
+#define TRANSFORM_BINDING 1
+#define INDICATOR_UNIT 1            // texture unit of the wall's indicator buffer texture
+#define IMPOSTOR_RADIUS 0.9f        // the radius of the sphere mesh
+
+// Light 0 and the material, and the fixed-function lighting equation on them.
+#define LIGHTING_SOURCE \
+    "layout(std140) uniform Lighting {\n" \
+    "    vec4 lightDirection;\n" \
+    "    vec4 lightAmbient;\n" \
+    "    vec4 lightDiffuse;\n" \
+    "    vec4 lightSpecular;\n" \
+    "    vec4 sceneAmbient;\n" \
+    "    vec4 materialAmbient;\n" \
+    "    vec4 materialDiffuse;\n" \
+    "    vec4 materialSpecular;\n" \
+    "};\n" \
+    "vec4 shade(vec3 n) {\n" \
+    "    vec3 l = normalize(lightDirection.xyz);\n" \
+    "    float diffuse = max(dot(n, l), 0.0);\n" \
+    "    vec3 color = (sceneAmbient.rgb + lightAmbient.rgb) * materialAmbient.rgb\n" \
+    "               + diffuse * lightDiffuse.rgb * materialDiffuse.rgb;\n" \
+    "    if (diffuse > 0.0) {\n" \
+    "        vec3 h = normalize(l + vec3(0.0, 0.0, 1.0));   // infinite viewer\n" \
+    "        color += pow(max(dot(n, h), 1e-6), materialSpecular.w) * lightSpecular.rgb * materialSpecular.rgb;\n" \
+    "    }\n" \
+    "    return vec4(min(color, 1.0), 1.0);\n" \
+    "}\n"
+
+static const char* lpVertexSource =
+    "#version 330 core\n"
+    "layout(location = 0) in vec3 position;\n"
+    "layout(location = 1) in vec3 normal;\n"
+    "layout(location = 2) in vec2 texCoord;\n"
+    LIGHTING_SOURCE
+    "out vec2 uv;\n"
+    "#ifdef WALL\n"
+    "out vec4 frontColor;\n"
+    "out vec4 backColor;\n"
+    "uniform samplerBuffer indicators;   // 4 texels per indicator, see wall.c\n"
+    "uniform vec2 cellScale;\n"
+    "uniform int ring;\n"
+    "void main() {\n"
+    "    int base = gl_InstanceID * 4;\n"
+    "    vec4 indicator = texelFetch(indicators, base);\n"
+    "    vec4 column0 = texelFetch(indicators, base + 1);\n"
+    "    vec4 column1 = texelFetch(indicators, base + 2);\n"
+    "    vec4 column2 = texelFetch(indicators, base + 3);\n"
+    "    if (column2.w != 0.0) {\n"
+    "        gl_Position = vec4(0.0, 0.0, 2.0, 1.0);   // stale: behind the far plane, clipped\n"
+    "        return;\n"
+    "    }\n"
+    "    mat3 model;\n"
+    "    if (ring != 0)\n"
+    "        model = mat3(column0.w, column1.w, 0.0, -column1.w, column0.w, 0.0, 0.0, 0.0, 1.0);\n"
+    "    else\n"
+    "        model = mat3(column0.xyz, column1.xyz, column2.xyz);\n"
+    "    vec3 p = model * position;\n"
+    "    vec3 n = normalize(model * normal);\n"
+    "    if (ring != 0)\n"
+    "        p.z -= 0.7;\n"
+    "    gl_Position = vec4(indicator.zw + p.xy * cellScale, p.z, 1.0);\n"
+    "    // Lit per vertex, which is cheaper and enough at the size of a cell.\n"
+    "    // Two-sided lighting: back faces are lit with the reversed normal.\n"
+    "    frontColor = shade(n);\n"
+    "    backColor = shade(-n);\n"
+    "#else\n"
+    "out vec3 eyeNormal;\n"
+    "layout(std140) uniform Transform {\n"
+    "    mat4 model;\n"
+    "};\n"
+    "void main() {\n"
+    "    eyeNormal = mat3(model) * normal;   // rotations only, no scaling\n"
+    "    gl_Position = model * vec4(position, 1.0);\n"
+    "#endif\n"
+    "    uv = texCoord;\n"
+    "}\n";
+
+static const char* lpFragmentSource =
+    "#version 330 core\n"
+    LIGHTING_SOURCE
+    "uniform sampler2D image;\n"
+    "in vec2 uv;\n"
+    "out vec4 fragColor;\n"
+    "#ifdef WALL\n"
+    "in vec4 frontColor;\n"
+    "in vec4 backColor;\n"
+    "void main() {\n"
+    "    fragColor = (gl_FrontFacing ? frontColor : backColor) * texture(image, uv);   // GL_MODULATE\n"
+    "}\n"
+    "#else\n"
+    "in vec3 eyeNormal;\n"
+    "void main() {\n"
+    "    // Lit per pixel.  Two-sided lighting: back faces are lit with the reversed normal.\n"
+    "    vec3 n = normalize(gl_FrontFacing ? eyeNormal : -eyeNormal);\n"
+    "    fragColor = shade(n) * texture(image, uv);   // GL_MODULATE\n"
+    "}\n"
+    "#endif\n";
+
+// The ball as a ray-cast impostor: one square around it, and every fragment finds
+// the point of the sphere it shows.  The projection is the identity, so the rays
+// run along z and the depth test keeps the smallest z: the visible hemisphere is
+// z < 0, which faces away from the light and, like the back faces of the mesh, is
+// lit with the reversed normal.
+static const char* lpImpostorVertexSource =
+    "#version 330 core\n"
+    "uniform float radius;\n"
+    "out vec2 eye;\n"
+    "void main() {\n"
+    "    // Corners of a triangle strip from the vertex number; no vertex buffer.\n"
+    "    eye = (vec2(float(gl_VertexID & 1), float(gl_VertexID >> 1)) * 2.0 - 1.0) * radius;\n"
+    "    gl_Position = vec4(eye, 0.0, 1.0);\n"
+    "}\n";
+
+static const char* lpImpostorFragmentSource =
+    "#version 330 core\n"
+    LIGHTING_SOURCE
+    "uniform sampler2D image;\n"
+    "uniform mat4 model;\n"
+    "uniform float radius;\n"
+    "in vec2 eye;\n"
+    "#ifdef VIRTUAL\n"
+    "// Virtual texture, see vtex.h: image is the page cache, and the indirection\n"
+    "// entry of a tile holds the page and level that stand in for it.\n"
+    "uniform usampler2D indirection;\n"
+    "uniform int levelCount;\n"
+    "uniform vec2 levelSize[VTEX_MAX_LEVELS];     // texels\n"
+    "uniform ivec2 levelTiles[VTEX_MAX_LEVELS];\n"
+    "uniform int levelRow[VTEX_MAX_LEVELS];       // of the level's first entry\n"
+    "vec4 sampleImage(vec2 uv, vec2 dx, vec2 dy) {\n"
+    "    float rho = max(length(dx * levelSize[0]), length(dy * levelSize[0]));\n"
+    "    int level = clamp(int(log2(max(rho, 1.0)) + 0.5), 0, levelCount - 1);\n"
+    "    uv = vec2(fract(uv.x), clamp(uv.y, 0.0, 1.0));\n"
+    "    ivec2 tile = min(ivec2(uv * levelSize[level]) / VTEX_TILE, levelTiles[level] - 1);\n"
+    "    uvec4 entry = texelFetch(indirection, ivec2(tile.x, levelRow[level] + tile.y), 0);\n"
+    "    tile = min(tile >> (int(entry.z) - level), levelTiles[entry.z] - 1);\n"
+    "    // Level sizes round down, so the texel can stray a fraction outside the\n"
+    "    // ancestor tile; the border covers that.\n"
+    "    vec2 texel = clamp(uv * levelSize[entry.z] - vec2(tile * VTEX_TILE), -0.5, float(VTEX_TILE) + 0.5);\n"
+    "    vec2 page = vec2(entry.xy) * float(VTEX_PAGE) + float(VTEX_BORDER) + texel;\n"
+    "    return textureLod(image, page / vec2(textureSize(image, 0)), 0.0);\n"
+    "}\n"
+    "#else\n"
+    "vec4 sampleImage(vec2 uv, vec2 dx, vec2 dy) {\n"
+    "    return textureGrad(image, uv, dx, dy);\n"
+    "}\n"
+    "#endif\n"
+    "out vec4 fragColor;\n"
+    "void main() {\n"
+    "    float r2 = dot(eye, eye);\n"
+    "    vec3 p = vec3(eye, -sqrt(max(radius * radius - r2, 0.0)));\n"
+    "    vec3 o = transpose(mat3(model)) * p;   // object coordinates of the sphere mesh\n"
+    "    // gluSphere() texture coordinates: x = sin(theta), y = cos(theta),\n"
+    "    // s = 1 - theta / 2 pi, t = 1 - rho / pi from the +z pole.\n"
+    "    float s = 1.0 - atan(o.x, o.y) / 6.28318531;\n"
+    "    float t = 1.0 - acos(clamp(o.z / radius, -1.0, 1.0)) / 3.14159265;\n"
+    "    // s jumps by 1 at theta = pi; take the derivatives of fract(s) there so\n"
+    "    // that the seam does not drop to the smallest mip level.\n"
+    "    vec2 dx = vec2(dFdx(s), dFdx(t)), dy = vec2(dFdy(s), dFdy(t));\n"
+    "    float dxWrapped = dFdx(fract(s)), dyWrapped = dFdy(fract(s));\n"
+    "    if (abs(dxWrapped) + abs(dyWrapped) < abs(dx.x) + abs(dy.x)) {\n"
+    "        dx.x = dxWrapped;\n"
+    "        dy.x = dyWrapped;\n"
+    "    }\n"
+    "    if (r2 > radius * radius)\n"
+    "        discard;\n"
+    "    fragColor = shade(-p / radius) * sampleImage(vec2(s, t), dx, dy);\n"
+    "    gl_FragDepth = p.z * 0.5 + 0.5;\n"
+    "}\n";
+
+static GLuint program, wallProgram, impostorProgram;
+static GLint cellScaleLocation, ringLocation, impostorModelLocation;
+static GLuint impostorArray;        // empty vertex array object for the attribute-less square
+static GLuint lightingBuffer, transformBuffer;
+static GLint transformStride;       // one mat4, rounded up to GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT
+
+/* Builds the programs and uploads the lighting block.  Returns 0 on failure. */
+int buildScene(const struct sceneLighting* lpLighting) {
+    GLint alignment;
+
+    program = buildProgram(lpVertexSource, lpFragmentSource, "scene");
+    wallProgram = buildProgramVariant(lpVertexSource, lpFragmentSource, "#define WALL\n", "wall scene");
+    if (program == 0 || wallProgram == 0)
+        return 0;
+    glUniformBlockBinding(program, glGetUniformBlockIndex(program, "Lighting"), LIGHTING_BINDING);
+    glUniformBlockBinding(program, glGetUniformBlockIndex(program, "Transform"), TRANSFORM_BINDING);
+    glUseProgram(program);
+    glUniform1i(glGetUniformLocation(program, "image"), 0);
+
+    glUniformBlockBinding(wallProgram, glGetUniformBlockIndex(wallProgram, "Lighting"), LIGHTING_BINDING);
+    glUseProgram(wallProgram);
+    glUniform1i(glGetUniformLocation(wallProgram, "image"), 0);
+    glUniform1i(glGetUniformLocation(wallProgram, "indicators"), INDICATOR_UNIT);
+    cellScaleLocation = glGetUniformLocation(wallProgram, "cellScale");
+    ringLocation = glGetUniformLocation(wallProgram, "ring");
+    impostorProgram = buildImpostorVariant(NULL, "ball impostor");
+    if (impostorProgram == 0)
+        return 0;
+    impostorModelLocation = glGetUniformLocation(impostorProgram, "model");
+    glGenVertexArrays(1, &impostorArray);
+    glUseProgram(0);
+
+    glGenBuffers(1, &lightingBuffer);
+    glBindBuffer(GL_UNIFORM_BUFFER, lightingBuffer);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(*lpLighting), lpLighting, GL_STATIC_DRAW);
+    glBindBufferBase(GL_UNIFORM_BUFFER, LIGHTING_BINDING, lightingBuffer);
+
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    transformStride = (16 * sizeof(GLfloat) + alignment - 1) / alignment * alignment;
+    glGenBuffers(1, &transformBuffer);
+    glBindBuffer(GL_UNIFORM_BUFFER, transformBuffer);
+    glBufferData(GL_UNIFORM_BUFFER, 2 * transformStride, NULL, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    return 1;
+}
+
+/* Builds the impostor program with lpDefines (see buildProgramVariant()), the
+ * lighting block bound, image on unit 0 and the radius set, and leaves it in use.
+ * Returns 0 on failure.
+ */
+GLuint buildImpostorVariant(const char* lpDefines, const char* lpName) {
+    GLuint variant = buildProgramVariant(lpImpostorVertexSource, lpImpostorFragmentSource, lpDefines, lpName);
+
+    if (variant == 0)
+        return 0;
+    glUniformBlockBinding(variant, glGetUniformBlockIndex(variant, "Lighting"), LIGHTING_BINDING);
+    glUseProgram(variant);
+    glUniform1i(glGetUniformLocation(variant, "image"), 0);
+    glUniform1f(glGetUniformLocation(variant, "radius"), IMPOSTOR_RADIUS);
+    return variant;
+}
+
+/* Draws the square of the impostor with the program in use. */
+void drawImpostorSquare() {
+    bindVertexArray(impostorArray);
+    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+}
+
+/* Draws the ball as a ray-cast impostor: four vertices whatever the window size,
+ * with an exact outline and the texture coordinates, lighting and depth of the
+ * sphere mesh.  Works in both profiles; the fixed-function path selects
+ * program 0 again before its own draws.
+ */
+void drawBallImpostor(GLuint sphereTexture, const GLfloat* lpSphereModel) {
+    useProgram(impostorProgram);
+    glUniformMatrix4fv(impostorModelLocation, 1, GL_FALSE, lpSphereModel);
+    bindTexture(0, GL_TEXTURE_2D, sphereTexture);
+    drawImpostorSquare();
+}
+
+/* Draws the ball and ring with the column-major model matrices of the frame (see
+ * attitude.h).  With lpSphere NULL only the ring is drawn; the caller has drawn an
+ * impostor ball.
+ */
+void drawScene(const struct mesh* lpSphere, const struct mesh* lpRing, GLuint sphereTexture,
+               GLuint ringTexture, const GLfloat* lpSphereModel, const GLfloat* lpRingModel) {
+    unsigned char transforms[2 * 256];
+
+    if (transformStride > 256) {
+        fprintf(stderr, "%s:%u: Uniform buffer alignment %d is not supported\n", __FILE__, __LINE__, transformStride);
+        return;
+    }
+    memcpy(transforms, lpSphereModel, 16 * sizeof(GLfloat));
+    memcpy(transforms + transformStride, lpRingModel, 16 * sizeof(GLfloat));
+
+    glBindBuffer(GL_UNIFORM_BUFFER, transformBuffer);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, 2 * transformStride, transforms);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+    useProgram(program);
+
+    if (lpSphere != NULL) {
+        glBindBufferRange(GL_UNIFORM_BUFFER, TRANSFORM_BINDING, transformBuffer, 0, 16 * sizeof(GLfloat));
+        bindTexture(0, GL_TEXTURE_2D, sphereTexture);
+        drawMesh(lpSphere);
+    }
+    perfMark(PERF_SPHERE);
+
+    glBindBufferRange(GL_UNIFORM_BUFFER, TRANSFORM_BINDING, transformBuffer, transformStride, 16 * sizeof(GLfloat));
+    bindTexture(0, GL_TEXTURE_2D, ringTexture);
+    drawMesh(lpRing);
+}
+
+/* Draws count balls and rings, one per indicator, with one instanced call each.
+ * indicatorTexture is a GL_RGBA32F buffer texture holding roll, pitch and the
+ * cell center for every indicator; cellScale maps the [-1, 1] square of one
+ * indicator to its cell.
+ */
+void drawSceneWall(const struct mesh* lpSphere, const struct mesh* lpRing, GLuint sphereTexture,
+                   GLuint ringTexture, GLuint indicatorTexture, int count, float cellScaleX, float cellScaleY) {
+    useProgram(wallProgram);
+    glUniform2f(cellScaleLocation, cellScaleX, cellScaleY);
+    bindTexture(INDICATOR_UNIT, GL_TEXTURE_BUFFER, indicatorTexture);
+
+    glUniform1i(ringLocation, 0);
+    bindTexture(0, GL_TEXTURE_2D, sphereTexture);
+    drawMeshInstanced(lpSphere, count);
+    perfMark(PERF_SPHERE);
+
+    glUniform1i(ringLocation, 1);
+    bindTexture(0, GL_TEXTURE_2D, ringTexture);
+    drawMeshInstanced(lpRing, count);
+    perfMark(PERF_RING);
+}
+
+void deleteScene() {
+    glDeleteProgram(program);
+    glDeleteProgram(wallProgram);
+    glDeleteProgram(impostorProgram);
+    glDeleteVertexArrays(1, &impostorArray);
+    glDeleteBuffers(1, &lightingBuffer);
+    glDeleteBuffers(1, &transformBuffer);
+    program = wallProgram = impostorProgram = impostorArray = lightingBuffer = transformBuffer = 0;
+}
@@ -0,0 +1,47 @@
+
+/* Shader-based drawing of the ball and ring for the OpenGL 3.3 core profile path
+ * (--core), where the fixed-function lighting, matrix stack and texture enables
+ * of display() do not exist, and for the indicator wall (see wall.h) in either
+ * profile.
+ *
+ * Two uniform blocks feed the program.  Lighting holds light 0 and the material
+ * and is uploaded once by buildScene().  Transform holds the model matrix; both
+ * the sphere and the ring matrix are written into one buffer each frame, and each
+ * draw binds its own range of it.  Lighting uses the same terms as the
+ * fixed-function pipeline, including two-sided lighting; it is evaluated per
+ * pixel for the single indicator and per vertex for the small cells of the wall.
+ *
+ * drawBallImpostor() (--impostor) replaces the tessellated ball by one square
+ * whose fragments intersect their view ray with the sphere, and computes the
+ * texture coordinates and lighting per pixel.  It serves both profiles.  Its
+ * VIRTUAL variant samples a virtual texture instead (see vtex.h).
+ */
+
+#ifndef SCENE_H
+#define SCENE_H
+
+#include <GL/gl.h>
+#include "mesh.h"
+
+struct sceneLighting {              // std140 layout of the Lighting block
+    GLfloat lightDirection[4];      // eye space, towards the light (w = 0)
+    GLfloat lightAmbient[4];
+    GLfloat lightDiffuse[4];
+    GLfloat lightSpecular[4];
+    GLfloat sceneAmbient[4];        // GL_LIGHT_MODEL_AMBIENT
+    GLfloat materialAmbient[4];
+    GLfloat materialDiffuse[4];
+    GLfloat materialSpecular[4];    // rgb, shininess in w
+};
+
+int buildScene(const struct sceneLighting* lpLighting);
+void drawScene(const struct mesh* lpSphere, const struct mesh* lpRing, GLuint sphereTexture,
+               GLuint ringTexture, const GLfloat* lpSphereModel, const GLfloat* lpRingModel);
+GLuint buildImpostorVariant(const char* lpDefines, const char* lpName);
+void drawImpostorSquare();
+void drawBallImpostor(GLuint sphereTexture, const GLfloat* lpSphereModel);
+void drawSceneWall(const struct mesh* lpSphere, const struct mesh* lpRing, GLuint sphereTexture,
+                   GLuint ringTexture, GLuint indicatorTexture, int count, float cellScaleX, float cellScaleY);
+void deleteScene();
+
+#endif
@@ -0,0 +1,222 @@
+
+/* Frame scheduling for the GLUT window, see scheduler.h. */
+
+#include <GL/gl.h>
+#include <GL/glx.h>
+#include <GL/freeglut.h>
+#include <stdio.h>
+#include <time.h>
+#include "indicator.h"
+#include "telemetry.h"
+#include "recording.h"
+#include "texture.h"
+#include "scheduler.h"
+
+#define FALLBACK_FPS 60.0
+#define REFRESH_PERIOD (1.0 / 60.0)  // of the panel, for the scanout estimate
+#define TELEMETRY_ACTIVE_MS 2       // poll interval while samples are coming in
+#define TELEMETRY_IDLE_MS 50        // poll interval after a second without samples
+#define TEXTURE_POLL_MS 100         // how soon a reloaded texture image is shown
+
+typedef int (*swapIntervalProc)(int);
+
+static enum pacingMode pacing = PACE_NONE;
+static double frameInterval;        // seconds between swaps for PACE_RATE
+static double lastSwap;
+static int framePending;            // a redisplay has been posted or a timer is armed for one
+static unsigned int frameGeneration;
+static int continuousFrames;
+static double lastSampleTime;
+static unsigned long lastReceived;  // telemetryReceived() when last checked
+static double lastFleetFrame;
+static double replaySpeed;          // 0: one record per frame
+static double replayStart;
+static int replayPerFrame;
+
+static double monotonicSeconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Sets the swap interval of the current GLX drawable.  Returns 0 if neither
+ * GLX_MESA_swap_control nor GLX_SGI_swap_control is available.
+ */
+static int setSwapInterval(int interval) {
+    swapIntervalProc lpSwapInterval;
+
+    lpSwapInterval = (swapIntervalProc)glXGetProcAddressARB((const GLubyte*)"glXSwapIntervalMESA");
+    if (lpSwapInterval == NULL)
+        lpSwapInterval = (swapIntervalProc)glXGetProcAddressARB((const GLubyte*)"glXSwapIntervalSGI");
+    return lpSwapInterval != NULL && lpSwapInterval(interval) == 0;
+}
+
+/* Must be called once the window exists. */
+void initScheduler(enum pacingMode mode, double targetFps) {
+    pacing = mode;
+    if (pacing == PACE_VSYNC && !setSwapInterval(1)) {
+        fprintf(stderr, "%s:%u: No swap control, pacing at %.0f fps instead\n", __FILE__, __LINE__, FALLBACK_FPS);
+        pacing = PACE_RATE;
+        targetFps = FALLBACK_FPS;
+    }
+    else if (pacing != PACE_VSYNC) {
+        setSwapInterval(0);
+    }
+    frameInterval = (pacing == PACE_RATE && targetFps > 0) ? 1.0 / targetFps : 0.0;
+    lastSwap = monotonicSeconds();
+}
+
+static void postFrame(int generation) {
+    if ((unsigned int)generation == frameGeneration)
+        glutPostRedisplay();
+}
+
+/* Asks for one frame.  Does nothing if a frame is already on its way. */
+void requestFrame() {
+    double wait;
+
+    if (framePending)
+        return;
+    framePending = 1;
+
+    wait = lastSwap + frameInterval - monotonicSeconds();
+    if (wait > 0.001)
+        glutTimerFunc((unsigned int)(wait * 1000.0), postFrame, (int)frameGeneration);
+    else
+        glutPostRedisplay();
+}
+
+/* With continuous set, a new frame is requested after every swap (the 's' key
+ * animation); pacing still applies.
+ */
+void setContinuous(int continuous) {
+    continuousFrames = continuous;
+    if (continuous)
+        requestFrame();
+}
+
+static void advanceReplay();
+
+void frameSwapped() {
+    lastSwap = monotonicSeconds();
+    framePending = 0;
+    frameGeneration++;      // a timer armed for an earlier request is now stale
+    if (replayPerFrame)
+        advanceReplay();
+    if (continuousFrames)
+        requestFrame();
+}
+
+/* Seconds from the start of a frame until it is on the panel, for the attitude
+ * prediction.  With vsync the swap waits for the next vertical blank, on average
+ * half a refresh, and the scanout reaches the middle of the panel half a refresh
+ * after that; without vsync only the second half applies.
+ */
+double scanoutLead() {
+    return pacing == PACE_VSYNC ? REFRESH_PERIOD : REFRESH_PERIOD / 2;
+}
+
+/* Takes the newest telemetry sample and asks for a frame when it moves the
+ * indicator.  display() polls once more right before drawing, so the frame shows
+ * whatever arrived in between.  The wall gets a frame for a sample of any
+ * vehicle, and one a second at least, so that silent vehicles are blanked.
+ */
+static void pollTelemetryTimer(int value) {
+    struct attitudeSample sample;
+    double now = monotonicSeconds();
+    unsigned long received = telemetryReceived();
+    int arrived = received != lastReceived;
+
+    if (arrived) {
+        lastReceived = received;
+        lastSampleTime = now;
+    }
+    if (pollTelemetry(&sample)) {
+        if (takeTelemetrySample(&sample))
+            requestFrame();
+    }
+    if (wallCount > 0 && (arrived || now - lastFleetFrame >= 1.0)) {
+        lastFleetFrame = now;
+        requestFrame();
+    }
+    glutTimerFunc(now - lastSampleTime < 1.0 ? TELEMETRY_ACTIVE_MS : TELEMETRY_IDLE_MS, pollTelemetryTimer, 0);
+}
+
+/* Starts watching the telemetry ring; call after startTelemetry(). */
+void watchTelemetry() {
+    lastSampleTime = monotonicSeconds();
+    glutTimerFunc(TELEMETRY_ACTIVE_MS, pollTelemetryTimer, 0);
+}
+
+/* Asks for a frame when the texture watcher has decoded a changed image;
+ * display() takes it from there.
+ */
+static void pollTexturesTimer(int value) {
+    if (texturesChanged())
+        requestFrame();
+    glutTimerFunc(TEXTURE_POLL_MS, pollTexturesTimer, 0);
+}
+
+/* Starts looking for reloaded textures; call after startTextureWatch(). */
+void watchTextureReloads() {
+    glutTimerFunc(TEXTURE_POLL_MS, pollTexturesTimer, 0);
+}
+
+static void finishReplay() {
+    printf("replay: %lu records in %.1f s\n", replayLength(), monotonicSeconds() - replayStart);
+    replayPerFrame = 0;
+    closeReplay();
+}
+
+/* Speed "max": shows the next record in the next frame, whether it changes
+ * anything or not, so every record is drawn once.
+ */
+static void advanceReplay() {
+    struct replayRecord record;
+
+    if (!nextReplay(&record)) {
+        finishReplay();
+        return;
+    }
+    changeAttitude(record.roll, record.pitch);
+    changeBrightness(record.brightness);
+    requestFrame();
+}
+
+/* Applies every record that is due at the replay clock, asks for one frame for
+ * all of them and sleeps until the next one is due.
+ */
+static void replayTimer(int value) {
+    struct replayRecord record;
+    double due = (monotonicSeconds() - replayStart) * replaySpeed;
+    int changed = 0;
+
+    while (peekReplay(&record) && record.time <= due) {
+        nextReplay(&record);
+        changed |= changeAttitude(record.roll, record.pitch);
+        changed |= changeBrightness(record.brightness);
+    }
+    if (changed)
+        requestFrame();
+    if (!peekReplay(&record)) {
+        finishReplay();
+        return;
+    }
+    glutTimerFunc((unsigned int)((record.time - due) / replaySpeed * 1000.0), replayTimer, 0);
+}
+
+/* Plays back the log opened with openReplay() through changeAttitude() and
+ * changeBrightness(), speed times as fast as it was recorded, or one record per
+ * frame with speed 0.
+ */
+void startReplay(double speed) {
+    replaySpeed = speed;
+    replayStart = monotonicSeconds();
+    if (speed > 0.0) {
+        glutTimerFunc(0, replayTimer, 0);
+    }
+    else {
+        replayPerFrame = 1;
+        advanceReplay();
+    }
+}
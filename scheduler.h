@@ -0,0 +1,43 @@
+
+/* Demand-driven frame scheduling for the GLUT window.  Nothing is drawn unless
+ * something visible changed: input handlers call requestFrame() after they
+ * actually changed the attitude or brightness, and the telemetry watcher does the
+ * same for new samples.  Requests that arrive while a frame is already pending
+ * are folded into that frame.  With nothing to draw and no telemetry source
+ * there are no timers at all, so an idle panel uses no CPU or GPU time.
+ *
+ * Frames are paced from the previous swap:
+ *
+ *    PACE_VSYNC    swap interval 1, the swap waits for vertical blank; falls back to
+ *                  PACE_RATE at 60 fps if the swap interval cannot be set
+ *    PACE_RATE     at most targetFps frames per second, a frame requested earlier
+ *                  than 1 / targetFps after the previous swap is delayed to that time
+ *    PACE_NONE     draw as soon as requested
+ *
+ * With --watch-textures, watchTextureReloads() checks every TEXTURE_POLL_MS
+ * for a changed texture image (see texture.h) and asks for a frame to show it.
+ *
+ * startReplay() plays back an attitude log (see recording.h) on GLUT timers.
+ * Records that fall due together are drawn in one frame.
+ *
+ * scanoutLead() estimates how long a frame takes from display() to the panel;
+ * the attitude prediction (see attitude.h) aims that far ahead.
+ *
+ * display() must call frameSwapped() right after glutSwapBuffers().
+ */
+
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+enum pacingMode { PACE_NONE, PACE_VSYNC, PACE_RATE };
+
+void initScheduler(enum pacingMode mode, double targetFps);
+void requestFrame();
+void setContinuous(int continuous);
+void watchTelemetry();
+void watchTextureReloads();
+void frameSwapped();
+double scanoutLead();
+void startReplay(double speed);
+
+#endif
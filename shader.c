@@ -0,0 +1,99 @@
+
+/* GLSL program helpers, see shader.h. */
+
+#define GL_GLEXT_PROTOTYPES
+
+#include <GL/gl.h>
+#include <GL/glext.h>
+#include <stdio.h>
+#include <string.h>
+#include "shader.h"
+
+/* Compiles lpSource with lpDefines (may be NULL) inserted after its first line. */
+static GLuint compileShaderWithDefines(GLenum type, const char* lpSource, const char* lpDefines, const char* lpName) {
+    GLuint shader = glCreateShader(type);
+    const char* lpBody = strchr(lpSource, '\n');
+    const char* lpParts[3];
+    GLint lengths[3];
+    GLint status;
+    char log[2048];
+
+    if (lpDefines == NULL || lpBody == NULL) {
+        glShaderSource(shader, 1, &lpSource, NULL);
+    }
+    else {
+        lpParts[0] = lpSource;
+        lengths[0] = (GLint)(lpBody + 1 - lpSource);
+        lpParts[1] = lpDefines;
+        lengths[1] = (GLint)strlen(lpDefines);
+        lpParts[2] = lpBody + 1;
+        lengths[2] = (GLint)strlen(lpBody + 1);
+        glShaderSource(shader, 3, lpParts, lengths);
+    }
+    glCompileShader(shader);
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+    if (!status) {
+        glGetShaderInfoLog(shader, sizeof(log), NULL, log);
+        fprintf(stderr, "%s:%u: Failed to compile %s %s shader:\n%s\n", __FILE__, __LINE__, lpName,
+                type == GL_VERTEX_SHADER ? "vertex" : type == GL_GEOMETRY_SHADER ? "geometry" : "fragment", log);
+        glDeleteShader(shader);
+        return 0;
+    }
+    return shader;
+}
+
+GLuint compileShader(GLenum type, const char* lpSource, const char* lpName) {
+    return compileShaderWithDefines(type, lpSource, NULL, lpName);
+}
+
+/* Compiles both stages and links them.  Attribute locations are expected to be
+ * fixed in the sources with layout(location = n).
+ */
+GLuint buildProgram(const char* lpVertexSource, const char* lpFragmentSource, const char* lpName) {
+    return buildProgramVariant(lpVertexSource, lpFragmentSource, NULL, lpName);
+}
+
+GLuint buildProgramVariant(const char* lpVertexSource, const char* lpFragmentSource, const char* lpDefines,
+                           const char* lpName) {
+    return buildGeometryProgram(lpVertexSource, NULL, lpFragmentSource, lpDefines, lpName);
+}
+
+/* Like buildProgramVariant(), with a geometry shader between the two stages
+ * unless lpGeometrySource is NULL.
+ */
+GLuint buildGeometryProgram(const char* lpVertexSource, const char* lpGeometrySource, const char* lpFragmentSource,
+                            const char* lpDefines, const char* lpName) {
+    GLuint vertexShader, geometryShader = 0, fragmentShader, program;
+    GLint status;
+    char log[2048];
+
+    vertexShader = compileShaderWithDefines(GL_VERTEX_SHADER, lpVertexSource, lpDefines, lpName);
+    if (lpGeometrySource != NULL)
+        geometryShader = compileShaderWithDefines(GL_GEOMETRY_SHADER, lpGeometrySource, lpDefines, lpName);
+    fragmentShader = compileShaderWithDefines(GL_FRAGMENT_SHADER, lpFragmentSource, lpDefines, lpName);
+    if (vertexShader == 0 || (lpGeometrySource != NULL && geometryShader == 0) || fragmentShader == 0) {
+        glDeleteShader(vertexShader);
+        glDeleteShader(geometryShader);
+        glDeleteShader(fragmentShader);
+        return 0;
+    }
+
+    program = glCreateProgram();
+    glAttachShader(program, vertexShader);
+    if (geometryShader != 0)
+        glAttachShader(program, geometryShader);
+    glAttachShader(program, fragmentShader);
+    glLinkProgram(program);
+    glDeleteShader(vertexShader);   // only flagged; they live as long as the program
+    glDeleteShader(geometryShader);
+    glDeleteShader(fragmentShader);
+
+    glGetProgramiv(program, GL_LINK_STATUS, &status);
+    if (!status) {
+        glGetProgramInfoLog(program, sizeof(log), NULL, log);
+        fprintf(stderr, "%s:%u: Failed to link %s program:\n%s\n", __FILE__, __LINE__, lpName, log);
+        glDeleteProgram(program);
+        return 0;
+    }
+    return program;
+}
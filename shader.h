@@ -0,0 +1,22 @@
+
+/* Compiling and linking GLSL programs.  Errors are reported on stderr with the
+ * driver's info log, and 0 is returned instead of a program name.
+ *
+ * buildProgramVariant() inserts lpDefines (for example "#define WALL\n") after the
+ * #version line of both sources, so one source can serve several programs.
+ * buildGeometryProgram() adds a geometry shader stage.
+ */
+
+#ifndef SHADER_H
+#define SHADER_H
+
+#include <GL/gl.h>
+
+GLuint compileShader(GLenum type, const char* lpSource, const char* lpName);
+GLuint buildProgram(const char* lpVertexSource, const char* lpFragmentSource, const char* lpName);
+GLuint buildProgramVariant(const char* lpVertexSource, const char* lpFragmentSource, const char* lpDefines,
+                           const char* lpName);
+GLuint buildGeometryProgram(const char* lpVertexSource, const char* lpGeometrySource, const char* lpFragmentSource,
+                            const char* lpDefines, const char* lpName);
+
+#endif
@@ -0,0 +1,440 @@
+
+/* Software renderer, see soft.h. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "marks.h"
+#include "soft.h"
+
+#define SOFT_MAX_THREADS 64
+#define RING_INNER 0.8f
+#define RING_OUTER 1.0f
+#define LIGHT_AMBIENT 0.3f          // scene ambient 0.2 plus light ambient 0.1, see initGL()
+#define LIGHT_DIFFUSE 0.75f
+#define WHITE 0x00ffffffu
+
+typedef float v4f __attribute__((vector_size(16)));
+typedef int32_t v4i __attribute__((vector_size(16)));
+
+struct softSegment {
+    float x0, y0, x1, y1;           // pixel coordinates, pixel centers at + 0.5
+    float halfWidth;
+    int left, top, right, bottom;   // pixels the line can touch, inclusive
+};
+
+static struct softTexture sphereTexture, ringTexture;
+static struct softSegment* lpSegments;
+static int maxSegments;
+
+// Frame state, set by renderSoft() before the tiles are handed out.
+static struct softFramebuffer* lpTarget;
+static float ballRows[3][3];        // object coordinates = ballRows * eye coordinates
+static float ringCos, ringSin;
+static int segmentCount;
+static int tileColumns, tileCount;
+
+// Thread pool.  Tiles are taken with nextTile; tilesLeft and frameGeneration are
+// guarded by lock.
+static pthread_t threads[SOFT_MAX_THREADS];
+static int workerCount;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t frameStart, frameDone;
+static unsigned int frameGeneration;
+static int tilesLeft;
+static int stopping;
+static atomic_int nextTile;
+
+// ------------------------------- vector helpers -------------------------------
+
+static inline v4f splat(float f) {
+    return (v4f){ f, f, f, f };
+}
+
+static inline v4f select4(v4i mask, v4f a, v4f b) {
+    return (v4f)((mask & (v4i)a) | (~mask & (v4i)b));
+}
+
+static inline v4f min4(v4f a, v4f b) {
+    return select4(a < b, a, b);
+}
+
+static inline v4f max4(v4f a, v4f b) {
+    return select4(a > b, a, b);
+}
+
+static inline v4f abs4(v4f a) {
+    return (v4f)((v4i)a & 0x7fffffff);
+}
+
+static inline v4f sqrt4(v4f a) {
+    v4f r;
+    int k;
+    for (k = 0; k < 4; k++)
+        r[k] = sqrtf(a[k]);
+    return r;
+}
+
+static inline int any4(v4i mask) {
+    return (mask[0] | mask[1] | mask[2] | mask[3]) != 0;
+}
+
+/* atan2(y, x) to about 1e-5 radians: a minimax polynomial for atan on [0, 1]
+ * and the octant folded back in.
+ */
+static inline v4f atan24(v4f y, v4f x) {
+    v4f ax = abs4(x), ay = abs4(y);
+    v4f a = min4(ax, ay) / max4(max4(ax, ay), splat(1e-30f));
+    v4f s = a * a;
+    v4f r = (((((-0.01172120f * s + 0.05265332f) * s - 0.11643287f) * s + 0.19354346f) * s
+              - 0.33262347f) * s + 0.99997726f) * a;
+
+    r = select4(ay > ax, (float)M_PI_2 - r, r);
+    r = select4(x < 0.0f, (float)M_PI - r, r);
+    return select4(y < 0.0f, -r, r);
+}
+
+/* Bilinear GL_REPEAT sample of lpTexture at (s, t), scaled by light, packed
+ * into 0x00RRGGBB.
+ */
+static inline v4i sample4(const struct softTexture* lpTexture, v4f s, v4f t, v4f light) {
+    int w = lpTexture->width, h = lpTexture->height;
+    const uint32_t* lpTexels = lpTexture->lpTexels;
+    v4f fx = s * (float)w - 0.5f + (float)w;   // positive, so truncation is floor
+    v4f fy = min4(max4(t * (float)h - 0.5f, splat(0.0f)), splat((float)(h - 1)));
+    v4i ix = __builtin_convertvector(fx, v4i);
+    v4i iy = __builtin_convertvector(fy, v4i);
+    v4f ax = fx - __builtin_convertvector(ix, v4f);
+    v4f ay = fy - __builtin_convertvector(iy, v4f);
+    v4i ix0, ix1, row0, row1;
+    v4i c00, c10, c01, c11;
+    v4f top, bottom, channel;
+    v4i result = { 0, 0, 0, 0 };
+    int k, shift;
+
+    ix0 = ix - ((ix >= w) & w);
+    ix1 = ix0 + 1;
+    ix1 &= ~(ix1 == w);
+    row0 = iy * w;
+    row1 = row0 + ((iy < h - 1) & w);
+
+    for (k = 0; k < 4; k++) {
+        c00[k] = lpTexels[row0[k] + ix0[k]];
+        c10[k] = lpTexels[row0[k] + ix1[k]];
+        c01[k] = lpTexels[row1[k] + ix0[k]];
+        c11[k] = lpTexels[row1[k] + ix1[k]];
+    }
+    for (shift = 0; shift < 24; shift += 8) {
+        top = __builtin_convertvector((c00 >> shift) & 0xff, v4f);
+        top += (__builtin_convertvector((c10 >> shift) & 0xff, v4f) - top) * ax;
+        bottom = __builtin_convertvector((c01 >> shift) & 0xff, v4f);
+        bottom += (__builtin_convertvector((c11 >> shift) & 0xff, v4f) - bottom) * ax;
+        channel = (top + (bottom - top) * ay) * light + 0.5f;
+        result |= __builtin_convertvector(channel, v4i) << shift;
+    }
+    return result;
+}
+
+// ------------------------------- ball and ring --------------------------------
+
+/* The front of the ball at eye coordinates (x, y): texture coordinates of the
+ * point of the sphere mesh there and its two-sided lighting.
+ */
+static inline v4i shadeBall(v4f x, v4f y, v4f r2) {
+    v4f z = -sqrt4(max4(BALL_RADIUS * BALL_RADIUS - r2, splat(0.0f)));
+    v4f ox = ballRows[0][0] * x + ballRows[0][1] * y + ballRows[0][2] * z;
+    v4f oy = ballRows[1][0] * x + ballRows[1][1] * y + ballRows[1][2] * z;
+    v4f oz = ballRows[2][0] * x + ballRows[2][1] * y + ballRows[2][2] * z;
+    v4f theta = atan24(ox, oy);     // gluSphere(): x = sin(theta), y = cos(theta)
+    v4f rho = atan24(sqrt4(ox * ox + oy * oy), oz);
+    v4f light = min4(LIGHT_AMBIENT + LIGHT_DIFFUSE / BALL_RADIUS * abs4(z), splat(1.0f));
+
+    theta = select4(theta < 0.0f, theta + (float)(2 * M_PI), theta);
+    return sample4(&sphereTexture, 1.0f - theta * (float)(0.5 / M_PI), 1.0f - rho * (float)(1.0 / M_PI), light);
+}
+
+/* The ring faces the light, so it shows its texture unchanged. */
+static inline v4i shadeRing(v4f x, v4f y) {
+    v4f ox = ringCos * x + ringSin * y;
+    v4f oy = ringCos * y - ringSin * x;
+    return sample4(&ringTexture, ox * (0.5f / RING_OUTER) + 0.5f, oy * (0.5f / RING_OUTER) + 0.5f, splat(1.0f));
+}
+
+/* Shades n <= 4 pixels of one row starting at eye coordinate x. */
+static void shadePixels(uint32_t* lpOut, int n, float x, float dx, float y) {
+    v4f vx = x + (v4f){ 0.0f, 1.0f, 2.0f, 3.0f } * dx;
+    v4f vy = splat(y);
+    v4f r2 = vx * vx + vy * vy;
+    v4i ring = (r2 >= RING_INNER * RING_INNER) & (r2 <= RING_OUTER * RING_OUTER);
+    v4i ball = (r2 < BALL_RADIUS * BALL_RADIUS) & ~ring;
+    v4i color = { 0, 0, 0, 0 };
+
+    if (any4(ball))
+        color = ball & shadeBall(vx, vy, r2);
+    if (any4(ring))
+        color = (ring & shadeRing(vx, vy)) | (~ring & color);
+    memcpy(lpOut, &color, n * sizeof(uint32_t));
+}
+
+// ------------------------------- overlay lines --------------------------------
+
+/* Places template vertex lpVertex of instance lpInstance like the overlay vertex
+ * shader does.  Returns 0 for ladder rungs out of range.
+ */
+static int placeVertex(const struct markInstance* lpInstance, const float* lpVertex, float roll, float pitch,
+                       float* lpX, float* lpY) {
+    float x = lpVertex[0], y = lpVertex[1] * lpInstance->yScale, angle = 0.0f, delta, c, s;
+
+    switch ((int)lpInstance->mode) {
+        case MODE_FIXED:
+            angle = lpInstance->angle;
+            break;
+        case MODE_ROLL:
+            angle = lpInstance->angle + roll;
+            break;
+        case MODE_PITCH:
+            delta = lpInstance->pitch - pitch + 180.0f;
+            delta = delta - 360.0f * floorf(delta / 360.0f) - 180.0f;
+            if (fabsf(delta) > LADDER_RANGE)
+                return 0;
+            y += sinf(delta * (float)M_PI / 180.0f) * sqrtf(fmaxf(BALL_RADIUS * BALL_RADIUS - x * x, 0.0f));
+            angle = roll;
+            break;
+    }
+    c = cosf(angle * (float)M_PI / 180.0f);
+    s = sinf(angle * (float)M_PI / 180.0f);
+    *lpX = c * x - s * y;
+    *lpY = s * x + c * y;
+    return 1;
+}
+
+static void addSegment(float x0, float y0, float x1, float y1, float lineWidth) {
+    struct softSegment* lpSegment;
+    float w = (float)lpTarget->width, h = (float)lpTarget->height;
+
+    if (segmentCount >= maxSegments)
+        return;
+    lpSegment = &lpSegments[segmentCount++];
+    lpSegment->x0 = (x0 + 1.0f) * 0.5f * w;
+    lpSegment->y0 = (1.0f - y0) * 0.5f * h;
+    lpSegment->x1 = (x1 + 1.0f) * 0.5f * w;
+    lpSegment->y1 = (1.0f - y1) * 0.5f * h;
+    lpSegment->halfWidth = lineWidth * 0.5f;
+    lpSegment->left = (int)floorf(fminf(lpSegment->x0, lpSegment->x1) - lpSegment->halfWidth);
+    lpSegment->right = (int)ceilf(fmaxf(lpSegment->x0, lpSegment->x1) + lpSegment->halfWidth);
+    lpSegment->top = (int)floorf(fminf(lpSegment->y0, lpSegment->y1) - lpSegment->halfWidth);
+    lpSegment->bottom = (int)ceilf(fmaxf(lpSegment->y0, lpSegment->y1) + lpSegment->halfWidth);
+}
+
+/* Adds every line of instances [first, first + count) of a template. */
+static void addTemplate(int firstVertex, int vertexCount, int firstInstance, int instanceCount, float lineWidth,
+                        float roll, float pitch) {
+    float x0, y0, x1, y1;
+    int i, v;
+
+    for (i = firstInstance; i < firstInstance + instanceCount; i++) {
+        for (v = firstVertex; v + 1 < firstVertex + vertexCount; v += 2) {
+            if (placeVertex(&markInstances[i], markVertices[v], roll, pitch, &x0, &y0) &&
+                    placeVertex(&markInstances[i], markVertices[v + 1], roll, pitch, &x1, &y1))
+                addSegment(x0, y0, x1, y1, lineWidth);
+        }
+    }
+}
+
+static void buildSegments(float roll, float pitch) {
+    int t;
+
+    segmentCount = 0;
+    addTemplate(symbolFirst, symbolCount, 0, 1, SYMBOL_LINE_WIDTH, roll, pitch);
+    for (t = 0; t < TEMPLATE_COUNT; t++)
+        addTemplate(markRanges[t].first, markRanges[t].count, markRanges[t].baseInstance,
+                    markRanges[t].instanceCount, MARK_LINE_WIDTH, roll, pitch);
+}
+
+/* Draws the parts of all lines that fall into the given pixel rectangle
+ * (right and bottom exclusive): every pixel whose center lies within half the
+ * line width of the segment.
+ */
+static void drawSegments(int left, int top, int right, int bottom) {
+    uint32_t* lpPixels = lpTarget->lpPixels;
+    int stride = lpTarget->width;
+    int i, x, y, x0, x1, y0, y1;
+
+    for (i = 0; i < segmentCount; i++) {
+        const struct softSegment* lpSegment = &lpSegments[i];
+        float dx = lpSegment->x1 - lpSegment->x0, dy = lpSegment->y1 - lpSegment->y0;
+        float lengthSquared = dx * dx + dy * dy;
+        float limit = lpSegment->halfWidth * lpSegment->halfWidth;
+
+        x0 = lpSegment->left > left ? lpSegment->left : left;
+        x1 = lpSegment->right < right ? lpSegment->right : right;
+        y0 = lpSegment->top > top ? lpSegment->top : top;
+        y1 = lpSegment->bottom < bottom ? lpSegment->bottom : bottom;
+        for (y = y0; y < y1; y++) {
+            float py = y + 0.5f - lpSegment->y0;
+            for (x = x0; x < x1; x++) {
+                float px = x + 0.5f - lpSegment->x0;
+                float u = lengthSquared > 0.0f ? (px * dx + py * dy) / lengthSquared : 0.0f;
+                float ex, ey;
+                u = u < 0.0f ? 0.0f : u > 1.0f ? 1.0f : u;
+                ex = px - u * dx;
+                ey = py - u * dy;
+                if (ex * ex + ey * ey <= limit)
+                    lpPixels[y * stride + x] = WHITE;
+            }
+        }
+    }
+}
+
+// ------------------------------- tiles and threads ----------------------------
+
+static void drawTile(int tile) {
+    int width = lpTarget->width, height = lpTarget->height;
+    int left = tile % tileColumns * SOFT_TILE, top = tile / tileColumns * SOFT_TILE;
+    int right = left + SOFT_TILE < width ? left + SOFT_TILE : width;
+    int bottom = top + SOFT_TILE < height ? top + SOFT_TILE : height;
+    float dx = 2.0f / width, dy = 2.0f / height;
+    float x0 = (left + 0.5f) * dx - 1.0f;
+    float nearX, nearY;
+    int x, y;
+
+    // Nearest point of the tile to the center; tiles beyond the ring are background.
+    nearX = fmaxf(fmaxf(left * dx - 1.0f, 1.0f - right * dx), 0.0f);
+    nearY = fmaxf(fmaxf(1.0f - bottom * dy, top * dy - 1.0f), 0.0f);
+    for (y = top; y < bottom; y++) {
+        uint32_t* lpRow = lpTarget->lpPixels + y * width;
+        if (nearX * nearX + nearY * nearY > RING_OUTER * RING_OUTER) {
+            memset(lpRow + left, 0, (right - left) * sizeof(uint32_t));
+            continue;
+        }
+        for (x = left; x < right; x += 4)
+            shadePixels(lpRow + x, right - x < 4 ? right - x : 4, x0 + (x - left) * dx, dx, 1.0f - (y + 0.5f) * dy);
+    }
+    drawSegments(left, top, right, bottom);
+}
+
+/* Draws tiles until none are left. */
+static void drawTiles() {
+    int tile, done = 0;
+
+    while ((tile = atomic_fetch_add(&nextTile, 1)) < tileCount) {
+        drawTile(tile);
+        done++;
+    }
+    if (done > 0) {
+        pthread_mutex_lock(&lock);
+        tilesLeft -= done;
+        if (tilesLeft == 0)
+            pthread_cond_signal(&frameDone);
+        pthread_mutex_unlock(&lock);
+    }
+}
+
+static void* runWorker(void* lpArgument) {
+    unsigned int seen = 0;
+
+    (void)lpArgument;
+    for (;;) {
+        pthread_mutex_lock(&lock);
+        while (frameGeneration == seen && !stopping)
+            pthread_cond_wait(&frameStart, &lock);
+        seen = frameGeneration;
+        if (stopping) {
+            pthread_mutex_unlock(&lock);
+            break;
+        }
+        pthread_mutex_unlock(&lock);
+        drawTiles();
+    }
+    return NULL;
+}
+
+/* Starts threadCount - 1 workers (the caller of renderSoft() is the last
+ * thread).  The textures must stay valid until stopSoftRenderer().  buildMarks()
+ * must have been called.  Returns 0 on failure.
+ */
+int initSoftRenderer(int threadCount, const struct softTexture* lpSphere, const struct softTexture* lpRing) {
+    int t;
+
+    sphereTexture = *lpSphere;
+    ringTexture = *lpRing;
+
+    maxSegments = symbolCount / 2;
+    for (t = 0; t < TEMPLATE_COUNT; t++)
+        maxSegments += markRanges[t].count / 2 * markRanges[t].instanceCount;
+    if ((lpSegments = (struct softSegment*)malloc(sizeof(struct softSegment) * maxSegments)) == NULL) {
+        fprintf(stderr, "%s:%u: Allocation of lpSegments failed\n", __FILE__, __LINE__);
+        return 0;
+    }
+
+    pthread_cond_init(&frameStart, NULL);
+    pthread_cond_init(&frameDone, NULL);
+    stopping = 0;
+    if (threadCount > SOFT_MAX_THREADS)
+        threadCount = SOFT_MAX_THREADS;
+    for (workerCount = 0; workerCount < threadCount - 1; workerCount++) {
+        if (pthread_create(&threads[workerCount], NULL, runWorker, NULL) != 0) {
+            fprintf(stderr, "%s:%u: Failed to start render thread %d\n", __FILE__, __LINE__, workerCount + 1);
+            break;
+        }
+    }
+    return 1;
+}
+
+/* Draws one frame into lpFramebuffer and returns when it is complete. */
+void renderSoft(struct softFramebuffer* lpFramebuffer, float rollDegrees, float pitchDegrees) {
+    float cz = cosf((rollDegrees + 90.0f) * (float)M_PI / 180.0f);
+    float sz = sinf((rollDegrees + 90.0f) * (float)M_PI / 180.0f);
+    float cy = cosf(pitchDegrees * (float)M_PI / 180.0f);
+    float sy = sinf(pitchDegrees * (float)M_PI / 180.0f);
+
+    lpTarget = lpFramebuffer;
+
+    // The transpose of the ball's rotation Rz(roll + 90) Ry(pitch) Rx(90), see wall.c.
+    ballRows[0][0] = cz * cy;
+    ballRows[0][1] = sz * cy;
+    ballRows[0][2] = -sy;
+    ballRows[1][0] = cz * sy;
+    ballRows[1][1] = sz * sy;
+    ballRows[1][2] = cy;
+    ballRows[2][0] = sz;
+    ballRows[2][1] = -cz;
+    ballRows[2][2] = 0.0f;
+    ringCos = cosf(rollDegrees * (float)M_PI / 180.0f);
+    ringSin = sinf(rollDegrees * (float)M_PI / 180.0f);
+    buildSegments(rollDegrees, pitchDegrees);
+
+    tileColumns = (lpFramebuffer->width + SOFT_TILE - 1) / SOFT_TILE;
+    tileCount = tileColumns * ((lpFramebuffer->height + SOFT_TILE - 1) / SOFT_TILE);
+
+    pthread_mutex_lock(&lock);
+    atomic_store(&nextTile, 0);
+    tilesLeft = tileCount;
+    frameGeneration++;
+    pthread_cond_broadcast(&frameStart);
+    pthread_mutex_unlock(&lock);
+
+    drawTiles();
+
+    pthread_mutex_lock(&lock);
+    while (tilesLeft > 0)
+        pthread_cond_wait(&frameDone, &lock);
+    pthread_mutex_unlock(&lock);
+}
+
+void stopSoftRenderer() {
+    int i;
+
+    pthread_mutex_lock(&lock);
+    stopping = 1;
+    pthread_cond_broadcast(&frameStart);
+    pthread_mutex_unlock(&lock);
+    for (i = 0; i < workerCount; i++)
+        pthread_join(threads[i], NULL);
+    workerCount = 0;
+    free(lpSegments);
+    lpSegments = NULL;
+}
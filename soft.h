@@ -0,0 +1,41 @@
+
+/* Software renderer for panels without a usable GL driver.  It draws the same
+ * picture as display() (the lit, textured ball at the current roll and pitch,
+ * the roll ring and the white overlay marks of marks.h) into a memory
+ * framebuffer of 0x00RRGGBB pixels, the layout of a 32 bpp Linux framebuffer.
+ *
+ * With the orthographic view of the GL path, the ball and the ring need no
+ * triangles: every pixel knows which point of the ball or ring it shows, so the
+ * texture coordinates and lighting are computed per pixel, four pixels at a time
+ * with GCC vector extensions (SSE on x86, NEON on ARM).  The frame is cut into
+ * SOFT_TILE x SOFT_TILE tiles that a pool of threads takes one by one; every
+ * tile draws its background, ball, ring and the overlay lines that cross it,
+ * so threads never share a pixel.
+ *
+ * Textures are sampled bilinearly from a single level, which is what the GL
+ * path shows over most of the ball; only the very edge of the ball, where GL
+ * would move to smaller mip levels, can shimmer a little.
+ */
+
+#ifndef SOFT_H
+#define SOFT_H
+
+#include <stdint.h>
+
+#define SOFT_TILE 64
+
+struct softTexture {
+    int width, height;
+    uint32_t* lpTexels;         // 0x00RRGGBB, row 0 at t = 0 like a GL texture
+};
+
+struct softFramebuffer {
+    int width, height;
+    uint32_t* lpPixels;         // 0x00RRGGBB, top row first
+};
+
+int initSoftRenderer(int threadCount, const struct softTexture* lpSphere, const struct softTexture* lpRing);
+void renderSoft(struct softFramebuffer* lpFramebuffer, float rollDegrees, float pitchDegrees);
+void stopSoftRenderer();
+
+#endif
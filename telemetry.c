@@ -0,0 +1,316 @@
+
+/* Attitude telemetry input, see telemetry.h. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include "telemetry.h"
+
+#define TELEMETRY_BUFFER 4096
+
+enum sourceKind { SOURCE_STDIN, SOURCE_SOCKET, SOURCE_FILE };
+
+// The newest sample of a vehicle under a sequence lock: the reader thread makes
+// sequence odd while it writes the sample and even again after, and
+// pollVehicleTelemetry() retries a copy that overlapped a write.  Only the reader
+// thread writes sample, sequence and receivedSamples, only
+// pollVehicleTelemetry() writes taken and droppedSamples.
+struct vehicleSlot {
+    struct attitudeSample sample;
+    atomic_uint sequence;
+    atomic_uint taken;              // sequence of the sample last polled
+};
+
+static struct vehicleSlot vehicles[TELEMETRY_MAX_VEHICLES];
+static atomic_ulong droppedSamples;
+static atomic_ulong receivedSamples;
+
+static enum sourceKind sourceKind;
+static char* lpSourcePath;
+static int sourceFd = -1;
+static int wakePipe[2] = { -1, -1 };   // written by stopTelemetry() to end the thread
+static pthread_t readerThread;
+static int running;
+
+static double monotonicSeconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// ------------------------------- latest sample --------------------------------
+
+/* Replaces the newest sample of vehicle. */
+static void pushSample(int vehicle, const struct attitudeSample* lpSample) {
+    struct vehicleSlot* lpSlot = &vehicles[vehicle];
+    unsigned int sequence = atomic_load_explicit(&lpSlot->sequence, memory_order_relaxed);
+
+    atomic_store_explicit(&lpSlot->sequence, sequence + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    lpSlot->sample = *lpSample;
+    atomic_store_explicit(&lpSlot->sequence, sequence + 2, memory_order_release);
+    atomic_fetch_add_explicit(&receivedSamples, 1, memory_order_relaxed);
+}
+
+/* Copies the newest sample of vehicle into lpSample and counts the ones it
+ * replaced since the last call as dropped.  Returns 0, leaving lpSample alone,
+ * if nothing arrived since the last call or vehicle is out of range.
+ */
+int pollVehicleTelemetry(int vehicle, struct attitudeSample* lpSample) {
+    struct vehicleSlot* lpSlot;
+    unsigned int taken, before, after;
+
+    if (vehicle < 0 || vehicle >= TELEMETRY_MAX_VEHICLES)
+        return 0;
+    lpSlot = &vehicles[vehicle];
+    taken = atomic_load_explicit(&lpSlot->taken, memory_order_relaxed);
+    do {
+        before = atomic_load_explicit(&lpSlot->sequence, memory_order_acquire);
+        if (before == taken)
+            return 0;
+        *lpSample = lpSlot->sample;
+        atomic_thread_fence(memory_order_acquire);
+        after = atomic_load_explicit(&lpSlot->sequence, memory_order_relaxed);
+    } while ((before & 1) != 0 || before != after);
+    atomic_fetch_add_explicit(&droppedSamples, (before - taken) / 2 - 1, memory_order_relaxed);
+    atomic_store_explicit(&lpSlot->taken, before, memory_order_relaxed);
+    return 1;
+}
+
+/* The same for vehicle 0, this station's own attitude. */
+int pollTelemetry(struct attitudeSample* lpSample) {
+    return pollVehicleTelemetry(0, lpSample);
+}
+
+/* Number of samples received, of all vehicles. */
+unsigned long telemetryReceived() {
+    return atomic_load_explicit(&receivedSamples, memory_order_relaxed);
+}
+
+/* Number of samples replaced before pollTelemetry() took them. */
+unsigned long telemetryDropped() {
+    return atomic_load_explicit(&droppedSamples, memory_order_relaxed);
+}
+
+// ------------------------------- reader thread --------------------------------
+
+/* Parses "TIME ROLL PITCH YAW", "TIME ROLL PITCH" or "ROLL PITCH", each with an
+ * optional "Vn " in front, and pushes the sample for vehicle n (or 0).
+ */
+static void parseLine(const char* lpLine, double receiveTime) {
+    struct attitudeSample sample;
+    double values[4];
+    const char* lpCursor = lpLine;
+    char* lpEnd;
+    long vehicle = 0;
+    int count = 0;
+
+    while (*lpCursor == ' ' || *lpCursor == '\t')
+        lpCursor++;
+    if (*lpCursor == 'V') {
+        vehicle = strtol(lpCursor + 1, &lpEnd, 10);
+        if (lpEnd == lpCursor + 1 || (*lpEnd != ' ' && *lpEnd != '\t') || vehicle < 0 ||
+                vehicle >= TELEMETRY_MAX_VEHICLES)
+            return;
+        lpCursor = lpEnd;
+    }
+    while (count < 4) {
+        values[count] = strtod(lpCursor, &lpEnd);
+        if (lpEnd == lpCursor)
+            break;
+        lpCursor = lpEnd;
+        count++;
+    }
+    while (*lpCursor == ' ' || *lpCursor == '\t' || *lpCursor == '\r')
+        lpCursor++;
+    if (count < 2 || *lpCursor != '\0')
+        return;
+
+    sample.receiveTime = receiveTime;
+    sample.sourceTime = count >= 3 ? values[0] : receiveTime;
+    sample.roll = (float)values[count == 2 ? 0 : 1];
+    sample.pitch = (float)values[count == 2 ? 1 : 2];
+    sample.yaw = count == 4 ? (float)values[3] : 0.0f;
+    pushSample((int)vehicle, &sample);
+}
+
+/* Parses the complete lines in lpBuffer and returns the number of bytes used;
+ * a trailing partial line is left for the next read.
+ */
+static size_t parseLines(char* lpBuffer, size_t length, double receiveTime) {
+    size_t start = 0, i;
+
+    for (i = 0; i < length; i++) {
+        if (lpBuffer[i] == '\n') {
+            lpBuffer[i] = '\0';
+            parseLine(lpBuffer + start, receiveTime);
+            start = i + 1;
+        }
+    }
+    return start;
+}
+
+static int openSource() {
+    struct sockaddr_un address;
+
+    switch (sourceKind) {
+    case SOURCE_STDIN:
+        sourceFd = STDIN_FILENO;
+        break;
+    case SOURCE_SOCKET:
+        if (strlen(lpSourcePath) >= sizeof(address.sun_path)) {
+            fprintf(stderr, "%s:%u: Socket path %s is too long\n", __FILE__, __LINE__, lpSourcePath);
+            return 0;
+        }
+        memset(&address, 0, sizeof(address));
+        address.sun_family = AF_UNIX;
+        strcpy(address.sun_path, lpSourcePath);
+        sourceFd = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+        if (sourceFd < 0) {
+            fprintf(stderr, "%s:%u: Failed to create socket: %s\n", __FILE__, __LINE__, strerror(errno));
+            return 0;
+        }
+        unlink(lpSourcePath);
+        if (bind(sourceFd, (struct sockaddr*)&address, sizeof(address)) != 0) {
+            fprintf(stderr, "%s:%u: Failed to bind %s: %s\n", __FILE__, __LINE__, lpSourcePath, strerror(errno));
+            close(sourceFd);
+            sourceFd = -1;
+            return 0;
+        }
+        break;
+    case SOURCE_FILE:
+        // Non-blocking, so opening a FIFO does not wait for a writer.
+        sourceFd = open(lpSourcePath, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+        if (sourceFd < 0) {
+            fprintf(stderr, "%s:%u: Failed to open %s: %s\n", __FILE__, __LINE__, lpSourcePath, strerror(errno));
+            return 0;
+        }
+        break;
+    }
+    return 1;
+}
+
+static void closeSource() {
+    if (sourceFd >= 0 && sourceFd != STDIN_FILENO)
+        close(sourceFd);
+    sourceFd = -1;
+}
+
+static void* readTelemetry(void* lpArg) {
+    char buffer[TELEMETRY_BUFFER];
+    size_t length = 0;
+    struct stat st;
+    int isFifo = sourceKind == SOURCE_FILE && fstat(sourceFd, &st) == 0 && S_ISFIFO(st.st_mode);
+
+    for (;;) {
+        struct pollfd fds[2] = { { sourceFd, POLLIN, 0 }, { wakePipe[0], POLLIN, 0 } };
+        ssize_t n;
+
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+        if (fds[1].revents)
+            break;
+        if (!fds[0].revents)
+            continue;
+
+        if (sourceKind == SOURCE_SOCKET) {
+            // One datagram per read; a sample never spans datagrams.
+            n = recv(sourceFd, buffer, sizeof(buffer) - 1, 0);
+            if (n > 0) {
+                if (buffer[n - 1] != '\n')
+                    buffer[n++] = '\n';
+                parseLines(buffer, n, monotonicSeconds());
+            }
+            continue;
+        }
+
+        n = read(sourceFd, buffer + length, sizeof(buffer) - 1 - length);
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EINTR)
+                continue;
+            fprintf(stderr, "%s:%u: Telemetry read failed: %s\n", __FILE__, __LINE__, strerror(errno));
+            break;
+        }
+        if (n == 0) {
+            if (!isFifo)
+                break;
+            // The writer went away; wait for the next one.
+            closeSource();
+            length = 0;
+            if (!openSource())
+                break;
+            continue;
+        }
+        length += n;
+        n = parseLines(buffer, length, monotonicSeconds());
+        length -= n;
+        memmove(buffer, buffer + n, length);
+        if (length == sizeof(buffer) - 1)
+            length = 0;     // no newline in a full buffer: not telemetry, skip it
+    }
+    return NULL;
+}
+
+// -------------------------------------------------------------------------------
+
+/* Opens lpSource (see telemetry.h) and starts the reader thread.  Returns 0 on
+ * failure.
+ */
+int startTelemetry(const char* lpSource) {
+    if (strcmp(lpSource, "-") == 0) {
+        sourceKind = SOURCE_STDIN;
+    }
+    else if (strncmp(lpSource, "unix:", 5) == 0) {
+        sourceKind = SOURCE_SOCKET;
+        lpSource += 5;
+    }
+    else {
+        sourceKind = SOURCE_FILE;
+    }
+    lpSourcePath = strdup(lpSource);
+    if (lpSourcePath == NULL || !openSource())
+        return 0;
+
+    if (pipe(wakePipe) != 0) {
+        fprintf(stderr, "%s:%u: Failed to create pipe: %s\n", __FILE__, __LINE__, strerror(errno));
+        closeSource();
+        return 0;
+    }
+    if (pthread_create(&readerThread, NULL, readTelemetry, NULL) != 0) {
+        fprintf(stderr, "%s:%u: Failed to start the telemetry thread\n", __FILE__, __LINE__);
+        closeSource();
+        return 0;
+    }
+    running = 1;
+    return 1;
+}
+
+void stopTelemetry() {
+    if (!running)
+        return;
+    if (write(wakePipe[1], "", 1) != 1)
+        pthread_cancel(readerThread);
+    pthread_join(readerThread, NULL);
+    running = 0;
+
+    closeSource();
+    if (sourceKind == SOURCE_SOCKET)
+        unlink(lpSourcePath);
+    close(wakePipe[0]);
+    close(wakePipe[1]);
+    free(lpSourcePath);
+    lpSourcePath = NULL;
+}
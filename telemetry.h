@@ -0,0 +1,51 @@
+
+/* Attitude telemetry input.  startTelemetry() starts a thread that reads
+ * samples from an attitude source and publishes the newest one of each vehicle in
+ * a lock-free slot.  pollTelemetry() is called from display() and takes the
+ * newest sample of this station's own vehicle without blocking;
+ * pollVehicleTelemetry() does the same for the vehicles of the wall (see wall.h).
+ *
+ * The source is one of
+ *
+ *    -                 standard input, until end of file
+ *    unix:PATH         a Unix datagram socket bound at PATH, one or more samples per datagram
+ *    PATH              a FIFO (reopened whenever the writer goes away) or a plain file
+ *
+ * Every sample is a text line "TIME ROLL PITCH YAW", "TIME ROLL PITCH" or
+ * "ROLL PITCH", with the angles in degrees and TIME in seconds on the sender's
+ * clock; yaw is 0 when left out.  A line may start with "Vn " for vehicle n,
+ * below TELEMETRY_MAX_VEHICLES, which wall indicator n shows; lines without it
+ * are vehicle 0, the station's own.  Lines that do not parse are skipped.  A
+ * stand-in feeder for local testing:
+ *
+ *    mkfifo /tmp/attitude
+ *    ./glut-starter --telemetry /tmp/attitude &
+ *    while sleep 0.005; do echo "$(date +%s.%N) 10.5 4.25"; done > /tmp/attitude
+ *
+ * Each sample replaces the previous one of its vehicle, so after display() has
+ * not polled for a while it still gets the newest sample, never a stale one.
+ * Samples replaced before display() took them are counted by telemetryDropped(),
+ * and telemetryReceived() counts all samples, for the scheduler to notice any.
+ */
+
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#define TELEMETRY_MAX_VEHICLES 4096
+
+struct attitudeSample {
+    double sourceTime;      // TIME from the sample, or receiveTime when it has none
+    double receiveTime;     // CLOCK_MONOTONIC seconds when the sample was read
+    float roll;
+    float pitch;
+    float yaw;
+};
+
+int startTelemetry(const char* lpSource);
+int pollTelemetry(struct attitudeSample* lpSample);
+int pollVehicleTelemetry(int vehicle, struct attitudeSample* lpSample);
+unsigned long telemetryDropped();
+unsigned long telemetryReceived();
+void stopTelemetry();
+
+#endif
@@ -0,0 +1,49 @@
+
+/* On-disk layout of the texture pack written by the bake tool (bake.c) and mapped
+ * by LoadGLTextures().  The pack holds, per source image, a complete mip chain of
+ * GL_RGBA / GL_UNSIGNED_BYTE levels that can be handed to glTexImage2D() straight
+ * from the mapping:
+ *
+ *    struct texPackHeader
+ *    struct texPackEntry[textureCount]
+ *    level data, each level starting at a TEXPACK_ALIGNMENT byte offset
+ *
+ * All fields are in host byte order; the pack is built on the machine (or at least
+ * the architecture) that uses it.  An entry is stale when the size or modification
+ * time of its source file no longer match what was recorded at bake time.
+ */
+
+#ifndef TEXPACK_H
+#define TEXPACK_H
+
+#include <stdint.h>
+
+#define TEXPACK_MAGIC 0x4b505854    // "TXPK"
+#define TEXPACK_VERSION 1
+#define TEXPACK_MAX_LEVELS 16       // enough for a 32768 x 32768 base level
+#define TEXPACK_ALIGNMENT 64
+#define TEXPACK_NAME_LENGTH 64
+
+struct texPackHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t textureCount;
+    uint32_t reserved;
+};
+
+struct texPackLevel {
+    uint32_t width, height;
+    uint64_t offset;        // from the start of the file
+    uint64_t size;          // width * height * 4 bytes
+};
+
+struct texPackEntry {
+    char name[TEXPACK_NAME_LENGTH];    // source file name as given to the bake tool
+    int64_t sourceMtime;               // st_mtime of the source file, in seconds
+    uint64_t sourceSize;               // st_size of the source file
+    uint32_t levelCount;               // level 0 is the full resolution image
+    uint32_t reserved;
+    struct texPackLevel levels[TEXPACK_MAX_LEVELS];
+};
+
+#endif
@@ -0,0 +1,263 @@
+
+/* Glyph atlas text, see text.h. */
+
+#define GL_GLEXT_PROTOTYPES
+
+#include <GL/gl.h>
+#include <GL/glext.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include "shader.h"
+#include "glstate.h"
+#include "text.h"
+
+#define GLYPH_WIDTH 5
+#define GLYPH_HEIGHT 7
+#define CELL_WIDTH 6                // atlas cell and advance, with one blank column
+#define CELL_HEIGHT 8
+#define LINE_HEIGHT 10              // font pixels between rows
+#define MARGIN 4                    // font pixels between the window edge and the text
+#define REFERENCE_SIZE 360          // window size per font pixel of scale
+#define TEXT_DEPTH -1.0f            // in front of the overlay
+
+// The font: rows top to bottom, 5 bits each, the leftmost pixel in bit 4.
+static const char fontCharacters[] = " -.%:0123456789BCFHILOPRST";
+static const unsigned char fontRows[][GLYPH_HEIGHT] = {
+    { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 },   // space
+    { 0x00, 0x00, 0x00, 0x1f, 0x00, 0x00, 0x00 },   // -
+    { 0x00, 0x00, 0x00, 0x00, 0x00, 0x0c, 0x0c },   // .
+    { 0x18, 0x19, 0x02, 0x04, 0x08, 0x13, 0x03 },   // %
+    { 0x00, 0x0c, 0x0c, 0x00, 0x0c, 0x0c, 0x00 },   // :
+    { 0x0e, 0x11, 0x13, 0x15, 0x19, 0x11, 0x0e },   // 0
+    { 0x04, 0x0c, 0x04, 0x04, 0x04, 0x04, 0x0e },   // 1
+    { 0x0e, 0x11, 0x01, 0x02, 0x04, 0x08, 0x1f },   // 2
+    { 0x1f, 0x02, 0x04, 0x02, 0x01, 0x11, 0x0e },   // 3
+    { 0x02, 0x06, 0x0a, 0x12, 0x1f, 0x02, 0x02 },   // 4
+    { 0x1f, 0x10, 0x1e, 0x01, 0x01, 0x11, 0x0e },   // 5
+    { 0x06, 0x08, 0x10, 0x1e, 0x11, 0x11, 0x0e },   // 6
+    { 0x1f, 0x01, 0x02, 0x04, 0x08, 0x08, 0x08 },   // 7
+    { 0x0e, 0x11, 0x11, 0x0e, 0x11, 0x11, 0x0e },   // 8
+    { 0x0e, 0x11, 0x11, 0x0f, 0x01, 0x02, 0x0c },   // 9
+    { 0x1e, 0x11, 0x11, 0x1e, 0x11, 0x11, 0x1e },   // B
+    { 0x0e, 0x11, 0x10, 0x10, 0x10, 0x11, 0x0e },   // C
+    { 0x1f, 0x10, 0x10, 0x1e, 0x10, 0x10, 0x10 },   // F
+    { 0x11, 0x11, 0x11, 0x1f, 0x11, 0x11, 0x11 },   // H
+    { 0x0e, 0x04, 0x04, 0x04, 0x04, 0x04, 0x0e },   // I
+    { 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x1f },   // L
+    { 0x0e, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0e },   // O
+    { 0x1e, 0x11, 0x11, 0x1e, 0x10, 0x10, 0x10 },   // P
+    { 0x1e, 0x11, 0x11, 0x1e, 0x14, 0x12, 0x11 },   // R
+    { 0x0f, 0x10, 0x10, 0x0e, 0x01, 0x01, 0x1e },   // S
+    { 0x1f, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04 },   // T
+};
+#define GLYPH_COUNT ((int)sizeof(fontRows) / GLYPH_HEIGHT)
+
+static const char* lpVertexSource =
+    "#version 330 core\n"
+    "layout(location = 0) in vec4 placement;   // corner x, y, offset x, y in font pixels\n"
+    "layout(location = 1) in float glyph;\n"
+    "uniform vec2 pixelSize;   // of a font pixel, in normalized device coordinates\n"
+    "uniform float depth;\n"
+    "out vec2 texel;\n"
+    "flat out int cell;\n"
+    "void main() {\n"
+    "    vec2 corner = vec2(float(gl_VertexID & 1), float(gl_VertexID >> 1));\n"
+    "    vec2 size = vec2(6.0, 8.0);   // CELL_WIDTH, CELL_HEIGHT\n"
+    "    texel = vec2(corner.x, 1.0 - corner.y) * size;   // atlas rows run downwards\n"
+    "    cell = int(glyph);\n"
+    "    vec2 offset = placement.zw + vec2(corner.x, corner.y - 1.0) * size;\n"
+    "    gl_Position = vec4(placement.xy + offset * pixelSize, depth, 1.0);\n"
+    "}\n";
+
+static const char* lpFragmentSource =
+    "#version 330 core\n"
+    "uniform sampler2D atlas;\n"
+    "uniform vec4 color;\n"
+    "in vec2 texel;\n"
+    "flat in int cell;\n"
+    "out vec4 fragColor;\n"
+    "void main() {\n"
+    "    ivec2 t = min(ivec2(texel), ivec2(5, 7));\n"
+    "    if (texelFetch(atlas, ivec2(cell * 6 + t.x, t.y), 0).r < 0.5)\n"
+    "        discard;\n"
+    "    fragColor = color;\n"
+    "}\n";
+
+struct glyphInstance {
+    GLfloat cornerX, cornerY;       // -1 or 1
+    GLfloat offsetX, offsetY;       // font pixels from the corner to the top left of the glyph
+    GLfloat glyph;                  // atlas cell
+};
+
+struct textField {
+    int first;                      // glyph slot
+    int length;
+    int rightAligned;
+};
+
+static GLuint program, atlasTexture, vao, glyphBuffer;
+static GLint pixelSizeLocation;
+static struct glyphInstance glyphs[TEXT_MAX_GLYPHS];
+static int glyphCount;
+static struct textField fields[TEXT_MAX_FIELDS];
+static int fieldCount;
+static unsigned char cellOf[128];   // ASCII to atlas cell, 0 (blank) where the font has none
+static int scale = 1, viewportWidth = 1, viewportHeight = 1;
+
+/* Builds the atlas, the program and the empty glyph buffer.  Returns 0 on
+ * failure.
+ */
+int buildText() {
+    unsigned char atlas[CELL_HEIGHT][GLYPH_COUNT * CELL_WIDTH];
+    GLint alignment;
+    int g, x, y;
+
+    memset(atlas, 0, sizeof(atlas));
+    memset(cellOf, 0, sizeof(cellOf));
+    for (g = 0; g < GLYPH_COUNT; g++) {
+        cellOf[(unsigned char)fontCharacters[g]] = g;
+        for (y = 0; y < GLYPH_HEIGHT; y++)
+            for (x = 0; x < GLYPH_WIDTH; x++)
+                atlas[y][g * CELL_WIDTH + x] = fontRows[g][y] & (0x10 >> x) ? 255 : 0;
+    }
+
+    program = buildProgram(lpVertexSource, lpFragmentSource, "text");
+    if (program == 0)
+        return 0;
+    glUseProgram(program);
+    glUniform1i(glGetUniformLocation(program, "atlas"), 0);
+    glUniform1f(glGetUniformLocation(program, "depth"), TEXT_DEPTH);
+    glUniform4f(glGetUniformLocation(program, "color"), 1.0f, 1.0f, 1.0f, 1.0f);
+    pixelSizeLocation = glGetUniformLocation(program, "pixelSize");
+    glUseProgram(0);
+
+    glGenTextures(1, &atlasTexture);
+    glBindTexture(GL_TEXTURE_2D, atlasTexture);
+    glGetIntegerv(GL_UNPACK_ALIGNMENT, &alignment);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, GLYPH_COUNT * CELL_WIDTH, CELL_HEIGHT, 0, GL_RED, GL_UNSIGNED_BYTE, atlas);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, alignment);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    // The whole buffer is allocated here; fields only ever overwrite parts of it.
+    glGenBuffers(1, &glyphBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, glyphBuffer);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(glyphs), NULL, GL_DYNAMIC_DRAW);
+    glGenVertexArrays(1, &vao);
+    glBindVertexArray(vao);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(struct glyphInstance), (void*)0);
+    glVertexAttribDivisor(0, 1);
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 1, GL_FLOAT, GL_FALSE, sizeof(struct glyphInstance),
+                          (void*)offsetof(struct glyphInstance, glyph));
+    glVertexAttribDivisor(1, 1);
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    glyphCount = 0;
+    fieldCount = 0;
+    return 1;
+}
+
+/* Reserves a field of length glyphs in row row (0 at the window edge) of a
+ * corner.  Fields in the right corners are right-aligned.  Returns the field
+ * number, or -1 when the glyph buffer is full.
+ */
+int addTextField(enum textCorner corner, int row, int length) {
+    struct textField* lpField;
+    int right = corner == TEXT_TOP_RIGHT || corner == TEXT_BOTTOM_RIGHT;
+    int top = corner == TEXT_TOP_LEFT || corner == TEXT_TOP_RIGHT;
+    int i;
+
+    if (fieldCount == TEXT_MAX_FIELDS || glyphCount + length > TEXT_MAX_GLYPHS) {
+        fprintf(stderr, "%s:%u: No room for a text field of %d glyphs\n", __FILE__, __LINE__, length);
+        return -1;
+    }
+    lpField = &fields[fieldCount];
+    lpField->first = glyphCount;
+    lpField->length = length;
+    lpField->rightAligned = right;
+    for (i = 0; i < length; i++) {
+        struct glyphInstance* lpGlyph = &glyphs[glyphCount + i];
+        lpGlyph->cornerX = right ? 1.0f : -1.0f;
+        lpGlyph->cornerY = top ? 1.0f : -1.0f;
+        lpGlyph->offsetX = right ? -(MARGIN + (length - i) * CELL_WIDTH) : MARGIN + i * CELL_WIDTH;
+        lpGlyph->offsetY = top ? -(MARGIN + row * LINE_HEIGHT) : MARGIN + row * LINE_HEIGHT + CELL_HEIGHT;
+        lpGlyph->glyph = 0.0f;
+    }
+    glyphCount += length;
+    glBindBuffer(GL_ARRAY_BUFFER, glyphBuffer);
+    glBufferSubData(GL_ARRAY_BUFFER, lpField->first * sizeof(struct glyphInstance),
+                    length * sizeof(struct glyphInstance), &glyphs[lpField->first]);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    return fieldCount++;
+}
+
+/* Shows lpText in a field, cut to its length.  Uploads the run from the first
+ * to the last glyph that changed, nothing if none did.
+ */
+void setTextField(int field, const char* lpText) {
+    struct textField* lpField;
+    int length, pad, i, first = -1, last = -1;
+    unsigned char c;
+    GLfloat cell;
+
+    if (field < 0 || field >= fieldCount)
+        return;
+    lpField = &fields[field];
+    length = (int)strnlen(lpText, lpField->length);
+    pad = lpField->rightAligned ? lpField->length - length : 0;
+    for (i = 0; i < lpField->length; i++) {
+        c = i >= pad && i < pad + length ? (unsigned char)lpText[i - pad] : ' ';
+        cell = c < 128 ? cellOf[c] : 0.0f;
+        if (glyphs[lpField->first + i].glyph != cell) {
+            glyphs[lpField->first + i].glyph = cell;
+            if (first < 0)
+                first = i;
+            last = i;
+        }
+    }
+    if (first < 0)
+        return;
+    first += lpField->first;
+    last += lpField->first;
+    glBindBuffer(GL_ARRAY_BUFFER, glyphBuffer);
+    glBufferSubData(GL_ARRAY_BUFFER, first * sizeof(struct glyphInstance),
+                    (last - first + 1) * sizeof(struct glyphInstance), &glyphs[first]);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+/* Scales the font by a whole number to the window: 1 up to REFERENCE_SIZE
+ * pixels, 2 up to twice that and so on.
+ */
+void resizeText(int width, int height) {
+    viewportWidth = width > 0 ? width : 1;
+    viewportHeight = height > 0 ? height : 1;
+    scale = (viewportWidth < viewportHeight ? viewportWidth : viewportHeight) / REFERENCE_SIZE;
+    if (scale < 1)
+        scale = 1;
+}
+
+/* Draws all fields with one call. */
+void drawText() {
+    if (glyphCount == 0)
+        return;
+    useProgram(program);
+    glUniform2f(pixelSizeLocation, 2.0f * scale / viewportWidth, 2.0f * scale / viewportHeight);
+    bindTexture(0, GL_TEXTURE_2D, atlasTexture);
+    bindVertexArray(vao);
+    glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, glyphCount);
+}
+
+void deleteText() {
+    glDeleteProgram(program);
+    glDeleteTextures(1, &atlasTexture);
+    glDeleteVertexArrays(1, &vao);
+    glDeleteBuffers(1, &glyphBuffer);
+    program = atlasTexture = vao = glyphBuffer = 0;
+    glyphCount = fieldCount = 0;
+}
@@ -0,0 +1,34 @@
+
+/* Numeric readouts drawn from a glyph atlas, for roll, pitch, brightness and
+ * frame rate next to the ball.
+ *
+ * buildText() renders the built-in 5 x 7 pixel font into a one-row atlas
+ * texture once.  Text lives in fields: fixed runs of glyph slots that
+ * addTextField() reserves in one vertex buffer, placed in a corner of the
+ * window.  setTextField() compares the new string with what the field shows and
+ * writes only the glyphs that changed, with one glBufferSubData() of a few
+ * bytes; it allocates nothing.  drawText() draws every field with one instanced
+ * call, whatever the number of glyphs, where glutBitmapCharacter() would issue
+ * one call per glyph.
+ *
+ * Glyphs are scaled by a whole number to the window size with resizeText(), so
+ * their pixels stay square and sharp.  Characters outside the font show as
+ * blanks.
+ */
+
+#ifndef TEXT_H
+#define TEXT_H
+
+#define TEXT_MAX_GLYPHS 128
+#define TEXT_MAX_FIELDS 16
+
+enum textCorner { TEXT_TOP_LEFT, TEXT_TOP_RIGHT, TEXT_BOTTOM_LEFT, TEXT_BOTTOM_RIGHT };
+
+int buildText();
+int addTextField(enum textCorner corner, int row, int length);
+void setTextField(int field, const char* lpText);
+void resizeText(int width, int height);
+void drawText();
+void deleteText();
+
+#endif
@@ -0,0 +1,707 @@
+
+/* Texture loading, see texture.h. */
+
+#define GL_GLEXT_PROTOTYPES
+
+#include <GL/gl.h>
+#include <GL/glext.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "indicator.h"
+#include "image.h"
+#include "texpack.h"
+#include "glstate.h"
+#include "texture.h"
+
+#define TEXTURE_PACK "./textures.pack"
+#define RELOAD_ROWS_BYTES (2 << 20)     // staged per frame while a reloaded image is uploaded
+#define RELOAD_MAX_LEVELS 24
+
+struct decodeJob {
+    char* lpFilename;
+    unsigned long neededWidth, neededHeight;  // the resolution the window can actually show
+    const struct texPackEntry* lpPackEntry;   // baked mip chain, or NULL to decode the JPEG
+    struct imgRawImage* lpImage;
+    pthread_t thread;
+    int started;
+};
+
+static struct decodeJob decodeJobs[2] = {
+    { "./sphere.jpg" },
+    { "./ring.jpg" },
+};
+
+static void* lpPack = MAP_FAILED;     // read-only mapping of TEXTURE_PACK
+static size_t dwPackBytes;
+static GLint maxTextureSize;
+static GLint textureWidths[2];      // of level 0 of texture[k]
+static GLint textureMaxLevels[2];
+static int detailPixels;            // indicator size the mip range is set for, 0 for none yet
+
+enum reloadState { RELOAD_IDLE, RELOAD_STAGING, RELOAD_UPLOADING };
+
+/* A changed image and its mip chain, RGB, finest level first. */
+struct reloadImage {
+    int levelCount;
+    struct imgRawImage* lpLevels[RELOAD_MAX_LEVELS];
+};
+
+/* A changed image on its way into texture[k].  lpDecoded is handed over from the
+ * watcher under reloadLock; everything else belongs to the GL thread.
+ */
+struct reloadSlot {
+    struct reloadImage* lpDecoded;  // newest decode not yet taken by updateTextures()
+    struct reloadImage* lpImage;    // being copied into the staging buffer
+    int stagedLevel;
+    unsigned long stagedRows;       // of stagedLevel
+    size_t stagedBytes;             // offset of the next rows in buffer
+    GLuint buffer;                  // pixel unpack buffer the whole chain is staged in, as RGBA
+    GLuint texture;                 // replaces texture[k] once its upload is done
+    GLsync fence;
+    enum reloadState state;
+};
+
+static struct reloadSlot reloadSlots[2];
+static pthread_mutex_t reloadLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_t watchThread;
+static int watchFd = -1;            // inotify instance watching the directory of the images
+static int watchPipe[2];            // written by stopTextureWatch() to end the watcher
+static int watching;
+
+// ------------------------------- texture pack ---------------------------------
+
+/* Maps the texture pack and checks that its directory and all level ranges lie
+ * within the file.  Returns 0 (and leaves nothing mapped) if the pack is missing
+ * or malformed, in which case the JPEG files are used.
+ */
+static int openTexturePack(const char* lpFilename) {
+    const struct texPackHeader* lpHeader;
+    const struct texPackEntry* lpEntries;
+    struct stat st;
+    uint32_t i, level;
+    int fd;
+
+    fd = open(lpFilename, O_RDONLY);
+    if (fd < 0)
+        return 0;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(struct texPackHeader)) {
+        close(fd);
+        return 0;
+    }
+    dwPackBytes = st.st_size;
+    lpPack = mmap(NULL, dwPackBytes, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (lpPack == MAP_FAILED)
+        return 0;
+
+    lpHeader = (const struct texPackHeader*)lpPack;
+    lpEntries = (const struct texPackEntry*)(lpHeader + 1);
+    if (lpHeader->magic != TEXPACK_MAGIC || lpHeader->version != TEXPACK_VERSION ||
+            sizeof(*lpHeader) + (uint64_t)lpHeader->textureCount * sizeof(*lpEntries) > dwPackBytes)
+        goto invalid;
+    for (i = 0; i < lpHeader->textureCount; i++) {
+        if (lpEntries[i].levelCount < 1 || lpEntries[i].levelCount > TEXPACK_MAX_LEVELS ||
+                memchr(lpEntries[i].name, 0, TEXPACK_NAME_LENGTH) == NULL)
+            goto invalid;
+        for (level = 0; level < lpEntries[i].levelCount; level++) {
+            const struct texPackLevel* lpLevel = &lpEntries[i].levels[level];
+            if (lpLevel->size != (uint64_t)lpLevel->width * lpLevel->height * 4 ||
+                    lpLevel->offset > dwPackBytes || lpLevel->size > dwPackBytes - lpLevel->offset)
+                goto invalid;
+        }
+    }
+
+    // Start paging the levels in while the window and context are being created.
+    madvise(lpPack, dwPackBytes, MADV_WILLNEED);
+    return 1;
+
+invalid:
+    fprintf(stderr, "%s:%u: Ignoring malformed texture pack %s\n", __FILE__, __LINE__, lpFilename);
+    munmap(lpPack, dwPackBytes);
+    lpPack = MAP_FAILED;
+    return 0;
+}
+
+static void closeTexturePack() {
+    if (lpPack == MAP_FAILED)
+        return;
+    munmap(lpPack, dwPackBytes);
+    lpPack = MAP_FAILED;
+}
+
+/* Returns the pack entry baked from lpFilename, or NULL if there is none or the
+ * source file has changed since it was baked.  A pack shipped without its source
+ * files is used as it is.
+ */
+static const struct texPackEntry* findPackEntry(const char* lpFilename) {
+    const struct texPackHeader* lpHeader = (const struct texPackHeader*)lpPack;
+    const struct texPackEntry* lpEntries = (const struct texPackEntry*)(lpHeader + 1);
+    const char* lpName = lpFilename;
+    struct stat st;
+    uint32_t i;
+
+    if (lpPack == MAP_FAILED)
+        return NULL;
+    while (strncmp(lpName, "./", 2) == 0)
+        lpName += 2;
+
+    for (i = 0; i < lpHeader->textureCount; i++) {
+        if (strcmp(lpEntries[i].name, lpName) != 0)
+            continue;
+        if (stat(lpFilename, &st) == 0 &&
+                (st.st_mtime != lpEntries[i].sourceMtime || (uint64_t)st.st_size != lpEntries[i].sourceSize)) {
+            fprintf(stderr, "%s:%u: Texture pack is stale for %s, decoding it\n", __FILE__, __LINE__, lpFilename);
+            return NULL;
+        }
+        return &lpEntries[i];
+    }
+    return NULL;
+}
+
+// ------------------------------- JPEG decoding --------------------------------
+
+static void* decodeThread(void* lpArg) {
+    struct decodeJob* lpJob = (struct decodeJob*)lpArg;
+    lpJob->lpImage = loadJpegImageFileScaled(lpJob->lpFilename, lpJob->neededWidth, lpJob->neededHeight, 0);
+    return NULL;
+}
+
+/* The resolution of texture k an indicator of size x size pixels can show.  The
+ * ball is an equirectangular map around a sphere of 0.9 times the size: half its
+ * circumference is visible across the diameter, so pi times the diameter covers
+ * the full 360 degrees.  The ring texture is mapped onto the full size.
+ */
+static void neededSize(int k, int size, unsigned long* lpWidth, unsigned long* lpHeight) {
+    unsigned long sphereWidth = (unsigned long)ceil(M_PI * 0.9 * size);
+
+    *lpWidth = k == 0 ? sphereWidth : (unsigned long)size;
+    *lpHeight = k == 0 ? sphereWidth / 2 : (unsigned long)size;
+}
+
+/* Maps the texture pack, and starts decoding the textures it does not hold in the
+ * background, limited to the resolution a window of the given size can show.
+ */
+void startTextureDecode(int windowWidth, int windowHeight) {
+    int size = windowWidth < windowHeight ? windowWidth : windowHeight;
+    int k;
+
+    for (k = 0; k < 2; k++)
+        neededSize(k, size, &decodeJobs[k].neededWidth, &decodeJobs[k].neededHeight);
+
+    openTexturePack(TEXTURE_PACK);
+
+    for (k = 0; k < 2; k++) {
+        decodeJobs[k].lpImage = NULL;
+        decodeJobs[k].lpPackEntry = findPackEntry(decodeJobs[k].lpFilename);
+        if (decodeJobs[k].lpPackEntry != NULL)
+            continue;
+        decodeJobs[k].started = pthread_create(&decodeJobs[k].thread, NULL, decodeThread, &decodeJobs[k]) == 0;
+        if (!decodeJobs[k].started)
+            fprintf(stderr, "%s:%u: Failed to start decoder for %s\n", __FILE__, __LINE__, decodeJobs[k].lpFilename);
+    }
+}
+
+/* Waits for the decode workers and keeps their images for LoadGLTextures().
+ * A process that forks before creating its contexts calls this first: the
+ * children share the decoded pixels, but fork() copies no threads to join.
+ */
+void finishTextureDecode() {
+    int k;
+
+    for (k = 0; k < 2; k++) {
+        if (!decodeJobs[k].started)
+            continue;
+        pthread_join(decodeJobs[k].thread, NULL);
+        decodeJobs[k].started = 0;
+    }
+}
+
+/* Returns the decoded image of job k: waits for its worker, or decodes on this
+ * thread when no worker ran.  Images larger than the GL can hold are decoded again
+ * at a smaller scale, since the worker started before that limit was known.
+ */
+static struct imgRawImage* finishDecode(int k, GLint maxTextureSize) {
+    struct decodeJob* lpJob = &decodeJobs[k];
+    struct imgRawImage* lpImage;
+
+    if (lpJob->started) {
+        pthread_join(lpJob->thread, NULL);
+        lpJob->started = 0;
+    }
+    lpImage = lpJob->lpImage;       // from the worker, or NULL if none ran
+    if (lpImage == NULL)
+        lpImage = loadJpegImageFileScaled(lpJob->lpFilename, lpJob->neededWidth, lpJob->neededHeight, maxTextureSize);
+    lpJob->lpImage = NULL;
+
+    if (lpImage != NULL && (lpImage->width > (unsigned long)maxTextureSize || lpImage->height > (unsigned long)maxTextureSize)) {
+        freeImage(lpImage);
+        lpImage = loadJpegImageFileScaled(lpJob->lpFilename, lpJob->neededWidth, lpJob->neededHeight, maxTextureSize);
+    }
+    if (lpImage == NULL) {
+        fprintf(stderr, "%s:%u: No texture image for %s\n", __FILE__, __LINE__, lpJob->lpFilename);
+        exit(1);
+    }
+    return lpImage;
+}
+
+// ---------------------------------- upload ------------------------------------
+
+/* Uploads the levels of a baked mip chain straight from the mapped pack.  Levels
+ * larger than the window needs or than GL can hold are skipped, so the first
+ * level used becomes level 0.
+ */
+static void uploadPackTexture(const struct decodeJob* lpJob, GLint maxTextureSize) {
+    const struct texPackEntry* lpEntry = lpJob->lpPackEntry;
+    uint32_t base = 0, level;
+
+    while (base + 1 < lpEntry->levelCount &&
+            ((lpEntry->levels[base + 1].width >= lpJob->neededWidth &&
+              lpEntry->levels[base + 1].height >= lpJob->neededHeight) ||
+             lpEntry->levels[base].width > (uint32_t)maxTextureSize ||
+             lpEntry->levels[base].height > (uint32_t)maxTextureSize))
+        base++;
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    for (level = base; level < lpEntry->levelCount; level++) {
+        const struct texPackLevel* lpLevel = &lpEntry->levels[level];
+        glTexImage2D(GL_TEXTURE_2D, level - base, GL_RGBA8, lpLevel->width, lpLevel->height, 0,
+                     GL_RGBA, GL_UNSIGNED_BYTE, (const unsigned char*)lpPack + lpLevel->offset);
+    }
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, lpEntry->levelCount - 1 - base);
+}
+
+/* Uploads a decoded JPEG and lets GL build the mip chain. */
+static void uploadDecodedTexture(int k, GLint maxTextureSize) {
+    struct imgRawImage* image = finishDecode(k, maxTextureSize);
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);      // Rows of scaled images need not be 4-byte aligned
+    // Load texture into OpenGL RC
+    glTexImage2D(GL_TEXTURE_2D,     // 2D texture
+        0,                  // level of detail 0 (normal)
+        GL_RGBA8,           // stored like the baked textures
+        image->width,       // x size from image
+        image->height,      // y size from image
+        0,	            // border 0 (normal)
+        GL_RGB,             // rgb color data order
+        GL_UNSIGNED_BYTE,   // color component types
+        image->lpData       // image data itself
+    );
+    freeImage(image);       // GL has its own copy now
+    glGenerateMipmap(GL_TEXTURE_2D);
+}
+
+/* Sets the filtering of the texture bound to GL_TEXTURE_2D. */
+static void setTextureParameters() {
+    // Set Texture Parameters
+    //  Scale linearly when image bigger than texture
+    glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MAG_FILTER,GL_LINEAR);
+    //  Blend the two nearest mip levels when image smaller than texture
+    glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MIN_FILTER,GL_LINEAR_MIPMAP_LINEAR);
+}
+
+/* Remembers the size and mip chain of texture[k], which must be bound. */
+static void recordTextureSize(int k) {
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &textureWidths[k]);
+    glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, &textureMaxLevels[k]);
+}
+
+/* Sets the base level of texture[k] to the smallest mip level that still has the
+ * resolution an indicator of detailPixels needs.  The finer levels are never
+ * sampled then, so a small window does not read texels it cannot show.
+ */
+static void applyTextureDetail(int k) {
+    unsigned long neededWidth, neededHeight;
+    GLint base = 0;
+
+    if (detailPixels <= 0 || textureWidths[k] <= 0)
+        return;
+    neededSize(k, detailPixels, &neededWidth, &neededHeight);
+    while (base < textureMaxLevels[k] && (unsigned long)(textureWidths[k] >> (base + 1)) >= neededWidth)
+        base++;
+    bindTexture(0, GL_TEXTURE_2D, texture[k]);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, base);
+}
+
+/* Limits the mip range of both textures to what an indicator of pixels x pixels
+ * can show; called from reshape() and by the wall for its cell size.
+ */
+void setTextureDetail(int pixels) {
+    int k;
+
+    detailPixels = pixels;
+    for (k = 0; k < 2; k++)
+        applyTextureDetail(k);
+}
+
+void LoadGLTextures() {
+    int k;
+
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxTextureSize);
+
+    // Create Texture Names
+    glGenTextures(2, &texture[0]);
+
+    for (k = 0; k < 2; k++) {
+        glBindTexture(GL_TEXTURE_2D, texture[k]);   // 2d texture (x and y size)
+        setTextureParameters();
+
+        if (decodeJobs[k].lpPackEntry != NULL)
+            uploadPackTexture(&decodeJobs[k], maxTextureSize);
+        else
+            uploadDecodedTexture(k, maxTextureSize);
+        decodeJobs[k].lpPackEntry = NULL;
+        recordTextureSize(k);
+        applyTextureDetail(k);      // in case reshape() came first
+    }
+    closeTexturePack();
+
+    if (!coreProfile)
+        glEnable(GL_TEXTURE_2D);
+}
+
+// --------------------------------- hot reload ---------------------------------
+
+static void freeReloadImage(struct reloadImage* lpImage) {
+    int level;
+
+    if (lpImage == NULL)
+        return;
+    for (level = 0; level < lpImage->levelCount; level++)
+        freeImage(lpImage->lpLevels[level]);
+    free(lpImage);
+}
+
+/* Decodes the image of job k again after it changed on disk, builds its mip
+ * chain as bake.c does and leaves both in its reload slot, replacing a decode
+ * that updateTextures() has not taken yet.  A file caught half written does not
+ * decode; the next event retries it.
+ */
+static void decodeChangedImage(int k) {
+    struct decodeJob* lpJob = &decodeJobs[k];
+    struct reloadImage* lpImage;
+    struct reloadImage* lpStale;
+    struct imgRawImage* lpLevel;
+
+    if ((lpImage = (struct reloadImage*)calloc(1, sizeof(struct reloadImage))) == NULL) {
+        fprintf(stderr, "%s:%u: Allocation of lpImage failed\n", __FILE__, __LINE__);
+        return;
+    }
+    lpLevel = loadJpegImageFileScaled(lpJob->lpFilename, lpJob->neededWidth, lpJob->neededHeight, maxTextureSize);
+    while (lpLevel != NULL) {
+        lpImage->lpLevels[lpImage->levelCount++] = lpLevel;
+        if ((lpLevel->width == 1 && lpLevel->height == 1) || lpImage->levelCount == RELOAD_MAX_LEVELS)
+            break;
+        lpLevel = downsampleImage(lpLevel);
+    }
+    if (lpLevel == NULL) {          // the decode or a level failed
+        freeReloadImage(lpImage);
+        fprintf(stderr, "%s:%u: Keeping the old texture, %s does not decode\n", __FILE__, __LINE__, lpJob->lpFilename);
+        return;
+    }
+    pthread_mutex_lock(&reloadLock);
+    lpStale = reloadSlots[k].lpDecoded;
+    reloadSlots[k].lpDecoded = lpImage;
+    pthread_mutex_unlock(&reloadLock);
+    freeReloadImage(lpStale);
+}
+
+/* Returns the job whose file is called lpName, or -1. */
+static int findJobByName(const char* lpName) {
+    int k;
+
+    for (k = 0; k < 2; k++) {
+        const char* lpJobName = decodeJobs[k].lpFilename;
+        while (strncmp(lpJobName, "./", 2) == 0)
+            lpJobName += 2;
+        if (strcmp(lpJobName, lpName) == 0)
+            return k;
+    }
+    return -1;
+}
+
+/* Waits for inotify events on the image directory.  A file counts as changed
+ * when a writer closes it or when another file is renamed over it, as editors
+ * and "cp" followed by "mv" do.  All events read together are decoded once.
+ */
+static void* watchTextures(void* lpArg) {
+    char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+
+    for (;;) {
+        struct pollfd fds[2] = { { watchFd, POLLIN, 0 }, { watchPipe[0], POLLIN, 0 } };
+        int changed[2] = { 0, 0 };
+        ssize_t n, offset;
+        int k;
+
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+        if (fds[1].revents)
+            break;
+        n = read(watchFd, buffer, sizeof(buffer));
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EINTR)
+                continue;
+            fprintf(stderr, "%s:%u: Texture watch failed: %s\n", __FILE__, __LINE__, strerror(errno));
+            break;
+        }
+        for (offset = 0; offset < n; ) {
+            const struct inotify_event* lpEvent = (const struct inotify_event*)(buffer + offset);
+            if (lpEvent->len > 0 && (k = findJobByName(lpEvent->name)) >= 0)
+                changed[k] = 1;
+            offset += sizeof(struct inotify_event) + lpEvent->len;
+        }
+        for (k = 0; k < 2; k++) {
+            if (changed[k])
+                decodeChangedImage(k);
+        }
+    }
+    return NULL;
+}
+
+/* Starts watching sphere.jpg and ring.jpg for changes.  Call after
+ * LoadGLTextures(), which sets the size limit the new images are decoded for.
+ * Returns 0 on failure.
+ */
+int startTextureWatch() {
+    watchFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (watchFd < 0) {
+        fprintf(stderr, "%s:%u: Failed to start inotify: %s\n", __FILE__, __LINE__, strerror(errno));
+        return 0;
+    }
+    // The directory, not the files: a file replaced by a rename is a new inode.
+    if (inotify_add_watch(watchFd, ".", IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+        fprintf(stderr, "%s:%u: Failed to watch the texture directory: %s\n", __FILE__, __LINE__, strerror(errno));
+        close(watchFd);
+        watchFd = -1;
+        return 0;
+    }
+    if (pipe(watchPipe) != 0) {
+        fprintf(stderr, "%s:%u: Failed to create pipe: %s\n", __FILE__, __LINE__, strerror(errno));
+        close(watchFd);
+        watchFd = -1;
+        return 0;
+    }
+    if (pthread_create(&watchThread, NULL, watchTextures, NULL) != 0) {
+        fprintf(stderr, "%s:%u: Failed to start the texture watcher\n", __FILE__, __LINE__);
+        close(watchPipe[0]);
+        close(watchPipe[1]);
+        close(watchFd);
+        watchFd = -1;
+        return 0;
+    }
+    watching = 1;
+    return 1;
+}
+
+/* Gives up on the reload in lpSlot, keeping the old texture. */
+static void dropReload(struct reloadSlot* lpSlot) {
+    glDeleteBuffers(1, &lpSlot->buffer);
+    lpSlot->buffer = 0;
+    glDeleteTextures(1, &lpSlot->texture);
+    lpSlot->texture = 0;
+    invalidateGLState();
+    freeReloadImage(lpSlot->lpImage);
+    lpSlot->lpImage = NULL;
+    lpSlot->state = RELOAD_IDLE;
+}
+
+/* Takes the slot's new image: sizes its staging buffer for the whole chain and
+ * creates the texture with every level allocated but not yet filled.
+ */
+static void startReload(struct reloadSlot* lpSlot) {
+    const struct reloadImage* lpImage = lpSlot->lpImage;
+    size_t bytes = 0;
+    int level;
+
+    for (level = 0; level < lpImage->levelCount; level++)
+        bytes += (size_t)lpImage->lpLevels[level]->width * lpImage->lpLevels[level]->height * 4;
+    if (lpSlot->buffer == 0)
+        glGenBuffers(1, &lpSlot->buffer);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, lpSlot->buffer);
+    glBufferData(GL_PIXEL_UNPACK_BUFFER, bytes, NULL, GL_STREAM_DRAW);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    glGenTextures(1, &lpSlot->texture);
+    bindTexture(0, GL_TEXTURE_2D, lpSlot->texture);
+    setTextureParameters();
+    for (level = 0; level < lpImage->levelCount; level++)
+        glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA8, lpImage->lpLevels[level]->width,
+                     lpImage->lpLevels[level]->height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, lpImage->levelCount - 1);
+
+    lpSlot->stagedLevel = 0;
+    lpSlot->stagedRows = 0;
+    lpSlot->stagedBytes = 0;
+    lpSlot->state = RELOAD_STAGING;
+}
+
+/* Copies the next rows of the slot's mip chain into its staging buffer as RGBA,
+ * at most RELOAD_ROWS_BYTES per frame, and uploads them into their level from
+ * there, so no frame converts or copies more than that.  The finest level comes
+ * first; the small ones share a frame.  Once the last level is in, fences the
+ * upload.
+ */
+static void stageRows(struct reloadSlot* lpSlot) {
+    size_t budget = RELOAD_ROWS_BYTES;
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, lpSlot->buffer);
+    bindTexture(0, GL_TEXTURE_2D, lpSlot->texture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    while (lpSlot->state == RELOAD_STAGING) {
+        const struct imgRawImage* lpLevel = lpSlot->lpImage->lpLevels[lpSlot->stagedLevel];
+        size_t rowBytes = lpLevel->width * 4;
+        unsigned long rows = budget / rowBytes, i;
+        const unsigned char* lpSource;
+        unsigned char* lpMapped;
+
+        if (rows < 1 && budget < RELOAD_ROWS_BYTES)
+            break;              // the rest waits for the next frame
+        if (rows < 1)
+            rows = 1;
+        if (rows > lpLevel->height - lpSlot->stagedRows)
+            rows = lpLevel->height - lpSlot->stagedRows;
+
+        // Each range is written once, so the GPU never reads what is mapped.
+        lpMapped = (unsigned char*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, lpSlot->stagedBytes, rows * rowBytes,
+                                                    GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT |
+                                                    GL_MAP_UNSYNCHRONIZED_BIT);
+        if (lpMapped == NULL) {
+            fprintf(stderr, "%s:%u: Failed to map the staging buffer, dropping the reload\n", __FILE__, __LINE__);
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            dropReload(lpSlot);
+            return;
+        }
+        lpSource = lpLevel->lpData + lpSlot->stagedRows * lpLevel->width * 3;
+        for (i = 0; i < rows * lpLevel->width; i++) {
+            lpMapped[4 * i + 0] = lpSource[3 * i + 0];
+            lpMapped[4 * i + 1] = lpSource[3 * i + 1];
+            lpMapped[4 * i + 2] = lpSource[3 * i + 2];
+            lpMapped[4 * i + 3] = 255;
+        }
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        glTexSubImage2D(GL_TEXTURE_2D, lpSlot->stagedLevel, 0, lpSlot->stagedRows, lpLevel->width, rows,
+                        GL_RGBA, GL_UNSIGNED_BYTE, (const void*)lpSlot->stagedBytes);   // from the bound buffer
+        lpSlot->stagedBytes += rows * rowBytes;
+        lpSlot->stagedRows += rows;
+        budget -= budget < rows * rowBytes ? budget : rows * rowBytes;
+
+        if (lpSlot->stagedRows == lpLevel->height) {
+            lpSlot->stagedLevel++;
+            lpSlot->stagedRows = 0;
+        }
+        if (lpSlot->stagedLevel == lpSlot->lpImage->levelCount) {
+            lpSlot->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+            freeReloadImage(lpSlot->lpImage);     // the buffer has the pixels now
+            lpSlot->lpImage = NULL;
+            lpSlot->state = RELOAD_UPLOADING;
+        }
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+/* Called at the start of every frame, before anything is drawn.  Moves each
+ * reloaded image one step on: takes a new decode into a new texture and staging
+ * buffer, stages and uploads some of its rows, or, once the GPU has finished the
+ * upload, swaps the new texture into texture[k] and deletes the old one and the
+ * buffer.  Frames in flight keep the old texture until they are done with it, as
+ * GL defers the deletion.  Returns 1 while a reload is in progress, so the
+ * caller asks for another frame.
+ */
+int updateTextures() {
+    int k, busy = 0;
+
+    if (!watching)
+        return 0;
+    for (k = 0; k < 2; k++) {
+        struct reloadSlot* lpSlot = &reloadSlots[k];
+
+        if (lpSlot->state == RELOAD_IDLE) {
+            pthread_mutex_lock(&reloadLock);
+            lpSlot->lpImage = lpSlot->lpDecoded;
+            lpSlot->lpDecoded = NULL;
+            pthread_mutex_unlock(&reloadLock);
+            if (lpSlot->lpImage == NULL)
+                continue;
+            startReload(lpSlot);
+        }
+
+        if (lpSlot->state == RELOAD_STAGING) {
+            stageRows(lpSlot);
+        }
+        else if (lpSlot->state == RELOAD_UPLOADING) {
+            GLenum status = glClientWaitSync(lpSlot->fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+            if (status == GL_TIMEOUT_EXPIRED) {
+                busy = 1;
+                continue;
+            }
+            glDeleteSync(lpSlot->fence);
+            lpSlot->fence = 0;
+            glDeleteTextures(1, &texture[k]);
+            invalidateGLState();    // the deleted texture was unbound wherever it was bound
+            texture[k] = lpSlot->texture;
+            bindTexture(0, GL_TEXTURE_2D, texture[k]);
+            recordTextureSize(k);
+            applyTextureDetail(k);
+            lpSlot->texture = 0;
+            glDeleteBuffers(1, &lpSlot->buffer);
+            lpSlot->buffer = 0;
+            lpSlot->state = RELOAD_IDLE;
+            fprintf(stderr, "%s:%u: Reloaded %s\n", __FILE__, __LINE__, decodeJobs[k].lpFilename);
+        }
+        busy |= lpSlot->state != RELOAD_IDLE;
+    }
+    return busy;
+}
+
+/* Returns 1 if a changed image is decoded and waiting for updateTextures(). */
+int texturesChanged() {
+    int changed;
+
+    pthread_mutex_lock(&reloadLock);
+    changed = reloadSlots[0].lpDecoded != NULL || reloadSlots[1].lpDecoded != NULL;
+    pthread_mutex_unlock(&reloadLock);
+    return changed;
+}
+
+/* Stops the watcher and frees the images, buffers and textures of reloads that
+ * did not finish.  Needs the GL context if one was in progress.
+ */
+void stopTextureWatch() {
+    int k;
+
+    if (!watching)
+        return;
+    if (write(watchPipe[1], "", 1) != 1)
+        pthread_cancel(watchThread);
+    pthread_join(watchThread, NULL);
+    watching = 0;
+    close(watchPipe[0]);
+    close(watchPipe[1]);
+    close(watchFd);
+    watchFd = -1;
+
+    for (k = 0; k < 2; k++) {
+        struct reloadSlot* lpSlot = &reloadSlots[k];
+        freeReloadImage(lpSlot->lpDecoded);
+        freeReloadImage(lpSlot->lpImage);
+        if (lpSlot->fence != 0)
+            glDeleteSync(lpSlot->fence);
+        if (lpSlot->texture != 0)
+            glDeleteTextures(1, &lpSlot->texture);
+        if (lpSlot->buffer != 0)
+            glDeleteBuffers(1, &lpSlot->buffer);
+        memset(lpSlot, 0, sizeof(*lpSlot));
+    }
+}
@@ -0,0 +1,38 @@
+
+/* Loading of the sphere and ring textures.  When textures.pack (made with
+ * "make bake") is present and up to date, startTextureDecode() maps it and
+ * LoadGLTextures() uploads its precomputed mip chains without decoding anything.
+ * Otherwise the JPEG files are decoded on worker threads that are started with
+ * startTextureDecode() before the window and GL context are created;
+ * LoadGLTextures() (called from initGL()) waits for them, uploads the pixels into
+ * texture[0] and texture[1], has GL build the mipmaps and frees the CPU copies.
+ * setTextureDetail() limits the mip range of both textures to the levels an
+ * indicator of a given size can show (see lod.h).
+ * finishTextureDecode() waits for the workers ahead of that, for batch mode
+ * (see batch.h), which forks its renderers after decoding.
+ *
+ * With startTextureWatch() (--watch-textures) the images are reloaded while the
+ * program runs.  A thread waits for inotify events on the directory, decodes a
+ * changed image and builds its mip chain.  updateTextures(), called at the start
+ * of every frame, then creates a new texture object and copies the chain into a
+ * pixel unpack buffer as RGBA, a bounded number of rows per frame, uploading each
+ * band into its level in the frame that staged it.  Once a fence says the GPU is
+ * done, it swaps the new texture into texture[k] between two frames.  No frame
+ * waits for the decode, converts or uploads more than one band, and none ever
+ * samples a half-loaded image.
+ * texturesChanged() tells the scheduler that a decode is waiting for a frame.
+ */
+
+#ifndef TEXTURE_H
+#define TEXTURE_H
+
+void startTextureDecode(int windowWidth, int windowHeight);
+void finishTextureDecode();
+void LoadGLTextures();
+void setTextureDetail(int pixels);
+int startTextureWatch();
+int updateTextures();
+int texturesChanged();
+void stopTextureWatch();
+
+#endif
@@ -0,0 +1,550 @@
+
+/* Virtual texture streaming, see vtex.h. */
+
+#define GL_GLEXT_PROTOTYPES
+
+#include <GL/gl.h>
+#include <GL/glext.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "scene.h"
+#include "marks.h"
+#include "glstate.h"
+#include "vtexfile.h"
+#include "vtex.h"
+
+#define INDIRECTION_UNIT 2
+#define CACHE_SIZE (VTEX_CACHE_PAGES * VTEX_CACHE_PAGES)
+#define NO_PAGE -1
+#define PINNED_PAGE 0               // holds the coarsest level
+
+enum { STAGED_FREE, STAGED_LOADING, STAGED_READY };
+
+struct stagedTile {
+    int state;
+    uint32_t tile;
+    unsigned char* lpTexels;        // VTEX_TILE_BYTES, owned by the main thread while STAGED_READY
+};
+
+struct cachePage {
+    int64_t tile;                   // -1 while empty
+    uint32_t lastUsed;              // frame
+};
+
+static struct vtexHeader header;
+static int file = -1;
+static GLuint program, cacheTexture, indirectionTexture;
+static GLint modelLocation;
+static GLsizei indirectionWidth, indirectionHeight;
+static int levelRows[VTEX_MAX_LEVELS];
+static int32_t* lpPageOfTile;       // per tile: cache page or NO_PAGE
+static uint32_t* lpNeededFrame;     // per tile: the last frame that needed it
+static uint32_t* lpNeeded;          // tiles of this frame that are not resident
+static unsigned char* lpTileFailed; // per tile: 1 once reading it failed, under lock
+static unsigned char* lpIndirection;    // GL_RGBA8UI: page x, page y, level of the page
+static struct cachePage pages[CACHE_SIZE];
+static uint32_t frame;
+static int indirectionChanged;
+
+// The loader thread and the main thread share these under lock.
+static pthread_t loader;
+static int loaderStarted;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t wake = PTHREAD_COND_INITIALIZER;      // new requests or a free staging slot
+static pthread_cond_t loaded = PTHREAD_COND_INITIALIZER;    // a tile finished loading
+static uint32_t requests[CACHE_SIZE];   // coarsest first; more would not fit the cache anyway
+static int requestCount, nextRequest;
+static struct stagedTile staging[VTEX_STAGING];
+static int stopping;
+
+// ------------------------------- loader ---------------------------------------
+
+static int readTile(uint32_t tile, unsigned char* lpTexels) {
+    return pread(file, lpTexels, VTEX_TILE_BYTES, (off_t)(header.dataOffset + (uint64_t)tile * VTEX_TILE_BYTES)) ==
+           VTEX_TILE_BYTES;
+}
+
+static int freeStagingSlot() {
+    int k;
+    for (k = 0; k < VTEX_STAGING; k++)
+        if (staging[k].state == STAGED_FREE)
+            return k;
+    return -1;
+}
+
+/* Reads the requested tiles into free staging slots, in request order. */
+static void* loaderThread(void* lpArg) {
+    uint32_t tile;
+    int slot = -1, ok;
+
+    (void)lpArg;
+    pthread_mutex_lock(&lock);
+    for (;;) {
+        while (!stopping && (nextRequest == requestCount || (slot = freeStagingSlot()) < 0))
+            pthread_cond_wait(&wake, &lock);
+        if (stopping)
+            break;
+        tile = requests[nextRequest++];
+        staging[slot].state = STAGED_LOADING;
+        staging[slot].tile = tile;
+        pthread_mutex_unlock(&lock);
+
+        ok = readTile(tile, staging[slot].lpTexels);
+
+        pthread_mutex_lock(&lock);
+        if (!ok) {
+            fprintf(stderr, "%s:%u: Failed to read virtual texture tile %u\n", __FILE__, __LINE__, tile);
+            lpTileFailed[tile] = 1;     // never requested again; its ancestor stands in
+        }
+        staging[slot].state = ok ? STAGED_READY : STAGED_FREE;
+        pthread_cond_signal(&loaded);
+    }
+    pthread_mutex_unlock(&lock);
+    return NULL;
+}
+
+// ------------------------------- page cache -----------------------------------
+
+static uint32_t tileNumber(int level, uint32_t tileX, uint32_t tileY) {
+    const struct vtexLevel* lpLevel = &header.levels[level];
+    if (tileX >= lpLevel->tilesX)
+        tileX = lpLevel->tilesX - 1;
+    if (tileY >= lpLevel->tilesY)
+        tileY = lpLevel->tilesY - 1;
+    return (uint32_t)lpLevel->firstTile + tileY * lpLevel->tilesX + tileX;
+}
+
+/* The least recently used page that this frame does not need, or NO_PAGE. */
+static int victimPage() {
+    int p, victim = NO_PAGE;
+
+    for (p = 0; p < CACHE_SIZE; p++) {
+        if (p == PINNED_PAGE)
+            continue;
+        if (pages[p].tile < 0)
+            return p;
+        if (pages[p].lastUsed != frame && (victim == NO_PAGE || pages[p].lastUsed < pages[victim].lastUsed))
+            victim = p;
+    }
+    return victim;
+}
+
+static void uploadPage(int p, uint32_t tile, const unsigned char* lpTexels) {
+    if (pages[p].tile >= 0)
+        lpPageOfTile[pages[p].tile] = NO_PAGE;
+    pages[p].tile = tile;
+    pages[p].lastUsed = frame;
+    lpPageOfTile[tile] = p;
+    bindTexture(0, GL_TEXTURE_2D, cacheTexture);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, p % VTEX_CACHE_PAGES * VTEX_PAGE, p / VTEX_CACHE_PAGES * VTEX_PAGE,
+                    VTEX_PAGE, VTEX_PAGE, GL_RGBA, GL_UNSIGNED_BYTE, lpTexels);
+    indirectionChanged = 1;
+}
+
+/* Points every entry at the page of its tile or of the finest resident ancestor,
+ * the tile the shader derives with the same shifts, and uploads the table.
+ */
+static void updateIndirection() {
+    uint32_t level, ancestor, tileX, tileY;
+
+    for (level = 0; level < header.levelCount; level++) {
+        for (tileY = 0; tileY < header.levels[level].tilesY; tileY++) {
+            for (tileX = 0; tileX < header.levels[level].tilesX; tileX++) {
+                unsigned char* lpEntry = &lpIndirection[4 * ((levelRows[level] + tileY) * indirectionWidth + tileX)];
+                int32_t p = PINNED_PAGE;    // the coarsest level, where the search ends
+                for (ancestor = level; ancestor + 1 < header.levelCount; ancestor++) {
+                    int32_t page = lpPageOfTile[tileNumber(ancestor, tileX >> (ancestor - level),
+                                                           tileY >> (ancestor - level))];
+                    if (page != NO_PAGE) {
+                        p = page;
+                        break;
+                    }
+                }
+                lpEntry[0] = p % VTEX_CACHE_PAGES;
+                lpEntry[1] = p / VTEX_CACHE_PAGES;
+                lpEntry[2] = ancestor;
+                lpEntry[3] = 0;
+            }
+        }
+    }
+    bindTexture(0, GL_TEXTURE_2D, indirectionTexture);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, indirectionWidth, indirectionHeight, GL_RGBA_INTEGER, GL_UNSIGNED_BYTE,
+                    lpIndirection);
+    indirectionChanged = 0;
+}
+
+// ------------------------------- visibility -----------------------------------
+
+/* The impostor's texture coordinates at the eye point (x, y), see scene.c. */
+static void ballCoordinates(const GLfloat* m, float x, float y, float* lpS, float* lpT) {
+    float z = -sqrtf(fmaxf(BALL_RADIUS * BALL_RADIUS - x * x - y * y, 0.0f));
+    float ox = m[0] * x + m[1] * y + m[2] * z;
+    float oy = m[4] * x + m[5] * y + m[6] * z;
+    float oz = m[8] * x + m[9] * y + m[10] * z;
+
+    *lpS = 1.0f - atan2f(ox, oy) / (float)(2 * M_PI);
+    *lpT = 1.0f - acosf(fmaxf(fminf(oz / BALL_RADIUS, 1.0f), -1.0f)) / (float)M_PI;
+}
+
+/* The difference of two s coordinates across the seam, as fract() sees it. */
+static float wrappedDifference(float d) {
+    return d - floorf(d + 0.5f);
+}
+
+/* Marks the tile of level that covers (s, t) and its ancestors as needed by this
+ * frame.  Returns the new count of tiles in lpNeeded.
+ */
+static int needTile(int level, float s, float t, int count) {
+    uint32_t tileX, tileY, tile, ancestor;
+
+    s -= floorf(s);
+    t = fmaxf(fminf(t, 1.0f), 0.0f);
+    tileX = (uint32_t)(s * header.levels[level].width) / VTEX_TILE;
+    tileY = (uint32_t)(t * header.levels[level].height) / VTEX_TILE;
+    for (ancestor = level; ancestor < header.levelCount; ancestor++) {
+        tile = tileNumber(ancestor, tileX >> (ancestor - level), tileY >> (ancestor - level));
+        if (lpNeededFrame[tile] == frame)
+            break;          // and so are its ancestors
+        lpNeededFrame[tile] = frame;
+        if (lpPageOfTile[tile] != NO_PAGE)
+            pages[lpPageOfTile[tile]].lastUsed = frame;
+        else
+            lpNeeded[count++] = tile;
+    }
+    return count;
+}
+
+/* Finds the tiles the ball needs at every VTEX_SAMPLE_STEP-th pixel, choosing
+ * the level from the texture coordinate change to the next pixel as the shader
+ * does.  Returns their number.
+ */
+static int findNeededTiles(const GLfloat* lpSphereModel, int viewportWidth, int viewportHeight) {
+    float pixelX = 2.0f / viewportWidth, pixelY = 2.0f / viewportHeight;
+    float baseWidth = header.levels[0].width, baseHeight = header.levels[0].height;
+    float x, y, s, t, sx, tx, sy, ty, rho;
+    int level, count = 0;
+
+    for (y = -BALL_RADIUS; y <= BALL_RADIUS; y += VTEX_SAMPLE_STEP * pixelY) {
+        for (x = -BALL_RADIUS; x <= BALL_RADIUS; x += VTEX_SAMPLE_STEP * pixelX) {
+            if (x * x + y * y > BALL_RADIUS * BALL_RADIUS)
+                continue;
+            ballCoordinates(lpSphereModel, x, y, &s, &t);
+            ballCoordinates(lpSphereModel, x + pixelX, y, &sx, &tx);
+            ballCoordinates(lpSphereModel, x, y + pixelY, &sy, &ty);
+            rho = fmaxf(hypotf(wrappedDifference(sx - s) * baseWidth, (tx - t) * baseHeight),
+                        hypotf(wrappedDifference(sy - s) * baseWidth, (ty - t) * baseHeight));
+            level = (int)(log2f(fmaxf(rho, 1.0f)) + 0.5f);
+            if (level > (int)header.levelCount - 1)
+                level = header.levelCount - 1;
+            count = needTile(level, s, t, count);
+        }
+    }
+    return count;
+}
+
+static int compareTilesCoarseFirst(const void* a, const void* b) {
+    uint32_t ta = *(const uint32_t*)a, tb = *(const uint32_t*)b;
+    return (ta < tb) - (ta > tb);   // coarser levels come later in the file
+}
+
+// ------------------------------- frames ---------------------------------------
+
+static int isStaged(uint32_t tile) {
+    int k;
+    for (k = 0; k < VTEX_STAGING; k++)
+        if (staging[k].state != STAGED_FREE && staging[k].tile == tile)
+            return 1;
+    return 0;
+}
+
+/* Moves the loaded tiles into pages, at most limit of them.  Returns the number
+ * uploaded; stops early when every page is needed by this frame.
+ */
+static int uploadLoadedTiles(int limit) {
+    int ready[VTEX_STAGING], done[VTEX_STAGING];
+    int k, readyCount = 0, uploaded = 0, p;
+
+    pthread_mutex_lock(&lock);
+    for (k = 0; k < VTEX_STAGING; k++)
+        if (staging[k].state == STAGED_READY)
+            ready[readyCount++] = k;
+    pthread_mutex_unlock(&lock);
+
+    // Ready slots belong to this thread until they are freed, so no lock here.
+    for (k = 0; k < readyCount; k++) {
+        struct stagedTile* lpStaged = &staging[ready[k]];
+        done[k] = lpPageOfTile[lpStaged->tile] != NO_PAGE;    // already there, drop it
+        if (!done[k] && uploaded < limit && (p = victimPage()) != NO_PAGE) {
+            uploadPage(p, lpStaged->tile, lpStaged->lpTexels);
+            uploaded++;
+            done[k] = 1;
+        }
+    }
+
+    pthread_mutex_lock(&lock);
+    for (k = 0; k < readyCount; k++)
+        if (done[k])
+            staging[ready[k]].state = STAGED_FREE;
+    pthread_cond_signal(&wake);
+    pthread_mutex_unlock(&lock);
+    return uploaded;
+}
+
+/* Brings the cache up to date for a frame that draws the ball with lpSphereModel
+ * into a viewport of the given size: marks the tiles in view as used, queues the
+ * missing ones and uploads up to VTEX_UPLOADS_PER_FRAME loaded tiles.  With wait
+ * set (offscreen frames) it instead waits until every tile in view is resident
+ * or failed to read, or the cache cannot take more.
+ */
+void updateVirtualTexture(const GLfloat* lpSphereModel, int viewportWidth, int viewportHeight, int wait) {
+    int count, missing, i, pending, ready;
+
+    if (file < 0)
+        return;
+    frame++;
+    count = findNeededTiles(lpSphereModel, viewportWidth, viewportHeight);
+    qsort(lpNeeded, count, sizeof(*lpNeeded), compareTilesCoarseFirst);
+
+    for (;;) {
+        pthread_mutex_lock(&lock);
+        requestCount = nextRequest = missing = 0;
+        for (i = 0; i < count; i++) {
+            if (lpPageOfTile[lpNeeded[i]] != NO_PAGE || lpTileFailed[lpNeeded[i]])
+                continue;
+            missing++;
+            if (!isStaged(lpNeeded[i]) && requestCount < CACHE_SIZE)
+                requests[requestCount++] = lpNeeded[i];
+        }
+        pthread_cond_signal(&wake);
+        pending = requestCount > 0;
+        ready = 0;
+        for (i = 0; i < VTEX_STAGING; i++) {
+            pending |= staging[i].state != STAGED_FREE;
+            ready |= staging[i].state == STAGED_READY;
+        }
+        if (wait && missing > 0 && pending && !ready)
+            pthread_cond_wait(&loaded, &lock);
+        pthread_mutex_unlock(&lock);
+
+        if (uploadLoadedTiles(wait ? CACHE_SIZE : VTEX_UPLOADS_PER_FRAME) == 0 && victimPage() == NO_PAGE)
+            break;          // the cache is full of tiles this frame needs
+        if (!wait || missing == 0 || !pending)
+            break;
+    }
+    if (indirectionChanged)
+        updateIndirection();
+}
+
+/* 1 while tiles are being loaded or wait for upload, so that the caller keeps
+ * drawing frames until the view is sharp.
+ */
+int virtualTextureBusy() {
+    int k, busy;
+
+    if (file < 0)
+        return 0;
+    pthread_mutex_lock(&lock);
+    busy = nextRequest < requestCount;
+    for (k = 0; k < VTEX_STAGING; k++)
+        busy |= staging[k].state != STAGED_FREE;
+    pthread_mutex_unlock(&lock);
+    return busy;
+}
+
+/* Draws the ball impostor textured from the cache. */
+void drawVirtualBall(const GLfloat* lpSphereModel) {
+    useProgram(program);
+    glUniformMatrix4fv(modelLocation, 1, GL_FALSE, lpSphereModel);
+    bindTexture(INDIRECTION_UNIT, GL_TEXTURE_2D, indirectionTexture);
+    bindTexture(0, GL_TEXTURE_2D, cacheTexture);
+    drawImpostorSquare();
+}
+
+// ------------------------------- setup ----------------------------------------
+
+static int readHeader(const char* lpFilename) {
+    struct stat st;
+    uint32_t level;
+
+    if (pread(file, &header, sizeof(header), 0) != (ssize_t)sizeof(header) || header.magic != VTEX_MAGIC ||
+            header.version != VTEX_VERSION || header.levelCount < 1 || header.levelCount > VTEX_MAX_LEVELS) {
+        fprintf(stderr, "%s:%u: %s is not a virtual texture\n", __FILE__, __LINE__, lpFilename);
+        return 0;
+    }
+    for (level = 0; level < header.levelCount; level++) {
+        const struct vtexLevel* lpLevel = &header.levels[level];
+        if (lpLevel->tilesX != (lpLevel->width + VTEX_TILE - 1) / VTEX_TILE ||
+                lpLevel->tilesY != (lpLevel->height + VTEX_TILE - 1) / VTEX_TILE ||
+                lpLevel->firstTile + (uint64_t)lpLevel->tilesX * lpLevel->tilesY > header.tileCount) {
+            fprintf(stderr, "%s:%u: Level %u of %s is damaged\n", __FILE__, __LINE__, level, lpFilename);
+            return 0;
+        }
+    }
+    if (header.levels[header.levelCount - 1].tilesX * header.levels[header.levelCount - 1].tilesY != 1 ||
+            fstat(file, &st) != 0 ||
+            (uint64_t)st.st_size < header.dataOffset + header.tileCount * VTEX_TILE_BYTES) {
+        fprintf(stderr, "%s:%u: %s is damaged or truncated\n", __FILE__, __LINE__, lpFilename);
+        return 0;
+    }
+    return 1;
+}
+
+/* Builds the shader variant and sets the level uniforms. */
+static int buildVirtualProgram() {
+    GLfloat sizes[2 * VTEX_MAX_LEVELS];
+    GLint tiles[2 * VTEX_MAX_LEVELS];
+    char defines[256];
+    uint32_t level;
+
+    snprintf(defines, sizeof(defines),
+             "#define VIRTUAL\n#define VTEX_TILE %d\n#define VTEX_PAGE %d\n#define VTEX_BORDER %d\n"
+             "#define VTEX_MAX_LEVELS %d\n", VTEX_TILE, VTEX_PAGE, VTEX_BORDER, VTEX_MAX_LEVELS);
+    if ((program = buildImpostorVariant(defines, "virtual texture ball")) == 0)
+        return 0;
+    for (level = 0; level < header.levelCount; level++) {
+        sizes[2 * level] = header.levels[level].width;
+        sizes[2 * level + 1] = header.levels[level].height;
+        tiles[2 * level] = header.levels[level].tilesX;
+        tiles[2 * level + 1] = header.levels[level].tilesY;
+    }
+    modelLocation = glGetUniformLocation(program, "model");
+    glUniform1i(glGetUniformLocation(program, "indirection"), INDIRECTION_UNIT);
+    glUniform1i(glGetUniformLocation(program, "levelCount"), header.levelCount);
+    glUniform2fv(glGetUniformLocation(program, "levelSize"), header.levelCount, sizes);
+    glUniform2iv(glGetUniformLocation(program, "levelTiles"), header.levelCount, tiles);
+    glUniform1iv(glGetUniformLocation(program, "levelRow"), header.levelCount, levelRows);
+    glUseProgram(0);
+    return 1;
+}
+
+/* Opens lpFilename, creates the cache and indirection textures with the coarsest
+ * level in place and starts the loader.  Needs the GL context.  Returns 0 on
+ * failure.
+ */
+int openVirtualTexture(const char* lpFilename) {
+    GLint maxTextureSize;
+    uint32_t level;
+    int k;
+
+    if ((file = open(lpFilename, O_RDONLY)) < 0) {
+        fprintf(stderr, "%s:%u: Failed to read file %s\n", __FILE__, __LINE__, lpFilename);
+        return 0;
+    }
+    if (!readHeader(lpFilename)) {
+        closeVirtualTexture();
+        return 0;
+    }
+
+    // The indirection table stacks the levels, finest at the top.
+    indirectionWidth = header.levels[0].tilesX;
+    indirectionHeight = 0;
+    for (level = 0; level < header.levelCount; level++) {
+        levelRows[level] = indirectionHeight;
+        indirectionHeight += header.levels[level].tilesY;
+    }
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxTextureSize);
+    if (indirectionWidth > maxTextureSize || indirectionHeight > maxTextureSize ||
+            VTEX_CACHE_PAGES * VTEX_PAGE > maxTextureSize) {
+        fprintf(stderr, "%s:%u: %s needs textures larger than %d\n", __FILE__, __LINE__, lpFilename, maxTextureSize);
+        closeVirtualTexture();
+        return 0;
+    }
+
+    lpPageOfTile = (int32_t*)malloc(header.tileCount * sizeof(*lpPageOfTile));
+    lpNeededFrame = (uint32_t*)calloc(header.tileCount, sizeof(*lpNeededFrame));
+    lpNeeded = (uint32_t*)malloc(header.tileCount * sizeof(*lpNeeded));
+    lpTileFailed = (unsigned char*)calloc(header.tileCount, 1);
+    lpIndirection = (unsigned char*)malloc((size_t)indirectionWidth * indirectionHeight * 4);
+    for (k = 0; k < VTEX_STAGING; k++)
+        staging[k].lpTexels = (unsigned char*)malloc(VTEX_TILE_BYTES);
+    for (k = 0; k < VTEX_STAGING && staging[k].lpTexels != NULL; k++)
+        ;
+    if (lpPageOfTile == NULL || lpNeededFrame == NULL || lpNeeded == NULL || lpTileFailed == NULL ||
+            lpIndirection == NULL || k < VTEX_STAGING || !buildVirtualProgram()) {
+        fprintf(stderr, "%s:%u: Failed to set up the virtual texture\n", __FILE__, __LINE__);
+        closeVirtualTexture();
+        return 0;
+    }
+    for (k = 0; k < (int)header.tileCount; k++)
+        lpPageOfTile[k] = NO_PAGE;
+    for (k = 0; k < CACHE_SIZE; k++)
+        pages[k].tile = -1;
+
+    glGenTextures(1, &cacheTexture);
+    glBindTexture(GL_TEXTURE_2D, cacheTexture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, VTEX_CACHE_PAGES * VTEX_PAGE, VTEX_CACHE_PAGES * VTEX_PAGE, 0, GL_RGBA,
+                 GL_UNSIGNED_BYTE, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    glGenTextures(1, &indirectionTexture);
+    glBindTexture(GL_TEXTURE_2D, indirectionTexture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8UI, indirectionWidth, indirectionHeight, 0, GL_RGBA_INTEGER,
+                 GL_UNSIGNED_BYTE, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+    // The coarsest level stands in for every tile until better ones arrive.
+    if (!readTile(header.tileCount - 1, staging[0].lpTexels)) {
+        fprintf(stderr, "%s:%u: Failed to read file %s\n", __FILE__, __LINE__, lpFilename);
+        closeVirtualTexture();
+        return 0;
+    }
+    uploadPage(PINNED_PAGE, header.tileCount - 1, staging[0].lpTexels);
+    updateIndirection();
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    stopping = 0;
+    loaderStarted = pthread_create(&loader, NULL, loaderThread, NULL) == 0;
+    if (!loaderStarted) {
+        fprintf(stderr, "%s:%u: Failed to start the tile loader\n", __FILE__, __LINE__);
+        closeVirtualTexture();
+        return 0;
+    }
+    printf("%s: %ux%u, %u levels, %d pages of cache\n", lpFilename, header.levels[0].width, header.levels[0].height,
+           header.levelCount, CACHE_SIZE);
+    return 1;
+}
+
+void closeVirtualTexture() {
+    int k;
+
+    if (loaderStarted) {
+        pthread_mutex_lock(&lock);
+        stopping = 1;
+        pthread_cond_signal(&wake);
+        pthread_mutex_unlock(&lock);
+        pthread_join(loader, NULL);
+        loaderStarted = 0;
+    }
+    if (file >= 0)
+        close(file);
+    file = -1;
+    glDeleteProgram(program);
+    glDeleteTextures(1, &cacheTexture);
+    glDeleteTextures(1, &indirectionTexture);
+    program = cacheTexture = indirectionTexture = 0;
+    free(lpPageOfTile);
+    free(lpNeededFrame);
+    free(lpNeeded);
+    free(lpTileFailed);
+    free(lpIndirection);
+    lpPageOfTile = NULL;
+    lpNeededFrame = lpNeeded = NULL;
+    lpTileFailed = NULL;
+    lpIndirection = NULL;
+    for (k = 0; k < VTEX_STAGING; k++) {
+        free(staging[k].lpTexels);
+        staging[k].lpTexels = NULL;
+        staging[k].state = STAGED_FREE;
+    }
+    requestCount = nextRequest = 0;
+}
@@ -0,0 +1,42 @@
+
+/* Virtual texturing of the ball (--virtual-texture FILE.vtex).  Ball art of 16k
+ * or 32k texels does not fit in GPU memory with its mip chain, or not in the
+ * texture size limit at all, so it is baked into tiles (see vtexfile.h) and only
+ * the tiles the current view needs are kept on the GPU.
+ *
+ * The GPU side is a fixed page cache, one texture of VTEX_CACHE_PAGES x
+ * VTEX_CACHE_PAGES pages, and an indirection texture with one entry per tile of
+ * every level telling which page holds it.  An absent tile points at the page of
+ * its finest resident ancestor, so sampling never misses: the ball shows a
+ * coarser level there until the tile arrives.  The one tile of the coarsest level
+ * is loaded up front and never evicted.
+ *
+ * updateVirtualTexture() runs on the main thread before the ball is drawn.  It
+ * finds the tiles the frame needs by evaluating the impostor's texture
+ * coordinates and footprint on a grid of screen points, marks the resident ones
+ * as used and queues the others, coarsest first, for a loader thread that reads
+ * them from the file.  Loaded tiles are uploaded a few per frame into the least
+ * recently used pages.  Memory is bounded by the cache and VTEX_STAGING tiles in
+ * flight, whatever the size of the file.
+ *
+ * drawVirtualBall() draws the ball impostor (see scene.h) sampling through the
+ * indirection texture.
+ */
+
+#ifndef VTEX_H
+#define VTEX_H
+
+#include <GL/gl.h>
+
+#define VTEX_CACHE_PAGES 16         // pages per side of the cache texture
+#define VTEX_STAGING 8              // tiles being read or waiting for upload
+#define VTEX_UPLOADS_PER_FRAME 8
+#define VTEX_SAMPLE_STEP 8          // pixels between the points of the visibility grid
+
+int openVirtualTexture(const char* lpFilename);
+void updateVirtualTexture(const GLfloat* lpSphereModel, int viewportWidth, int viewportHeight, int wait);
+int virtualTextureBusy();
+void drawVirtualBall(const GLfloat* lpSphereModel);
+void closeVirtualTexture();
+
+#endif
@@ -0,0 +1,49 @@
+/* On-disk layout of a virtual texture written by "bake-textures --virtual" (bake.c)
+ * and streamed by vtex.c.  The source image, typically a 16k or 32k equirectangular
+ * ball texture, is stored as a mip pyramid cut into tiles of VTEX_TILE x VTEX_TILE
+ * texels, each with a VTEX_BORDER texel border copied from its neighbours, so a
+ * tile is one VTEX_PAGE x VTEX_PAGE page of GL_RGBA / GL_UNSIGNED_BYTE texels that
+ * filters bilinearly on its own:
+ *
+ *    struct vtexHeader
+ *    tiles, from dataOffset on: level 0 row by row, then level 1, ...
+ *
+ * Level sizes halve rounding down like the mip chains of the texture pack, until
+ * the last level fits in one tile.  Tile (x, y) of level l is tile number
+ * levels[l].firstTile + y * levels[l].tilesX + x.  The borders wrap around in s,
+ * where the texture closes around the ball, and repeat the edge rows in t; texels
+ * past the right edge of the last tile column wrap around as well.  Host byte
+ * order, as for texpack.h.
+ */
+
+#ifndef VTEXFILE_H
+#define VTEXFILE_H
+
+#include <stdint.h>
+
+#define VTEX_MAGIC 0x58455456       // "VTEX"
+#define VTEX_VERSION 1
+#define VTEX_TILE 128
+#define VTEX_BORDER 1
+#define VTEX_PAGE (VTEX_TILE + 2 * VTEX_BORDER)
+#define VTEX_TILE_BYTES (VTEX_PAGE * VTEX_PAGE * 4)
+#define VTEX_MAX_LEVELS 16
+#define VTEX_ALIGNMENT 4096
+
+struct vtexLevel {
+    uint32_t width, height;         // texels
+    uint32_t tilesX, tilesY;
+    uint64_t firstTile;
+};
+
+struct vtexHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t levelCount;            // level 0 is the full resolution image
+    uint32_t reserved;
+    uint64_t tileCount;
+    uint64_t dataOffset;            // of tile 0, from the start of the file
+    struct vtexLevel levels[VTEX_MAX_LEVELS];
+};
+
+#endif
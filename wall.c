@@ -0,0 +1,148 @@
+
+/* Indicator wall, see wall.h. */
+
+#define GL_GLEXT_PROTOTYPES
+
+#include <GL/gl.h>
+#include <GL/glext.h>
+#include <stdio.h>
+#include <math.h>
+#include "scene.h"
+#include "overlay.h"
+#include "perf.h"
+#include "lod.h"
+#include "texture.h"
+#include "wall.h"
+
+#define REFERENCE_SIZE 720.0f       // cell size in pixels the line widths are made for
+
+/* Four texels per indicator: roll, pitch and cell center x, y; then the columns of
+ * the ball's rotation Rz(roll + 90) Ry(pitch) Rx(90), with cos and sin of roll for
+ * the ring in the w of the first two and 1 for a stale indicator in the last.
+ * Computing the rotations here once per indicator keeps the trigonometry out of
+ * the vertex shader.
+ */
+static GLfloat indicators[WALL_MAX_INDICATORS][4][4];
+static int indicatorCount = 1;
+static int layoutWidth = 1, layoutHeight = 1;
+static float cellScaleX = 1.0f, cellScaleY = 1.0f, cellPixels = REFERENCE_SIZE;
+static int wallLevel = 2;           // level of detail for the cell size, see lod.h
+static GLuint indicatorBuffer, indicatorTexture;
+
+/* Creates the indicator buffer texture.  Returns 0 on failure. */
+int buildWall() {
+    glGenBuffers(1, &indicatorBuffer);
+    glBindBuffer(GL_TEXTURE_BUFFER, indicatorBuffer);
+    glBufferData(GL_TEXTURE_BUFFER, sizeof(indicators[0]), indicators, GL_STREAM_DRAW);
+    glGenTextures(1, &indicatorTexture);
+    glBindTexture(GL_TEXTURE_BUFFER, indicatorTexture);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, indicatorBuffer);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    if (glGetError() != GL_NO_ERROR) {
+        fprintf(stderr, "%s:%u: Failed to create the indicator buffer texture\n", __FILE__, __LINE__);
+        return 0;
+    }
+    return 1;
+}
+
+void setWallCount(int count) {
+    if (count < 1)
+        count = 1;
+    if (count > WALL_MAX_INDICATORS)
+        count = WALL_MAX_INDICATORS;
+    indicatorCount = count;
+    layoutWall(layoutWidth, layoutHeight);
+}
+
+void layoutWall(int w, int h) {
+    int columns, rows, bestColumns = 1, i;
+    float cell, best = 0.0f, left, top;
+
+    layoutWidth = w > 0 ? w : 1;
+    layoutHeight = h > 0 ? h : 1;
+    for (columns = 1; columns <= indicatorCount; columns++) {
+        rows = (indicatorCount + columns - 1) / columns;
+        cell = (float)layoutWidth / columns < (float)layoutHeight / rows ? (float)layoutWidth / columns
+                                                                       : (float)layoutHeight / rows;
+        if (cell > best) {
+            best = cell;
+            bestColumns = columns;
+        }
+    }
+    columns = bestColumns;
+    rows = (indicatorCount + columns - 1) / columns;
+
+    // Cell size in normalized device coordinates, and the top left cell's corner.
+    cellPixels = best;
+    wallLevel = selectLod(cellPixels);
+    setTextureDetail((int)cellPixels);
+    cellScaleX = best / layoutWidth;
+    cellScaleY = best / layoutHeight;
+    left = -columns * cellScaleX;
+    top = rows * cellScaleY;
+    for (i = 0; i < indicatorCount; i++) {
+        indicators[i][0][2] = left + (2 * (i % columns) + 1) * cellScaleX;
+        indicators[i][0][3] = top - (2 * (i / columns) + 1) * cellScaleY;
+    }
+}
+
+void setWallAttitude(int index, float rollDegrees, float pitchDegrees) {
+    GLfloat (*lpTexels)[4];
+    float cz, sz, cy, sy, cr, sr;
+
+    if (index < 0 || index >= indicatorCount)
+        return;
+    lpTexels = indicators[index];
+    lpTexels[0][0] = rollDegrees;
+    lpTexels[0][1] = pitchDegrees;
+
+    cz = cosf((rollDegrees + 90.0f) * (float)M_PI / 180.0f);
+    sz = sinf((rollDegrees + 90.0f) * (float)M_PI / 180.0f);
+    cy = cosf(pitchDegrees * (float)M_PI / 180.0f);
+    sy = sinf(pitchDegrees * (float)M_PI / 180.0f);
+    cr = cosf(rollDegrees * (float)M_PI / 180.0f);
+    sr = sinf(rollDegrees * (float)M_PI / 180.0f);
+
+    // Rz * Ry * Rx(90), where Rx(90) maps the x, y, z axes to x, z, -y.
+    lpTexels[1][0] = cz * cy;       // column 0 = Rz Ry x
+    lpTexels[1][1] = sz * cy;
+    lpTexels[1][2] = -sy;
+    lpTexels[1][3] = cr;
+    lpTexels[2][0] = cz * sy;       // column 1 = Rz Ry z
+    lpTexels[2][1] = sz * sy;
+    lpTexels[2][2] = cy;
+    lpTexels[2][3] = sr;
+    lpTexels[3][0] = sz;            // column 2 = -(Rz Ry y) = -Rz y
+    lpTexels[3][1] = -cz;
+    lpTexels[3][2] = 0.0f;
+    lpTexels[3][3] = 0.0f;         // not stale
+}
+
+/* Leaves the indicator out of the drawing until its next setWallAttitude(). */
+void setWallStale(int index) {
+    if (index < 0 || index >= indicatorCount)
+        return;
+    indicators[index][3][3] = 1.0f;
+}
+
+/* Uploads the indicators and draws all of them with the meshes of the level
+ * layoutWall() picked.  Marks the sphere, ring and overlay phases for perf.h.
+ */
+void drawWall(GLuint sphereTexture, GLuint ringTexture) {
+    glBindBuffer(GL_TEXTURE_BUFFER, indicatorBuffer);
+    // A new data store each frame, so the driver never waits for the previous frame.
+    glBufferData(GL_TEXTURE_BUFFER, indicatorCount * sizeof(indicators[0]), indicators, GL_STREAM_DRAW);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+    drawSceneWall(lodSphere(wallLevel), lodRing(wallLevel), sphereTexture, ringTexture, indicatorTexture, indicatorCount,
+                  cellScaleX, cellScaleY);
+    drawOverlayWall(indicatorTexture, indicatorCount, cellScaleX, cellScaleY, cellPixels / REFERENCE_SIZE);
+    perfMark(PERF_OVERLAY);
+}
+
+void deleteWall() {
+    glDeleteTextures(1, &indicatorTexture);
+    glDeleteBuffers(1, &indicatorBuffer);
+    indicatorTexture = indicatorBuffer = 0;
+}
@@ -0,0 +1,36 @@
+
+/* Indicator wall: many attitude indicators in a grid filling the window, for
+ * watching a whole fleet at once.  Every indicator is a roll, pitch and cell
+ * center in one GL_RGBA32F buffer texture, uploaded once per frame.  The shaders
+ * of scene.c and overlay.c read it by instance number, so all balls, all rings
+ * and all overlays take two instanced draw calls each, whatever the number of
+ * indicators, and share the texture[] objects.
+ *
+ * Indicator 0 shows this station's attitude and indicator n the telemetry of
+ * vehicle n (see telemetry.h).  setWallStale() blanks an indicator that has had
+ * no sample for WALL_STALE_SECONDS, or none at all, until setWallAttitude()
+ * gives it one, so the wall never shows an attitude it does not know.
+ *
+ * layoutWall() picks the column count that gives the largest square cells for
+ * the window and centers the grid; call it from reshape() and after
+ * setWallCount().  It also picks the level of detail for the cell size (see
+ * lod.h); all indicators share one cell size, so they share that level.
+ */
+
+#ifndef WALL_H
+#define WALL_H
+
+#include <GL/gl.h>
+
+#define WALL_MAX_INDICATORS 4096
+#define WALL_STALE_SECONDS 2.0
+
+int buildWall();
+void setWallCount(int count);
+void layoutWall(int w, int h);
+void setWallAttitude(int index, float rollDegrees, float pitchDegrees);
+void setWallStale(int index);
+void drawWall(GLuint sphereTexture, GLuint ringTexture);
+void deleteWall();
+
+#endif